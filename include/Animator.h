@@ -62,4 +62,10 @@ public:
 	 */
 	void tick(float dt);
 
+	/**
+	 * @brief Adds the objects the animator's animations move to the given list. Animators that
+	 * move none of the same objects may be ticked at the same time on different threads.
+	 */
+	void collectTargets(std::vector<Object3D*>& targets) const;
+
 };
\ No newline at end of file
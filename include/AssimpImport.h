@@ -1,10 +1,91 @@
 #pragma once
 #include "Object3D.h"
+#include "ModelCache.h"
+#include "TextureCooker.h"
+#include "TextureStreamer.h"
+#include "GeometryArena.h"
 #include <assimp/scene.h>
 #include <unordered_map>
 #include <filesystem>
 
-Object3D assimpLoad(const std::string& path, bool flipUVCoords);
-Object3D processAssimpNode(aiNode* node, const aiScene* scene,
-	const std::filesystem::path& modelPath,
-	std::unordered_map<std::filesystem::path, Texture>& loadedTextures);
\ No newline at end of file
+/**
+ * @brief Loads a model file and uploads it to the GPU.
+ * @param streamer if given, textures are streamed in over the next frames instead of being
+ * uploaded before this returns.
+ * @param compressTextures whether to load the model's images as block-compressed textures.
+ * @param arena if given, the model's meshes are placed in it.
+ */
+Object3D assimpLoad(const std::string& path, bool flipUVCoords, TextureStreamer* streamer = nullptr,
+	bool compressTextures = false, GeometryArena* arena = nullptr);
+
+/**
+ * @brief The Assimp post-processing flags used to import a model.
+ */
+uint32_t assimpImportFlags(bool flipUVCoords);
+
+/**
+ * @brief Runs Assimp on a model file and converts the post-processed scene to CPU-side data.
+ */
+ModelData assimpConvert(const std::string& path, uint32_t importFlags);
+
+/**
+ * @brief Chooses whether .obj files are parsed with objConvert rather than Assimp, and on how
+ * many threads. On by default, with one thread, since models are usually loaded several at a time.
+ */
+void setObjImport(bool enabled, size_t threadCount = 1);
+
+/**
+ * @brief The importer convertModel picks for a model file.
+ */
+ModelImporter modelImporterFor(const std::string& path);
+
+/**
+ * @brief Converts a model file to CPU-side data with the importer picked for it: objConvert
+ * for .obj files when enabled, assimpConvert for everything else.
+ */
+ModelData convertModel(const std::string& path, uint32_t importFlags);
+
+/**
+ * @brief Converts a model file with convertModel, then optimizes each mesh for the vertex
+ * cache, overdraw and vertex fetch, and packs the meshes whose vertices allow it. This is the
+ * form the model cache stores.
+ */
+ModelData assimpImport(const std::string& path, uint32_t importFlags);
+
+/**
+ * @brief Loads the post-processed data of a model file from the cache, importing it and
+ * writing the cache first if there is no valid entry for the file's current contents.
+ * @param cacheHit set to whether the model was served from the cache.
+ */
+CachedModel loadCachedModel(const std::string& path, uint32_t importFlags, bool& cacheHit);
+
+/**
+ * @brief A model whose CPU-side loading is finished: its post-processed data is in memory and
+ * its images are decoded, so only the GPU upload remains.
+ */
+struct PreparedModel {
+	std::string path;
+	CachedModel model;
+	// The prepared images, in the same order as the model's image list.
+	std::vector<PreparedImage> images;
+	bool cacheHit;
+	// Time spent loading the model data and decoding its images.
+	double prepareMilliseconds;
+};
+
+/**
+ * @brief Does all of the CPU work of loading a model: reading it from the cache or importing
+ * it, then decoding its images. Makes no OpenGL calls, so it may run on any thread.
+ * @param compressTextures whether to load the images as block-compressed textures, cooking
+ * any that aren't in the texture cache yet.
+ */
+PreparedModel prepareModel(const std::string& path, uint32_t importFlags, bool compressTextures = false);
+
+/**
+ * @brief Uploads a prepared model's meshes and textures to the GPU and builds its object
+ * hierarchy. Must run on the thread that owns the OpenGL context.
+ * @param streamer if given, the prepared images are handed to it to be streamed in over the
+ * next frames; otherwise they are uploaded before this returns.
+ * @param arena if given, the model's meshes are placed in it instead of buffers of their own.
+ */
+Object3D instantiateModel(PreparedModel&& prepared, TextureStreamer* streamer = nullptr, GeometryArena* arena = nullptr);
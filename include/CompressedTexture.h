@@ -0,0 +1,100 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+/**
+ * @brief The block-compressed formats textures are cooked to. The values are the matching
+ * Vulkan formats, which is how KTX2 files identify them.
+ */
+enum class BlockFormat : uint32_t {
+	// Opaque color: 4 bits per texel.
+	BC1 = 131,
+	// Color with alpha: 8 bits per texel.
+	BC3 = 137,
+	// Two independent channels, for normal and distortion maps: 8 bits per texel.
+	BC5 = 141,
+};
+
+/**
+ * @brief The size in bytes of one 4x4 block of a format.
+ */
+uint32_t blockBytes(BlockFormat format);
+
+/**
+ * @brief One mip level of a compressed texture.
+ */
+struct CompressedLevel {
+	uint32_t width;
+	uint32_t height;
+	// Location of the level's blocks in the container.
+	size_t offset;
+	size_t size;
+};
+
+/**
+ * @brief A block-compressed texture with its complete mip chain, stored in a KTX2 container.
+ * The container is either memory-mapped from disk or held in memory after cooking; level
+ * data is read straight out of it for upload.
+ */
+class CompressedTexture {
+private:
+	MappedFile m_file;
+	std::vector<uint8_t> m_bytes;
+	const uint8_t* m_data;
+	size_t m_size;
+	BlockFormat m_format;
+	uint32_t m_width;
+	uint32_t m_height;
+	std::vector<CompressedLevel> m_levels;
+	uint64_t m_sourceHash;
+	uint32_t m_cookerVersion;
+
+	bool parse();
+
+public:
+	CompressedTexture();
+
+	/**
+	 * @brief Maps a KTX2 file. Returns false if it is missing, malformed, or uses a format
+	 * other than the ones we cook.
+	 */
+	bool open(const std::filesystem::path& path);
+	/**
+	 * @brief Takes ownership of an in-memory KTX2 container.
+	 */
+	bool adopt(std::vector<uint8_t>&& bytes);
+
+	/**
+	 * @brief Builds a KTX2 container from encoded mip levels, level 0 first.
+	 */
+	static std::vector<uint8_t> serialize(BlockFormat format, const std::vector<std::vector<uint8_t>>& levels,
+		uint32_t width, uint32_t height, uint64_t sourceHash, uint32_t cookerVersion);
+
+	bool isValid() const;
+	BlockFormat format() const;
+	uint32_t width() const;
+	uint32_t height() const;
+	size_t levelCount() const;
+	const CompressedLevel& level(size_t index) const;
+	const uint8_t* levelData(size_t index) const;
+	// The hash of the image file the texture was cooked from, and the cooker that did it.
+	uint64_t sourceHash() const;
+	uint32_t cookerVersion() const;
+	// The size of all levels in VRAM.
+	size_t gpuBytes() const;
+
+	/**
+	 * @brief The OpenGL internal format for the texture's blocks.
+	 */
+	GLenum glInternalFormat() const;
+
+	/**
+	 * @brief Whether the current OpenGL context can sample every format we cook to.
+	 * Must be called on the thread that owns the context.
+	 */
+	static bool isSupported();
+};
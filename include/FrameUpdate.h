@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include "Animator.h"
+#include "Object3D.h"
+#include "TransformHierarchy.h"
+#include "WorkStealingPool.h"
+
+/**
+ * @brief The per-frame update of a set of scenes, spread over a WorkStealingPool. Each frame it
+ * ticks the animators, in parallel except where they move the same objects, then updates the
+ * world matrices of the TransformHierarchy one level at a time, then the world bounds of each
+ * root object's subtree in parallel. Every stage finishes before run() returns, so rendering
+ * afterward sees the matrices and bounds of one whole frame, and none are written while it
+ * draws.
+ */
+class FrameUpdate {
+private:
+	WorkStealingPool& m_pool;
+	TransformHierarchy& m_transforms;
+	std::vector<Animator*> m_animators;
+	// The animators, split so that no two groups move the same object. Each group is ticked in
+	// order by one thread, so animators sharing an object apply their changes as they would
+	// serially.
+	std::vector<std::vector<Animator*>> m_animatorGroups;
+	std::vector<Object3D*> m_roots;
+
+	void groupAnimators();
+
+public:
+	/**
+	 * @brief Updates the objects whose nodes are in the given hierarchy.
+	 */
+	explicit FrameUpdate(WorkStealingPool& pool, TransformHierarchy& transforms = TransformHierarchy::shared());
+
+	/**
+	 * @brief Adds animators to tick each frame. They are referred to by address, so the vector
+	 * must not be resized while they are in use.
+	 */
+	void addAnimators(std::vector<Animator>& animators);
+	/**
+	 * @brief Adds root objects whose bounds are updated each frame. As with animators, the
+	 * vector must not be resized afterward.
+	 */
+	void addObjects(std::vector<Object3D>& objects);
+	/**
+	 * @brief Stops updating the bounds of a root object, which must be done before it is
+	 * destroyed or moved.
+	 */
+	void removeObject(const Object3D& object);
+
+	/**
+	 * @brief Advances the animators by dt seconds, then brings every world matrix and bound up
+	 * to date.
+	 */
+	void run(float dt);
+};
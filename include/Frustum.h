@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/**
+ * @brief An axis-aligned bounding box.
+ */
+struct BoundingBox {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+/**
+ * @brief The volume a camera sees: the six planes of its view-projection matrix, plus an
+ * optional clip plane for passes that clip geometry away with gl_ClipDistance. The planes are
+ * stored side by side, one array per component, so that bounds are tested against four planes
+ * or four volumes at a time with SSE where it is available.
+ */
+class Frustum {
+public:
+	// Six frustum planes, the clip plane, and one that never rejects, to fill two groups of four.
+	static const size_t PLANE_COUNT = 8;
+
+private:
+	// The x, y and z of each plane's inward-facing unit normal, and its distance from the origin.
+	alignas(16) float m_normalX[PLANE_COUNT];
+	alignas(16) float m_normalY[PLANE_COUNT];
+	alignas(16) float m_normalZ[PLANE_COUNT];
+	alignas(16) float m_distance[PLANE_COUNT];
+
+	void setPlane(size_t index, const glm::vec4& plane);
+
+public:
+	/**
+	 * @brief Extracts the frustum of a camera.
+	 * @param viewProjection the camera's projection * view matrix.
+	 * @param clipPlane geometry on the negative side of this plane is rejected as well, as
+	 * with the plane of FrameUniforms; all zeros for none.
+	 */
+	Frustum(const glm::mat4& viewProjection, const glm::vec4& clipPlane = glm::vec4(0));
+
+	/**
+	 * @brief Whether any of a box may be visible. Boxes that straddle a plane count as visible.
+	 */
+	bool intersects(const BoundingBox& box) const;
+
+	/**
+	 * @brief Tests many boxes, writing 1 for each that may be visible and 0 for each that can't.
+	 */
+	void cullBoxes(const BoundingBox* boxes, size_t count, uint8_t* visible) const;
+
+	/**
+	 * @brief Tests many spheres, each a center in xyz and a radius in w, writing 1 for each that
+	 * may be visible and 0 for each that can't.
+	 */
+	void cullSpheres(const glm::vec4* spheres, size_t count, uint8_t* visible) const;
+};
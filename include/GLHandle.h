@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * @brief Owns the name of one OpenGL object, deleting the object when destroyed. Handles can be
+ * moved but not copied, so each object has exactly one owner; objects that several meshes or
+ * instances use are shared by sharing the owner of their handle, as Mesh3D and Texture do.
+ * A handle holding 0 owns nothing. Handles must be destroyed while their context is current.
+ * @tparam Traits provides static create() and destroy(uint32_t) for one kind of object.
+ */
+template <typename Traits>
+class GLHandle {
+private:
+	uint32_t m_name;
+
+public:
+	GLHandle() : m_name(0) {
+	}
+
+	/**
+	 * @brief Takes ownership of an existing object.
+	 */
+	explicit GLHandle(uint32_t name) : m_name(name) {
+	}
+
+	/**
+	 * @brief Creates a new object.
+	 */
+	static GLHandle create() {
+		return GLHandle(Traits::create());
+	}
+
+	~GLHandle() {
+		reset();
+	}
+
+	GLHandle(const GLHandle&) = delete;
+	GLHandle& operator=(const GLHandle&) = delete;
+
+	GLHandle(GLHandle&& other) noexcept : m_name(other.release()) {
+	}
+
+	GLHandle& operator=(GLHandle&& other) noexcept {
+		if (this != &other) {
+			reset(other.release());
+		}
+		return *this;
+	}
+
+	uint32_t get() const {
+		return m_name;
+	}
+
+	explicit operator bool() const {
+		return m_name != 0;
+	}
+
+	/**
+	 * @brief Gives up ownership of the object without deleting it.
+	 */
+	uint32_t release() {
+		auto name = m_name;
+		m_name = 0;
+		return name;
+	}
+
+	/**
+	 * @brief Deletes the owned object, if any, and takes ownership of another.
+	 */
+	void reset(uint32_t name = 0) {
+		if (m_name != 0) {
+			Traits::destroy(m_name);
+		}
+		m_name = name;
+	}
+};
+
+struct GLBufferTraits {
+	static uint32_t create();
+	static void destroy(uint32_t name);
+};
+
+struct GLVertexArrayTraits {
+	static uint32_t create();
+	static void destroy(uint32_t name);
+};
+
+struct GLTextureTraits {
+	static uint32_t create();
+	static void destroy(uint32_t name);
+};
+
+struct GLQueryTraits {
+	static uint32_t create();
+	static void destroy(uint32_t name);
+};
+
+using GLBuffer = GLHandle<GLBufferTraits>;
+using GLVertexArray = GLHandle<GLVertexArrayTraits>;
+using GLTexture = GLHandle<GLTextureTraits>;
+using GLQuery = GLHandle<GLQueryTraits>;
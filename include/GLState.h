@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+/**
+ * @brief How many state changes made through GLState reached OpenGL, and how many were
+ * skipped because the state was already set.
+ */
+struct GLStateStats {
+	size_t issued;
+	size_t skipped;
+};
+
+/**
+ * @brief A shadow copy of the OpenGL binding state of the context: the current program, vertex
+ * array, framebuffer, active texture unit, the 2D texture bound to each unit, and a few enable
+ * flags. Setting a state to the value it already has never reaches the driver. Every bind of
+ * these in the engine must go through here, or the shadow goes stale; after code that binds
+ * behind its back, call invalidate().
+ */
+class GLState {
+public:
+	// Each change returns whether it reached OpenGL.
+	static bool useProgram(uint32_t program);
+	static bool bindVertexArray(uint32_t vertexArray);
+	// Binds both the draw and read framebuffer.
+	static bool bindFramebuffer(uint32_t framebuffer);
+	// The unit is a zero-based index, not a GL_TEXTURE0 + i enum.
+	static bool activeTexture(uint32_t unit);
+	// Binds a 2D texture to the active unit.
+	static bool bindTexture(uint32_t texture);
+	// Binds a 2D texture to a unit, making that unit active if the binding changes.
+	static bool bindTexture(uint32_t unit, uint32_t texture);
+	// Enables or disables a capability. GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST,
+	// GL_STENCIL_TEST and GL_CLIP_DISTANCE0 are shadowed; others always reach OpenGL.
+	static bool setEnabled(GLenum capability, bool enabled);
+
+	/**
+	 * @brief Forgets the shadowed state, so the next change of each state reaches OpenGL.
+	 */
+	static void invalidate();
+	/**
+	 * @brief Records the deletion of a vertex array or texture. OpenGL unbinds a deleted object
+	 * wherever it is bound, so the shadow must stop claiming it is; otherwise a new object that
+	 * reuses its name would be taken as already bound.
+	 */
+	static void vertexArrayDeleted(uint32_t vertexArray);
+	static void textureDeleted(uint32_t texture);
+	/**
+	 * @brief How many vertex arrays have been deleted. Caches keyed by vertex array name must be
+	 * dropped when this changes, as a new vertex array may have been given a deleted one's name.
+	 */
+	static uint64_t vertexArrayDeletions();
+
+	/**
+	 * @brief When on, every change is followed by reading the shadowed state back with glGet*
+	 * and throwing std::runtime_error if any of it disagrees. Slow; meant for debug builds.
+	 */
+	static void setVerifying(bool verifying);
+	/**
+	 * @brief Compares the shadowed state with OpenGL's now, throwing std::runtime_error on the
+	 * first difference. States not yet known are not compared.
+	 */
+	static void verify();
+
+	/**
+	 * @brief The state changes made since the last reset.
+	 */
+	static GLStateStats stats();
+	static void resetStats();
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "GLHandle.h"
+#include "Mesh3D.h"
+
+/**
+ * @brief Where a mesh's data was placed in a GeometryArena.
+ */
+struct GeometryAllocation {
+	// The vertex array that draws the arena's meshes of this vertex format.
+	uint32_t vertexArray;
+	// Added to each of the mesh's indices when drawing, with a base-vertex draw call.
+	uint32_t baseVertex;
+	// The position of the mesh's first index in the arena's index buffer.
+	uint32_t firstIndex;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	bool packed;
+};
+
+/**
+ * @brief Sub-allocates the vertices and indices of many meshes from a few large buffers: one
+ * vertex buffer and one index buffer per vertex format, each pair drawn through one vertex
+ * array. Meshes in an arena then draw without switching vertex arrays between them, and can
+ * be submitted together with a multi-draw. Buffers grow by copying when full, and never shrink;
+ * the space of meshes that are gone is reused by later ones, so loading and unloading scenes
+ * doesn't grow them past the most that was loaded at once.
+ */
+class GeometryArena {
+	// A run of unused vertices or indices.
+	struct Range {
+		size_t offset;
+		size_t count;
+	};
+
+	struct Pool {
+		GLVertexArray vertexArray;
+		GLBuffer vertexBuffer;
+		GLBuffer indexBuffer;
+		size_t vertexCapacity = 0;
+		size_t vertexCount = 0;
+		size_t indexCapacity = 0;
+		size_t indexCount = 0;
+		// Freed runs below vertexCount and indexCount, in order and never adjacent.
+		std::vector<Range> freeVertices;
+		std::vector<Range> freeIndices;
+	};
+
+	// One pool for Vertex3D, one for PackedVertex3D.
+	Pool m_pools[2];
+	size_t m_initialVertices;
+	size_t m_initialIndices;
+
+	std::shared_ptr<const GeometryAllocation> add(Pool& pool, bool packed, const void* vertices, size_t vertexCount,
+		const uint32_t* indices, size_t indexCount);
+	void reserve(Pool& pool, bool packed, size_t vertexCount, size_t indexCount);
+	void release(const GeometryAllocation& allocation);
+	static size_t takeFree(std::vector<Range>& free, size_t count);
+	static void giveBack(std::vector<Range>& free, size_t& used, size_t offset, size_t count);
+
+public:
+	/**
+	 * @brief Creates an empty arena. Its buffers are created with room for the given counts
+	 * once the first mesh of a vertex format is added.
+	 */
+	GeometryArena(size_t initialVertices = 1 << 18, size_t initialIndices = 1 << 20);
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	/**
+	 * @brief Copies a mesh's vertices and indices into the arena. The space is given back when
+	 * the last copy of the returned pointer is gone, which must be before the arena is.
+	 */
+	std::shared_ptr<const GeometryAllocation> add(const Vertex3D* vertices, size_t vertexCount,
+		const uint32_t* indices, size_t indexCount);
+	std::shared_ptr<const GeometryAllocation> add(const PackedVertex3D* vertices, size_t vertexCount,
+		const uint32_t* indices, size_t indexCount);
+
+	/**
+	 * @brief The VRAM held by the arena's buffers, including unused capacity.
+	 */
+	size_t bufferBytes() const;
+	/**
+	 * @brief The part of bufferBytes() holding the data of live meshes.
+	 */
+	size_t usedBytes() const;
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief What a block of VRAM is used for, for reporting.
+ */
+enum class GpuCategory : uint8_t {
+	// Vertex and index buffers of meshes outside a GeometryArena.
+	MeshBuffers,
+	// The shared vertex and index buffers of GeometryArenas, including unused capacity.
+	GeometryArena,
+	// Textures sampled by meshes.
+	Textures,
+	// Textures drawn into, like the water's reflection and refraction.
+	RenderTargets,
+	// Buffers rewritten as the frame is drawn: instance data, indirect commands, uniform blocks
+	// and texture staging.
+	DynamicBuffers,
+	Count
+};
+
+/**
+ * @brief The live allocations of one category, and the most it has held at once.
+ */
+struct GpuCategoryUsage {
+	size_t objects;
+	size_t bytes;
+	size_t peakBytes;
+};
+
+/**
+ * @brief The kinds of GL object whose storage is tracked. Names are only unique within a kind.
+ */
+enum class GpuObject : uint8_t {
+	Buffer,
+	Texture
+};
+
+/**
+ * @brief Records the VRAM held by every buffer, texture and render target the engine creates,
+ * with the category and owner of each. Code that gives a GL object storage records it here;
+ * GLHandle forgets the object when it deletes it. Sizes are what the engine asked for, which
+ * drivers may round up.
+ *
+ * Only the thread that owns the OpenGL context may use it.
+ */
+class GpuMemory {
+private:
+	struct Record {
+		GpuCategory category;
+		size_t bytes;
+		std::string owner;
+	};
+
+	std::unordered_map<uint64_t, Record> m_records;
+	std::array<GpuCategoryUsage, static_cast<size_t>(GpuCategory::Count)> m_usage;
+	size_t m_totalBytes;
+	size_t m_peakBytes;
+	// Attributes new records to something more specific than the class that allocated them.
+	std::string m_ownerLabel;
+
+	static uint64_t key(GpuObject kind, uint32_t name);
+
+public:
+	GpuMemory();
+
+	GpuMemory(const GpuMemory&) = delete;
+	GpuMemory& operator=(const GpuMemory&) = delete;
+
+	/**
+	 * @brief The registry the engine's GL objects are recorded in.
+	 */
+	static GpuMemory& shared();
+
+	/**
+	 * @brief Records that an object holds the given storage, replacing what was recorded for it
+	 * before, as when a buffer is reallocated at a new size.
+	 * @param owner what allocated the object, unless an OwnerLabel is in effect.
+	 */
+	void track(GpuObject kind, uint32_t name, GpuCategory category, size_t bytes, const char* owner);
+	/**
+	 * @brief Records that an object was deleted. Objects never tracked are ignored.
+	 */
+	void forget(GpuObject kind, uint32_t name);
+
+	/**
+	 * @brief Attributes the mesh buffers and textures tracked while it lives to the given owner,
+	 * like the model being loaded. An inner label replaces an outer one until it ends.
+	 */
+	class OwnerLabel {
+	private:
+		std::string m_previous;
+
+	public:
+		explicit OwnerLabel(const std::string& owner);
+		~OwnerLabel();
+		OwnerLabel(const OwnerLabel&) = delete;
+		OwnerLabel& operator=(const OwnerLabel&) = delete;
+	};
+
+	size_t totalBytes() const;
+	size_t peakBytes() const;
+	GpuCategoryUsage usage(GpuCategory category) const;
+	/**
+	 * @brief The bytes recorded for an owner, across all categories.
+	 */
+	size_t ownerBytes(const std::string& owner) const;
+
+	static const char* categoryName(GpuCategory category);
+
+	/**
+	 * @brief Prints the live objects and bytes of each category, and the largest owners.
+	 */
+	void printReport(std::ostream& out, size_t topOwners = 5) const;
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Animator.h"
+#include "FrameUpdate.h"
+#include "GLHandle.h"
+#include "ModelRegistry.h"
+#include "Object3D.h"
+#include "Profiler.h"
+#include "RenderContext.h"
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
+#include "UniformBuffer.h"
+#include "WorkStealingPool.h"
+
+/**
+ * @brief Objects drawn with one shader program, and the animators that move them.
+ */
+struct Scene {
+	ShaderProgram program;
+	std::vector<Object3D> objects;
+	std::vector<Animator> animators;
+};
+
+/**
+ * @brief The lake the application shows: cliffs, terrain, a tree and a torch around a lake in
+ * which a bass swims up to eat a duck. The water reflects and refracts the rest, so each frame
+ * is drawn in three passes: the reflection and refraction into the water's render targets, then
+ * the main view, water included, into the target framebuffer.
+ *
+ * Time only advances through update(), so a fixed timestep replays the same frames every run.
+ * Only the thread that owns the OpenGL context may use it.
+ */
+class LakeScene {
+public:
+	// The frame uniform slot, and RenderContext::pass, of each pass.
+	static const size_t REFLECTION_PASS = 0;
+	static const size_t REFRACTION_PASS = 1;
+	static const size_t MAIN_PASS = 2;
+	static const size_t PASS_COUNT = 3;
+
+private:
+	uint32_t m_width;
+	uint32_t m_height;
+	Scene m_lake;
+	Scene m_bass;
+	Scene m_water;
+	GLTexture m_reflectionTarget;
+	GLTexture m_refractionTarget;
+	uint32_t m_reflectionFramebuffer;
+	uint32_t m_refractionFramebuffer;
+	UniformBuffer m_frameUniforms;
+	UniformBuffer m_lightingUniforms;
+	RenderQueue m_renderQueue;
+	FrameUpdate m_frameUpdate;
+	glm::mat4 m_perspective;
+	float m_projectionScale;
+	// Seconds of scene time, and the phase of the water's ripples.
+	float m_time;
+	float m_moveFactor;
+	std::array<RenderContext, PASS_COUNT> m_passes;
+
+	void createRenderTarget(GLTexture& texture, uint32_t& framebuffer, const char* owner);
+
+public:
+	/**
+	 * @brief The models the scene instantiates, to preload.
+	 */
+	static std::vector<std::string> modelPaths();
+
+	/**
+	 * @brief Builds the scene from the registry's models, for a viewport of the given size. Its
+	 * per-frame updates run on the given pool.
+	 */
+	LakeScene(ModelRegistry& models, WorkStealingPool& workers, uint32_t width, uint32_t height, bool compressTextures);
+	~LakeScene();
+
+	LakeScene(const LakeScene&) = delete;
+	LakeScene& operator=(const LakeScene&) = delete;
+
+	/**
+	 * @brief Advances the animation and the water by dt seconds, and brings every world matrix
+	 * and bound up to date.
+	 */
+	void update(float dt);
+
+	/**
+	 * @brief Draws a frame seen from the camera into the given framebuffer, timing each pass with
+	 * the GPU profiler when profiling is built in.
+	 */
+	void render(const glm::vec3& cameraPos, const glm::vec3& center, const glm::vec3& up, uint32_t framebuffer,
+		GpuProfiler& gpuProfiler);
+
+	/**
+	 * @brief The counts of the last frame's passes, indexed by pass. Their frustums are not kept.
+	 */
+	const std::array<RenderContext, PASS_COUNT>& passes() const;
+	float time() const;
+};
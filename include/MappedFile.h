@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief A read-only view of a file's contents, mapped into the process's address space.
+ * The mapping lives as long as the MappedFile; moving transfers ownership of it.
+ */
+class MappedFile {
+private:
+	const uint8_t* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+
+	void close();
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	/**
+	 * @brief Maps the file at the given path. Returns false if the file cannot be opened or
+	 * mapped, leaving this object empty.
+	 */
+	bool open(const std::string& path);
+
+	bool isOpen() const;
+	const uint8_t* data() const;
+	size_t size() const;
+};
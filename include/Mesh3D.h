@@ -1,10 +1,13 @@
 #pragma once
 #include <glm/ext.hpp>
 #include <glad/glad.h>
+#include <memory>
 #include <vector>
 
+#include "GLHandle.h"
 #include "Texture.h"
 #include "ShaderProgram.h"
+#include "RenderContext.h"
 struct Vertex3D {
 	float x;
 	float y;
@@ -22,12 +25,117 @@ struct Vertex3D {
 		x(px), y(py), z(pz), nx(normX), ny(normY), nz(normZ), u(texU), v(texV) {}
 };
 
+/**
+ * @brief A 16-byte vertex, half the size of Vertex3D. The position is quantized to 16 bits per
+ * axis within the mesh's bounds, the normal is packed as 10:10:10:2 signed normalized bits,
+ * and the texture coordinate is two half floats. See VertexPacking.h.
+ */
+struct PackedVertex3D {
+	int16_t x;
+	int16_t y;
+	int16_t z;
+	int16_t padding;
+
+	// GL_INT_2_10_10_10_REV: x in the low 10 bits, then y, then z.
+	uint32_t normal;
+
+	uint16_t u;
+	uint16_t v;
+};
+
+/**
+ * @brief Maps the quantized positions of a PackedVertex3D mesh back to model space:
+ * position = quantized * scale + offset.
+ */
+struct VertexQuantization {
+	glm::vec3 scale;
+	glm::vec3 offset;
+};
+
+/**
+ * @brief The first vertex attribute location of the per-instance model matrix read by instanced
+ * shaders. A mat4 attribute takes four locations, one per column.
+ */
+const uint32_t INSTANCE_MODEL_LOCATION = 3;
+
+/**
+ * @brief The vertex attribute locations of the per-instance quantization scale and offset read by
+ * instanced shaders, which replace the positionScale and positionOffset uniforms so that one
+ * multi-draw can draw meshes with different quantizations.
+ */
+const uint32_t INSTANCE_POSITION_SCALE_LOCATION = 7;
+const uint32_t INSTANCE_POSITION_OFFSET_LOCATION = 8;
+
+/**
+ * @brief The first vertex attribute location of the per-instance normal matrix read by instanced
+ * shaders. A mat3 attribute takes three locations, one per column.
+ */
+const uint32_t INSTANCE_NORMAL_MATRIX_LOCATION = 9;
+
+/**
+ * @brief The layout of one draw in a GL_DRAW_INDIRECT_BUFFER, as read by
+ * glMultiDrawElementsIndirect.
+ */
+struct DrawElementsIndirectCommand {
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
+};
+
+class GeometryArena;
+
+/**
+ * @brief The most levels of detail a mesh has, counting the full-detail mesh.
+ */
+const uint32_t MAX_MESH_LODS = 4;
+
+/**
+ * @brief A level of detail of a mesh: a range of its index buffer that draws a simplified
+ * version of it, using the same vertices.
+ */
+struct MeshLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// How far the simplified surface strays from the full-detail one, in model units.
+	float error;
+};
+
+/**
+ * @brief The vertex array and buffers of a mesh that was not placed in a GeometryArena.
+ */
+struct MeshBuffers {
+	GLVertexArray vertexArray;
+	GLBuffer vertexBuffer;
+	GLBuffer indexBuffer;
+};
+
 class Mesh3D {
 private:
 	uint32_t m_vao;
+	// Keeps the mesh's data on the GPU: its MeshBuffers, or its GeometryAllocation in an arena.
+	// Copies of a mesh, like the instances of one model, share it, and the last copy frees it.
+	std::shared_ptr<const void> m_storage;
+	// Where the mesh's data starts in its buffers, which it shares with other meshes if it was
+	// placed in a GeometryArena; both are 0 otherwise.
+	uint32_t m_baseVertex;
+	uint32_t m_firstIndex;
 	std::vector<Texture> m_textures;
 	uint32_t m_vertexCount;
 	uint32_t m_faceCount;
+	// The size of one vertex in the vertex buffer.
+	uint32_t m_vertexBytes;
+	VertexQuantization m_quantization;
+	// The mesh's levels of detail, finest first. Level 0 is the full mesh.
+	std::vector<MeshLod> m_lods;
+	// The mesh's bounding box in model space, and the radius of its bounding sphere, which is
+	// centered on the box.
+	glm::vec3 m_boundsMin;
+	glm::vec3 m_boundsMax;
+	float m_boundsRadius;
+
+	void upload(const void* vertices, const uint32_t* faces);
 
 public:
 	Mesh3D() = delete;
@@ -44,12 +152,90 @@ public:
 	Mesh3D(std::vector<Vertex3D>&& vertices, std::vector<uint32_t>&& faces,
 		std::vector<Texture>&& textures);
 
+	/**
+	 * @brief Constructs a Mesh3D by uploading vertices and faces from existing memory, such as a
+	 * memory-mapped model cache, without copying them first.
+	 * @param arena if given, the data is placed in the arena's shared buffers instead of buffers
+	 * of the mesh's own.
+	*/
+	Mesh3D(const Vertex3D* vertices, size_t vertexCount, const uint32_t* faces, size_t faceCount,
+		std::vector<Texture>&& textures, GeometryArena* arena = nullptr);
+
+	/**
+	 * @brief Constructs a Mesh3D from packed vertices, whose positions are decoded in the vertex
+	 * shader using the given quantization.
+	*/
+	Mesh3D(const PackedVertex3D* vertices, size_t vertexCount, const VertexQuantization& quantization,
+		const uint32_t* faces, size_t faceCount, std::vector<Texture>&& textures, GeometryArena* arena = nullptr);
+
+	/**
+	 * @brief Describes the attributes of Vertex3D, or of PackedVertex3D if packed, to the bound
+	 * vertex array, reading from the bound GL_ARRAY_BUFFER.
+	*/
+	static void describeVertexLayout(bool packed);
+
 	void addTexture(Texture texture);
 
+	/**
+	 * @brief Sets the mesh's levels of detail, which must all lie within its index buffer.
+	*/
+	void setLods(std::vector<MeshLod>&& lods);
+	size_t lodCount() const;
+	const MeshLod& getLod(size_t lod) const;
+
+	/**
+	 * @brief The corners of the mesh's bounding box in model space.
+	*/
+	const glm::vec3& getBoundsMin() const;
+	const glm::vec3& getBoundsMax() const;
+	/**
+	 * @brief The mesh's bounding sphere in model space: its center in xyz, which is the center of
+	 * the bounding box, and its radius in w.
+	*/
+	glm::vec4 getBoundingSphere() const;
+
+	/**
+	 * @brief How the vertex shader maps the mesh's vertex positions to model space; the identity
+	 * for unpacked meshes.
+	*/
+	const VertexQuantization& getQuantization() const;
+
+	/**
+	 * @brief The textures bound when drawing the mesh.
+	*/
+	const std::vector<Texture>& getTextures() const;
+
+	/**
+	 * @brief The mesh's vertex array object. Copies of a Mesh3D share the same vertex array, as
+	 * do all meshes of one vertex format in a GeometryArena.
+	*/
+	uint32_t getVertexArray() const;
+
+	/**
+	 * @brief Identifies the mesh's vertex and index data. Copies of a Mesh3D have the same id.
+	*/
+	uint64_t getGeometryId() const;
+
+	/**
+	 * @brief The number of meshes, this one included, sharing the mesh's data on the GPU.
+	*/
+	long storageUseCount() const;
+
+	/**
+	 * @brief The indirect draw command that draws instanceCount instances of one of the mesh's
+	 * levels of detail, reading per-instance attributes from baseInstance onwards.
+	*/
+	DrawElementsIndirectCommand indirectCommand(size_t lod, uint32_t instanceCount, uint32_t baseInstance) const;
+
+	/**
+	 * @brief The size of the mesh's vertex and index buffers in VRAM.
+	*/
+	size_t bufferBytes() const;
+
 	/**
 	 * @brief Constructs a 1x1 square centered at the origin in world space.
 	*/
-	static Mesh3D square(const std::vector<Texture>& textures);
+	static Mesh3D square(std::vector<Texture>&& textures);
 	
 	/**
 	 * @brief Renders the mesh to the given context.
@@ -58,5 +244,15 @@ public:
 	 * @param proj the view->clip projection matrix.
 	*/
 	void render(ShaderProgram& program) const;
+	/**
+	 * @brief Renders one of the mesh's levels of detail.
+	 * @param stats if given, counts the draw and the binds it took.
+	*/
+	void render(ShaderProgram& program, size_t lod, RenderStats* stats = nullptr) const;
+	/**
+	 * @brief Issues the draw call for one of the mesh's levels of detail, leaving binding its
+	 * vertex array, textures and uniforms to the caller.
+	*/
+	void draw(size_t lod) const;
 	
 };
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Mesh3D.h"
+
+/**
+ * @brief The size of the FIFO post-transform vertex cache that meshes are optimized for and
+ * measured against.
+ */
+const uint32_t VERTEX_CACHE_SIZE = 16;
+
+/**
+ * @brief How well an index buffer uses the post-transform vertex cache.
+ */
+struct VertexCacheStats {
+	// Average cache miss ratio: vertex shader runs per triangle. 0.5 is ideal for large grids, 3 is worst.
+	float acmr;
+	// Average transformed vertex ratio: vertex shader runs per vertex. 1 is ideal.
+	float atvr;
+};
+
+/**
+ * @brief Simulates a FIFO vertex cache over an index buffer.
+ */
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+	uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+/**
+ * @brief Reorders triangles for the post-transform vertex cache, using Tipsify (Sander, Nehab
+ * and Barczak 2007).
+ * @param clusters if given, receives the index offsets where Tipsify had to jump to a
+ * disconnected part of the mesh; the triangles between them are locally connected.
+ */
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount,
+	std::vector<size_t>* clusters = nullptr, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+/**
+ * @brief Reorders clusters of a cache-optimized index buffer so that triangles likely to
+ * occlude others, from any view, are drawn first. Clusters are split further where that costs
+ * at most threshold times their vertex cache misses.
+ */
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex3D>& vertices,
+	const std::vector<size_t>& clusters, float threshold = 1.05f, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+/**
+ * @brief Reorders vertices into the order the index buffer first uses them, so vertex fetches
+ * walk memory sequentially. Unreferenced vertices are dropped.
+ */
+void optimizeVertexFetch(std::vector<Vertex3D>& vertices, std::vector<uint32_t>& indices);
+
+/**
+ * @brief Vertex cache efficiency of a mesh before and after optimization.
+ */
+struct MeshOptimizationReport {
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+/**
+ * @brief Runs every optimization on a mesh: vertex cache, then overdraw, then vertex fetch.
+ */
+MeshOptimizationReport optimizeMesh(std::vector<Vertex3D>& vertices, std::vector<uint32_t>& indices);
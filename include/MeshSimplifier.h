@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Mesh3D.h"
+
+/**
+ * @brief Simplifies a mesh with quadric error metrics (Garland and Heckbert 1997). Edges are
+ * collapsed onto one of their own vertices, so the simplified index buffer reuses the original
+ * vertex buffer. Vertices on open edges never move; since vertices that differ in normal or
+ * texture coordinate are separate vertices, this also keeps attribute seams intact.
+ * @param targetIndexCount stop once the mesh has at most this many indices.
+ * @param maxError never make a collapse whose error, the root mean square distance of the
+ * collapsed vertex from the planes of the triangles merged into it, exceeds this, in model units.
+ * @param resultError if given, receives the largest error of any collapse made.
+ * @return the simplified index buffer.
+ */
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float maxError, float* resultError = nullptr);
+
+/**
+ * @brief Builds up to MAX_MESH_LODS - 1 simplified versions of a mesh, each with about half the
+ * triangles of the one before. Their indices are appended to the index buffer, cache-optimized.
+ * Stops early once a mesh no longer simplifies well.
+ * @return the levels of detail, starting with the full mesh.
+ */
+std::vector<MeshLod> generateLods(const std::vector<Vertex3D>& vertices, std::vector<uint32_t>& indices);
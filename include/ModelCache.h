@@ -0,0 +1,234 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glm/ext.hpp>
+
+#include "Mesh3D.h"
+#include "MappedFile.h"
+
+/**
+ * @brief The version of the on-disk model cache layout. Bump this whenever the layout, or the
+ * import pipeline that produces the cached data, changes; stale caches are then re-imported.
+ */
+const uint32_t MODEL_CACHE_VERSION = 6;
+
+/**
+ * @brief Binds one of a model's images to a sampler2D uniform of a mesh.
+ */
+struct TextureBinding {
+	// Index into ModelData::images.
+	uint32_t image;
+	std::string samplerName;
+};
+
+/**
+ * @brief The CPU-side geometry and texture references of a single imported mesh.
+ */
+struct MeshData {
+	std::vector<Vertex3D> vertices;
+	// If not empty, the packed form of the vertices, which is what gets cached and uploaded.
+	std::vector<PackedVertex3D> packedVertices;
+	VertexQuantization quantization;
+	std::vector<uint32_t> indices;
+	// Index ranges of the mesh's levels of detail. If empty, the whole index buffer is the only level.
+	std::vector<MeshLod> lods;
+	std::vector<TextureBinding> textures;
+};
+
+/**
+ * @brief One node of an imported model's hierarchy. Nodes are stored breadth-first, so the
+ * children of a node are contiguous and always come after their parent.
+ */
+struct NodeData {
+	std::string name;
+	glm::mat4 transform;
+	// Indices into ModelData::meshes.
+	std::vector<uint32_t> meshes;
+	uint32_t firstChild;
+	uint32_t childCount;
+};
+
+/**
+ * @brief The post-processed result of importing a model file, before anything is uploaded
+ * to the GPU. Node 0 is the root.
+ */
+struct ModelData {
+	// Paths of the image files referenced by the model's meshes.
+	std::vector<std::string> images;
+	std::vector<MeshData> meshes;
+	std::vector<NodeData> nodes;
+	// Paths of the other files the import read, such as material libraries and glTF buffers.
+	// Cached data is only used while they are unchanged. Images are not included; their
+	// contents are checked by the texture cache.
+	std::vector<std::string> dependencies;
+};
+
+/**
+ * @brief Which parser produced a model's data. Cached data is kept separately for each.
+ */
+enum class ModelImporter : uint32_t {
+	Assimp = 0,
+	// The built-in OBJ parser, see ObjImport.h.
+	Obj = 1,
+};
+
+// On-disk records of the model cache. All offsets are relative to the start of the file.
+struct CacheStringRef {
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct CacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t importFlags;
+	ModelImporter importer;
+	CacheStringRef sourcePath;
+	uint32_t imageCount;
+	uint32_t meshCount;
+	uint32_t bindingCount;
+	uint32_t nodeCount;
+	uint32_t nodeMeshCount;
+	uint32_t dependencyCount;
+	uint64_t imagesOffset;
+	uint64_t meshesOffset;
+	uint64_t bindingsOffset;
+	uint64_t nodesOffset;
+	uint64_t nodeMeshesOffset;
+	uint64_t dependenciesOffset;
+	uint64_t stringsOffset;
+};
+
+/**
+ * @brief The layout of a cached mesh's vertices.
+ */
+enum class VertexFormat : uint32_t {
+	// Vertex3D.
+	Float = 0,
+	// PackedVertex3D.
+	Packed = 1,
+};
+
+struct CacheMeshRecord {
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t firstBinding;
+	uint32_t bindingCount;
+	VertexFormat vertexFormat;
+	float positionScale[3];
+	float positionOffset[3];
+	uint32_t lodCount;
+	MeshLod lods[MAX_MESH_LODS];
+};
+
+struct CacheBindingRecord {
+	uint32_t image;
+	CacheStringRef samplerName;
+};
+
+struct CacheDependencyRecord {
+	CacheStringRef path;
+	// The hash of the file's contents when it was imported, or 0 if it could not be read.
+	uint64_t hash;
+};
+
+struct CacheNodeRecord {
+	float transform[16];
+	CacheStringRef name;
+	uint32_t firstMesh;
+	uint32_t meshCount;
+	uint32_t firstChild;
+	uint32_t childCount;
+};
+
+/**
+ * @brief A read-only view of a serialized model, either memory-mapped from the cache
+ * directory or held in memory when the cache could not be written. Vertex and index spans
+ * point directly into the serialized bytes, so they can be handed to the GPU without a copy.
+ */
+class CachedModel {
+private:
+	MappedFile m_file;
+	std::vector<uint8_t> m_bytes;
+	const uint8_t* m_data;
+	size_t m_size;
+
+	bool validate();
+	std::string_view string(const CacheStringRef& ref) const;
+	template <typename T>
+	std::span<const T> records(uint64_t offset, size_t count) const {
+		return std::span<const T>(reinterpret_cast<const T*>(m_data + offset), count);
+	}
+
+public:
+	CachedModel();
+
+	/**
+	 * @brief Maps a cache file. Returns false if it is missing, truncated, corrupt, or from a
+	 * different cache version.
+	 */
+	bool open(const std::filesystem::path& cachePath);
+	/**
+	 * @brief Takes ownership of an in-memory serialized model. Returns false if it is invalid.
+	 */
+	bool adopt(std::vector<uint8_t>&& bytes);
+
+	/**
+	 * @brief Whether the cached data was produced from the given source file contents, import
+	 * flags and importer, and the files the import read besides the source are unchanged.
+	 */
+	bool matches(const std::string& sourcePath, uint64_t sourceHash, uint32_t importFlags, ModelImporter importer) const;
+
+	const CacheHeader& header() const;
+	bool isMapped() const;
+	size_t byteSize() const;
+
+	std::string_view image(size_t index) const;
+	VertexFormat vertexFormat(size_t mesh) const;
+	// The vertices of a mesh in VertexFormat::Float.
+	std::span<const Vertex3D> vertices(size_t mesh) const;
+	// The vertices of a mesh in VertexFormat::Packed, and how to decode their positions.
+	std::span<const PackedVertex3D> packedVertices(size_t mesh) const;
+	VertexQuantization quantization(size_t mesh) const;
+	std::span<const uint32_t> indices(size_t mesh) const;
+	std::span<const MeshLod> lods(size_t mesh) const;
+	std::span<const CacheBindingRecord> bindings(size_t mesh) const;
+	std::string_view samplerName(const CacheBindingRecord& binding) const;
+	const CacheNodeRecord& node(size_t index) const;
+	std::span<const uint32_t> nodeMeshes(size_t node) const;
+	std::string_view nodeName(size_t node) const;
+};
+
+/**
+ * @brief Hashes a block of bytes (64-bit FNV-1a over 8-byte words).
+ */
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+
+/**
+ * @brief Hashes the contents of a file. Returns false if the file cannot be read.
+ */
+bool hashFile(const std::string& path, uint64_t& hash);
+
+/**
+ * @brief The path of the cache file for a source model, set of import flags and importer.
+ */
+std::filesystem::path modelCachePath(const std::string& sourcePath, uint32_t importFlags, ModelImporter importer);
+
+/**
+ * @brief Serializes an imported model into the cache layout.
+ */
+std::vector<uint8_t> serializeModel(const ModelData& model, const std::string& sourcePath,
+	uint64_t sourceHash, uint32_t importFlags, ModelImporter importer);
+
+/**
+ * @brief Writes a cache file, replacing any existing file atomically.
+ * Returns false if the cache directory is not writable.
+ */
+bool writeCacheFile(const std::filesystem::path& cachePath, const std::vector<uint8_t>& bytes);
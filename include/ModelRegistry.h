@@ -0,0 +1,124 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include "Object3D.h"
+#include "ThreadPool.h"
+#include "TextureStreamer.h"
+#include "GeometryArena.h"
+
+/**
+ * @brief Loads each model file at most once, and hands out instances of it that share the
+ * loaded meshes and textures on the GPU. Each instance is its own Object3D hierarchy, so it
+ * can be placed and animated independently of the others.
+ *
+ * Models stay loaded after their last instance is gone, so that the next request for them is
+ * free, until they exceed the memory budget: then the models with no live instances are
+ * unloaded, least recently instantiated first.
+ */
+class ModelRegistry {
+private:
+	struct Entry {
+		// The loaded model, which instances are copied from. It is never rendered itself.
+		Object3D prototype;
+		// The VRAM held by the model's buffers and textures.
+		size_t gpuBytes;
+		size_t instanceCount;
+		// When the model was last loaded or instantiated, on the registry's use clock.
+		uint64_t lastUsed;
+	};
+
+	std::unordered_map<std::string, Entry> m_models;
+	// The order models were first loaded in, for reporting.
+	std::vector<std::string> m_loadOrder;
+	TextureStreamer* m_streamer;
+	GeometryArena* m_arena;
+	bool m_compressTextures;
+	size_t m_budgetBytes;
+	uint64_t m_useClock;
+	size_t m_unloadCount;
+
+	static std::string key(const std::string& path, bool flipUVCoords);
+	Entry& add(const std::string& key, Object3D&& prototype);
+	static bool hasLiveInstances(const Object3D& prototype);
+	static size_t liveInstanceCount(const Object3D& prototype);
+	size_t evictUnused(size_t budgetBytes, bool keepPreloaded);
+
+public:
+	ModelRegistry();
+
+	/**
+	 * @brief Streams the textures of models loaded from now on through the given streamer,
+	 * instead of uploading them while loading.
+	 */
+	void setTextureStreamer(TextureStreamer* streamer);
+	/**
+	 * @brief Loads the textures of models loaded from now on as block-compressed textures.
+	 */
+	void setTextureCompression(bool compress);
+	/**
+	 * @brief Places the meshes of models loaded from now on in the given arena, so that they
+	 * can be drawn together with multi-draws.
+	 */
+	void setGeometryArena(GeometryArena* arena);
+	/**
+	 * @brief Sets how much VRAM loaded models may hold before unused ones are unloaded, which
+	 * is checked whenever instantiate loads a model. Models preloaded but not yet instantiated
+	 * are kept until unloadUnused is called. 0, the default, keeps every model loaded.
+	 */
+	void setMemoryBudget(size_t bytes);
+
+	/**
+	 * @brief Unloads models with no live instances, least recently instantiated first, until the
+	 * loaded models hold at most the given VRAM or none are left unused. Returns how many were
+	 * unloaded. Call with 0 after switching scenes to free everything the new one doesn't use.
+	 */
+	size_t unloadUnused(size_t budgetBytes);
+
+	/**
+	 * @brief Loads many model files at once. The CPU-side work for each file (parsing, post-
+	 * processing and image decoding or cooking) runs on the pool's workers, while the GPU uploads happen on
+	 * the calling thread as each file becomes ready. Files that are already loaded are skipped.
+	 * Prints the time each file took and the total wall time.
+	 */
+	void preload(const std::vector<std::string>& paths, bool flipUVCoords, ThreadPool& pool);
+
+	/**
+	 * @brief Returns a new instance of the model at the given path, loading the file if this is
+	 * the first request for it.
+	 */
+	Object3D instantiate(const std::string& path, bool flipUVCoords);
+
+	/**
+	 * @brief The number of model files loaded now.
+	 */
+	size_t loadCount() const;
+	/**
+	 * @brief The number of models unloaded so far.
+	 */
+	size_t unloadCount() const;
+	/**
+	 * @brief The VRAM held by the loaded models.
+	 */
+	size_t residentBytes() const;
+	/**
+	 * @brief The number of instances handed out across all models.
+	 */
+	size_t instanceCount() const;
+	/**
+	 * @brief The VRAM that loading each live instance separately would have used on top of what
+	 * the registry uses.
+	 */
+	size_t bytesSaved() const;
+
+	/**
+	 * @brief Prints each model's load and instance counts, and the VRAM saved by sharing.
+	 */
+	void printReport(std::ostream& out) const;
+
+	/**
+	 * @brief The VRAM used by an object's meshes and textures, counting each shared buffer
+	 * and texture once.
+	 */
+	static size_t gpuBytes(const Object3D& object);
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "ModelCache.h"
+
+/**
+ * @brief Parses a Wavefront OBJ file and the MTL libraries it references straight into
+ * CPU-side model data, without Assimp. The file is memory-mapped and parsed in place; faces
+ * are fan-triangulated and vertices with the same position, normal and texture coordinate
+ * are merged. Meshes are split by material, and all hang off a single root node.
+ * Of the import flags, only aiProcess_FlipUVs is honored; missing normals are always
+ * generated smoothly.
+ * @param threadCount how many threads to split the file's lines across. Small files are
+ * always parsed on the calling thread.
+ */
+ModelData objConvert(const std::string& path, uint32_t importFlags, size_t threadCount = 1);
+
+/**
+ * @brief Parses a decimal floating-point number at the start of a buffer, the way OBJ files
+ * write them. Returns a pointer just past the number, or begin if there is none.
+ */
+const char* parseObjFloat(const char* begin, const char* end, float& value);
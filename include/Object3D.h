@@ -2,29 +2,54 @@
 #include <memory>
 #include "ShaderProgram.h"
 #include "Mesh3D.h"
+#include "RenderContext.h"
+#include "Frustum.h"
+#include "TransformHierarchy.h"
+class RenderQueue;
 class Object3D {
 private:
 	// The object's list of meshes and children.
 	std::vector<Mesh3D> m_meshes;
 	std::vector<Object3D> m_children;
 
-	// The object's position, orientation, and scale in world space.
-	glm::vec3 m_position;
-	glm::vec3 m_orientation;
-	glm::vec3 m_scale;
-	glm::vec3 m_center;
+	// The object's position, orientation, scale, center and base transformation, and its local
+	// and world matrices, live in a node of a TransformHierarchy, parented to its parent's node.
+	// The mutators flag the node dirty; updateWorld brings the hierarchy's matrices up to date.
+	TransformHierarchy* m_transforms;
+	TransformHierarchy::NodeId m_node;
+	// The world version of the node when the bounds were last computed.
+	uint32_t m_boundsVersion;
 
 	// The object's material.
 	glm::vec4 m_material;
 
-	// The object's base transformation matrix.
-	glm::mat4 m_baseTransform;
-
 	// Some objects from Assimp imports have a "name" field, useful for debugging.
 	std::string m_name;
 
-	// Recomputes the local->world transformation matrix.
-	glm::mat4 buildModelMatrix() const;
+	// The level of detail last picked for each mesh in each pass, indexed by
+	// pass * m_meshes.size() + mesh, so switching levels can lag behind by the hysteresis.
+	mutable std::vector<uint8_t> m_selectedLods;
+
+	// World space bounds as of the last updateWorld: a sphere and a box around each mesh, and a
+	// box around the object and all its descendants. The children's boxes are copied side by side so
+	// that they can be tested against a frustum together.
+	std::vector<glm::vec4> m_meshSpheres;
+	std::vector<BoundingBox> m_meshBounds;
+	std::vector<BoundingBox> m_childBounds;
+	BoundingBox m_worldBounds;
+	size_t m_subtreeMeshCount;
+	bool m_hasWorldBounds;
+	// Which meshes and children passed the frustum test of the pass being drawn.
+	mutable std::vector<uint8_t> m_meshVisible;
+	mutable std::vector<uint8_t> m_childVisible;
+
+	// Picks the level of detail of one mesh for a pass.
+	size_t selectLod(size_t mesh, const glm::mat4& model, const RenderContext& context) const;
+	bool cullSubtree(RenderContext& context) const;
+	void cullContents(RenderContext& context) const;
+	void updateBounds(bool transformChanged, bool childrenChanged);
+	void renderRecursive(ShaderProgram& shaderProgram, RenderContext* context) const;
+	void enqueueRecursive(ShaderProgram& shaderProgram, RenderContext& context, RenderQueue& queue) const;
 
 
 public:
@@ -33,6 +58,15 @@ public:
 
 	Object3D(std::vector<Mesh3D>&& meshes);
 	Object3D(std::vector<Mesh3D>&& meshes, const glm::mat4& baseTransform);
+	// Creates the object's node in the given hierarchy rather than the shared one. Its children
+	// must belong to the same hierarchy.
+	Object3D(std::vector<Mesh3D>&& meshes, const glm::mat4& baseTransform, TransformHierarchy& transforms);
+	// Copies get nodes of their own, with the same transforms, for the copy and its descendants.
+	Object3D(const Object3D& other);
+	Object3D(Object3D&& other) noexcept;
+	Object3D& operator=(const Object3D& other);
+	Object3D& operator=(Object3D&& other) noexcept;
+	~Object3D();
 
 	// Simple accessors.
 	const glm::vec3& getPosition() const;
@@ -41,6 +75,7 @@ public:
 	const glm::vec3& getCenter() const;
 	const std::string& getName() const;
 	const glm::vec4& getMaterial() const;
+	const std::vector<Mesh3D>& getMeshes() const;
 
 	// Child management.
 	size_t numberOfChildren() const;
@@ -62,7 +97,28 @@ public:
 	void grow(const glm::vec3& growth);
 	void addChild(Object3D&& child);
 
-	// Rendering.
+	// World transforms. Updates the object's TransformHierarchy, then recomputes the bounds of
+	// the objects in the hierarchy that moved, or whose ancestors moved, since the last call. Call
+	// it once per frame after moving any of them and before rendering; the passes draw with the
+	// matrices it leaves. Until it is first called, the object is never culled.
+	void updateWorld();
+	// Only the second half of updateWorld: recomputes the bounds from the matrices left by the
+	// hierarchy's last update. Different objects' subtrees may be updated on different threads.
+	// Returns whether anything in the subtree moved.
+	bool updateBounds();
+	const glm::mat4& getWorldMatrix() const;
+	const glm::mat3& getNormalMatrix() const;
+	const BoundingBox& getWorldBounds() const;
+	TransformHierarchy& getTransforms() const;
+	TransformHierarchy::NodeId getNode() const;
+
+	// Rendering. Drawing an object directly takes a program that isn't instanced; instanced
+	// programs are drawn through a RenderQueue.
 	void render(ShaderProgram& shaderProgram) const;
-	void renderRecursive(ShaderProgram& shaderProgram, const glm::mat4& parentMatrix) const;
+	// Renders each mesh at the level of detail that suits its size on screen in the given pass,
+	// skipping those outside the pass's frustum.
+	void render(ShaderProgram& shaderProgram, RenderContext& context) const;
+	// Queues each mesh of the object and its children that is inside the pass's frustum at the
+	// level of detail picked for the pass, to be drawn when the queue is flushed.
+	void enqueue(ShaderProgram& shaderProgram, RenderContext& context, RenderQueue& queue) const;
 };
\ No newline at end of file
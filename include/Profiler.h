@@ -0,0 +1,233 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "GLHandle.h"
+
+/**
+ * @brief Percentiles of a rolling window of durations, in milliseconds.
+ */
+struct DurationPercentiles {
+	size_t samples;
+	float p50;
+	float p95;
+	float p99;
+	float max;
+};
+
+/**
+ * @brief The last samples of a duration, for percentiles that follow recent frames.
+ */
+class RollingDurations {
+private:
+	std::vector<float> m_samples;
+	size_t m_next;
+	size_t m_capacity;
+
+public:
+	explicit RollingDurations(size_t capacity = 600);
+
+	void add(float milliseconds);
+	DurationPercentiles percentiles() const;
+};
+
+/**
+ * @brief Collects timed CPU scopes from any thread, and the GPU times a GpuProfiler resolves.
+ * Each frame's scopes are summed per name into rolling percentiles, alongside the frame time,
+ * and while a capture is running they are also kept for a Chrome trace (chrome://tracing or
+ * Perfetto), with the GPU's times on a track of their own.
+ *
+ * Instrument code with the PROFILE_* macros rather than calling it directly: they compile to
+ * nothing unless GRAPHICS_PROFILING is defined.
+ */
+class Profiler {
+public:
+	using Clock = std::chrono::steady_clock;
+
+private:
+	struct Event {
+		// A string literal, compared by content when aggregating.
+		const char* name;
+		int64_t startNs;
+		int64_t durationNs;
+	};
+	// The events recorded by one thread since the end of the last frame. The lock is only
+	// contended while endFrame() takes the events.
+	struct ThreadLog {
+		std::mutex mutex;
+		std::vector<Event> events;
+		uint32_t threadId;
+	};
+
+	Clock::time_point m_epoch;
+	std::mutex m_mutex;
+	std::vector<std::unique_ptr<ThreadLog>> m_threads;
+	std::vector<Event> m_gpuEvents;
+	int64_t m_frameStartNs;
+	RollingDurations m_frameTimes;
+	std::map<std::string, RollingDurations> m_cpuScopes;
+	std::map<std::string, RollingDurations> m_gpuScopes;
+
+	// Trace capture: the frames left to capture, where to write the trace, and what was captured.
+	size_t m_captureFrames;
+	std::string m_capturePath;
+	std::vector<std::pair<uint32_t, Event>> m_captured;
+
+	ThreadLog& threadLog();
+	void writeTrace() const;
+
+public:
+	Profiler();
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	static Profiler& shared();
+
+	/**
+	 * @brief Nanoseconds since the profiler was created.
+	 */
+	int64_t now() const;
+
+	/**
+	 * @brief Records a finished CPU scope on the calling thread. The name must outlive the
+	 * profiler, as a string literal does.
+	 */
+	void recordCpu(const char* name, int64_t startNs, int64_t endNs);
+	/**
+	 * @brief Records how long the GPU spent on a scope that the CPU began at startNs.
+	 */
+	void recordGpu(const char* name, int64_t startNs, int64_t durationNs);
+
+	/**
+	 * @brief Ends the frame: adds its time and its scopes' times to the rolling percentiles,
+	 * and to the trace if one is being captured. Call once per frame on the render thread.
+	 */
+	void endFrame();
+
+	/**
+	 * @brief Captures the next frames into a Chrome trace-event JSON file, written once the last
+	 * of them ends. Replaces any capture in progress. If the file can't be written, the failure
+	 * is reported on std::cerr and the capture is dropped.
+	 */
+	void captureFrames(size_t frames, const std::string& path);
+	bool capturing() const;
+
+	DurationPercentiles frameTimes() const;
+	/**
+	 * @brief Prints the frame time percentiles and the median and 95th percentile of each scope.
+	 */
+	void printReport(std::ostream& out) const;
+};
+
+/**
+ * @brief Times the enclosing block on the CPU.
+ */
+class ProfileScope {
+private:
+	const char* m_name;
+	int64_t m_startNs;
+
+public:
+	explicit ProfileScope(const char* name) : m_name(name), m_startNs(Profiler::shared().now()) {
+	}
+	~ProfileScope() {
+		Profiler::shared().recordCpu(m_name, m_startNs, Profiler::shared().now());
+	}
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+/**
+ * @brief Times render passes on the GPU with GL_TIME_ELAPSED queries. Results are read a few
+ * frames later, once the GPU has caught up, so timing never makes the CPU wait; a frame whose
+ * results still aren't ready when its queries come around again is dropped instead.
+ * GL_TIME_ELAPSED queries can't nest, so neither can GPU scopes: one begun inside another is
+ * not timed. Only the thread that owns the OpenGL context may use it, and it must be destroyed
+ * while the context is current.
+ */
+class GpuProfiler {
+private:
+	static const size_t FRAMES_IN_FLIGHT = 4;
+
+	struct Query {
+		GLQuery query;
+		const char* name;
+		int64_t startNs;
+	};
+	struct Frame {
+		std::vector<Query> queries;
+		size_t used = 0;
+	};
+
+	std::array<Frame, FRAMES_IN_FLIGHT> m_frames;
+	size_t m_frame;
+	bool m_active;
+	size_t m_dropped;
+
+public:
+	GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	/**
+	 * @brief Starts timing a scope on the GPU. Returns whether it is timed.
+	 */
+	bool begin(const char* name);
+	void end();
+
+	/**
+	 * @brief Moves to the next frame's queries, first collecting the results of the frame that
+	 * last used them. Call once per frame, outside any GPU scope.
+	 */
+	void endFrame();
+
+	/**
+	 * @brief The frames whose GPU times were dropped because the GPU was too far behind.
+	 */
+	size_t droppedFrames() const;
+};
+
+/**
+ * @brief Times the enclosing block on the GPU.
+ */
+class GpuProfileScope {
+private:
+	GpuProfiler& m_profiler;
+	bool m_timed;
+
+public:
+	GpuProfileScope(GpuProfiler& profiler, const char* name) : m_profiler(profiler), m_timed(profiler.begin(name)) {
+	}
+	~GpuProfileScope() {
+		if (m_timed) {
+			m_profiler.end();
+		}
+	}
+	GpuProfileScope(const GpuProfileScope&) = delete;
+	GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef GRAPHICS_PROFILING
+// Times the rest of the enclosing block on the CPU. The name must be a string literal.
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+// Times the rest of the enclosing block on the GPU, with the given GpuProfiler.
+#define PROFILE_GPU_SCOPE(gpuProfiler, name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(gpuProfiler, name)
+// Ends the frame for the profiler and the given GpuProfiler.
+#define PROFILE_FRAME(gpuProfiler) ((gpuProfiler).endFrame(), Profiler::shared().endFrame())
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_GPU_SCOPE(gpuProfiler, name) ((void)0)
+#define PROFILE_FRAME(gpuProfiler) ((void)0)
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+class Frustum;
+
+/**
+ * @brief The largest simplification error, in pixels, that a level of detail may project to on
+ * screen before a finer level is drawn instead.
+ */
+const float LOD_PIXEL_ERROR = 1.0f;
+
+/**
+ * @brief How far below the threshold a level's projected error must fall before a coarser
+ * level is picked, as a fraction of the threshold. Keeps meshes near a switching distance
+ * from flickering between two levels.
+ */
+const float LOD_HYSTERESIS = 0.25f;
+
+/**
+ * @brief Draw calls made to render a pass, and the OpenGL state changes made around them.
+ */
+struct RenderStats {
+	size_t drawCalls = 0;
+	// Meshes drawn, counting each instance; above drawCalls when instancing batches them.
+	size_t meshesDrawn = 0;
+	size_t programBinds = 0;
+	size_t vertexArrayBinds = 0;
+	size_t textureBinds = 0;
+
+	size_t stateChanges() const { return programBinds + vertexArrayBinds + textureBinds; }
+};
+
+/**
+ * @brief Per-pass state for rendering objects: what levels of detail are picked from, and how
+ * many triangles were drawn.
+ */
+struct RenderContext {
+	// The eye position of the pass, in world space.
+	glm::vec3 cameraPosition;
+	// Pixels per world unit at a distance of one unit: viewport height / (2 * tan(fovy / 2)).
+	float projectionScale;
+	// Multiplies the pixel error allowed; passes whose output is blurred or distorted can use
+	// coarser levels of detail with a bias above 1.
+	float lodBias = 1.0f;
+	// Identifies the pass, so each object remembers the level it picked in each pass separately.
+	uint32_t pass = 0;
+	// What the pass's camera sees. Objects whose world bounds are outside it are not drawn; if
+	// null, nothing is culled.
+	const Frustum* frustum = nullptr;
+
+	// Triangles drawn in the pass, and how many the same meshes have at full detail.
+	size_t trianglesDrawn = 0;
+	size_t fullDetailTriangles = 0;
+	// Meshes that passed the frustum test, and meshes that didn't, counting each mesh of a
+	// subtree rejected as a whole.
+	size_t meshesVisible = 0;
+	size_t meshesCulled = 0;
+	// Draw calls and state changes made in the pass.
+	RenderStats stats;
+};
+
+/**
+ * @brief The projection scale of a perspective camera.
+ * @param fovy the vertical field of view, in radians.
+ * @param viewportHeight the height of the render target, in pixels.
+ */
+float projectionScaleFor(float fovy, float viewportHeight);
@@ -0,0 +1,125 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GLHandle.h"
+#include "Mesh3D.h"
+#include "RenderContext.h"
+#include "ShaderProgram.h"
+
+/**
+ * @brief One mesh to draw, with the key the render queue sorts it by.
+ */
+struct DrawItem {
+	uint64_t key;
+	ShaderProgram* program;
+	const Mesh3D* mesh;
+	uint32_t lod;
+	// The local->world model matrix of the mesh, and the matrix that transforms its normals.
+	glm::mat4 model;
+	glm::mat3 normalMatrix;
+};
+
+/**
+ * @brief What an instanced shader reads per instance, at INSTANCE_MODEL_LOCATION and following.
+ * The quantization is per instance because one multi-draw can draw meshes that differ in it.
+ */
+struct InstanceData {
+	glm::mat4 model;
+	glm::vec4 positionScale;
+	glm::vec4 positionOffset;
+	// The normal matrix, with each column padded to a vec4.
+	glm::mat3x4 normalMatrix;
+};
+
+/**
+ * @brief Collects the meshes of a pass, then draws them sorted so that draws sharing a program,
+ * textures and vertex array follow each other, and binds only what changes between them.
+ * With an instanced program, each run of items drawing the same level of detail of the same
+ * vertex array with the same textures, such as the meshes of objects instantiated from one
+ * model, becomes a single instanced draw. Consecutive instanced draws that also share a vertex
+ * array, as meshes placed in one GeometryArena do, are written to an indirect buffer and
+ * submitted with one glMultiDrawElementsIndirect where GL 4.3 is available. Each draw's
+ * baseInstance selects its instances' model matrices, which stands in for a draw id on GL
+ * versions without gl_DrawID. Meshes and programs must outlive the flush that draws them.
+ */
+class RenderQueue {
+	std::vector<DrawItem> m_items;
+
+	/**
+	 * @brief A run of sorted items drawn with the same program, vertex array and textures: either
+	 * one non-instanced item, or the instanced draw commands of one or more meshes.
+	 */
+	struct Batch {
+		size_t firstItem;
+		size_t itemCount;
+		size_t firstCommand;
+		size_t commandCount;
+	};
+	std::vector<Batch> m_batches;
+
+	// The per-instance data of the instanced items of a flush, in draw order, and the buffer it
+	// is uploaded to. The buffer only grows, so attributes left pointing into it stay in range.
+	std::vector<InstanceData> m_instances;
+	GLBuffer m_instanceBuffer;
+	size_t m_instanceBufferBytes;
+	// The vertex arrays whose instance attributes are enabled, with the instance they point at,
+	// as of the given count of vertex array deletions.
+	std::unordered_map<uint32_t, size_t> m_instancedVertexArrays;
+	uint64_t m_vertexArrayDeletions;
+
+	// The draw commands of the instanced batches, and the indirect buffer they are uploaded to.
+	std::vector<DrawElementsIndirectCommand> m_commands;
+	GLBuffer m_commandBuffer;
+	size_t m_commandBufferBytes;
+
+	// Small ids for the programs and texture sets seen so far, which form the middle bits of the
+	// sort keys. Ids are kept from one frame to the next, so the order of a scene is stable.
+	std::vector<uint32_t> m_programs;
+	std::map<std::vector<uint32_t>, uint32_t> m_textureSets;
+	std::vector<uint32_t> m_textureSetScratch;
+	std::unordered_map<uint64_t, uint32_t> m_geometries;
+
+	uint32_t programIndex(const ShaderProgram& program);
+	uint32_t textureSetIndex(const Mesh3D& mesh);
+	uint32_t geometryIndex(const Mesh3D& mesh);
+	void planBatches();
+	void uploadInstances();
+	void uploadCommands();
+	void pointInstanceAttributes(uint32_t vertexArray, size_t firstInstance);
+
+public:
+	RenderQueue();
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	/**
+	 * @brief Builds a sort key: from the most significant bits down, 4 bits of pass, 8 of program,
+	 * 12 of texture set, 8 of vertex array, 10 of geometry, 2 of level of detail and the top 20
+	 * bits of depth, so items draw front to back within each group that can share state or an
+	 * instanced draw, and the meshes of one vertex array follow each other for a multi-draw.
+	 * Ids too large for their field wrap around, which costs extra binds but never a wrong draw.
+	 * @param depth the distance from the camera, which must not be negative.
+	 */
+	static uint64_t makeKey(uint32_t pass, uint32_t program, uint32_t textureSet, uint32_t vertexArray,
+		uint32_t geometry, uint32_t lod, float depth);
+
+	/**
+	 * @brief Queues one level of detail of a mesh, keyed by the context's pass and its distance
+	 * from the context's camera.
+	 */
+	void submit(ShaderProgram& program, const Mesh3D& mesh, size_t lod, const glm::mat4& model,
+		const glm::mat3& normalMatrix, const RenderContext& context);
+
+	size_t size() const;
+	void clear();
+
+	/**
+	 * @brief Sorts and draws every queued item, counting draws and the binds that reached
+	 * OpenGL into stats, then empties the queue.
+	 */
+	void flush(RenderStats& stats);
+};
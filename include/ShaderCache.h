@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief The version of the on-disk program binary layout. Bump this whenever the layout
+ * changes; stale binaries are then rebuilt from source.
+ */
+const uint32_t SHADER_CACHE_VERSION = 1;
+
+// The header of a cached program binary, followed by the binary itself.
+struct ShaderCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	// The driver's format for the binary, as glGetProgramBinary reports it.
+	uint32_t binaryFormat;
+	uint32_t binaryLength;
+};
+
+/**
+ * @brief Whether the driver can save linked programs as binaries and load them back: OpenGL 4.1
+ * with at least one program binary format.
+ */
+bool programBinariesSupported();
+
+/**
+ * @brief Identifies a program built from the given sources by the current driver. Binaries are
+ * only valid for the driver that produced them, so its vendor, renderer and version are hashed
+ * along with the sources.
+ */
+uint64_t programCacheKey(const std::string& vertexCode, const std::string& fragmentCode);
+
+/**
+ * @brief The path of the cached binary of a program.
+ */
+std::filesystem::path programCachePath(uint64_t key);
+
+/**
+ * @brief Loads a program's cached binary into a program object that has no shaders attached.
+ * Returns false if there is none, it is stale, or the driver rejects it, as drivers may after
+ * an update; the program must then be deleted and built from source.
+ */
+bool loadProgramBinary(uint32_t program, uint64_t key);
+
+/**
+ * @brief Caches the binary of a successfully linked program. Returns false if the driver
+ * gives no binary or the cache directory is not writable.
+ */
+bool saveProgramBinary(uint32_t program, uint64_t key);
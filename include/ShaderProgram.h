@@ -1,22 +1,141 @@
 #pragma once
 #include <glm/ext.hpp>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief A uniform's name together with its hash. Constructing one from a string literal in a
+ * constexpr context hashes it at compile time, so repeated lookups never rehash the string.
+ */
+class UniformName {
+	std::string_view m_name;
+	uint64_t m_hash;
+
+	static constexpr uint64_t hash(std::string_view name) {
+		// 64-bit FNV-1a.
+		uint64_t h = 0xcbf29ce484222325ull;
+		for (char c : name) {
+			h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+		}
+		return h;
+	}
+
+public:
+	constexpr UniformName(const char* name) : UniformName(std::string_view(name)) {}
+	constexpr UniformName(std::string_view name) : m_name(name), m_hash(hash(name)) {}
+	UniformName(const std::string& name) : UniformName(std::string_view(name)) {}
+
+	constexpr std::string_view name() const { return m_name; }
+	constexpr uint64_t hashValue() const { return m_hash; }
+};
+
+/**
+ * @brief Identifies an active uniform of one particular ShaderProgram. A handle for a uniform
+ * the program doesn't use is invalid; setting it does nothing.
+ */
+struct UniformHandle {
+	int32_t index = -1;
+
+	bool isValid() const { return index >= 0; }
+};
+
+/**
+ * @brief How many setUniform calls reached OpenGL, and how many were skipped because the
+ * uniform already held the value or isn't used by the program. Summed over every program.
+ */
+struct UniformCallStats {
+	size_t issued;
+	size_t skipped;
+};
+
 class ShaderProgram {
+	// The program's active uniforms, found by introspection at link time, with a copy of the
+	// value last uploaded to each. Copies of a ShaderProgram share the same GL program, so
+	// they share this too.
+	struct UniformTable;
+	// A load begun by startLoad() that finishLoad() has yet to check.
+	struct PendingLoad;
+
 	uint32_t m_programId;
+	std::shared_ptr<UniformTable> m_uniforms;
+	std::shared_ptr<PendingLoad> m_pending;
+	bool m_instanced;
+
+	void introspectUniforms();
+	template <typename T, typename Upload>
+	void set(UniformHandle handle, const T& value, Upload upload);
 
 public:
 	ShaderProgram();
-	void load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath);
+	/**
+	 * @brief Compiles and links a program from two shader files, or loads the binary the driver
+	 * produced for the same sources last time from the shader cache.
+	 * @param defines names to #define at the top of both shaders, right after their #version
+	 * line, to build a variant of them; e.g. INSTANCED.
+	 */
+	void load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+		const std::vector<std::string>& defines = {});
+
+	/**
+	 * @brief Starts loading a program as load() does, without waiting for the driver to compile
+	 * it. Drivers with GL_KHR_parallel_shader_compile compile programs started together at the
+	 * same time; start them all before finishing any. Copies made before finishLoad() have no
+	 * uniforms.
+	 */
+	void startLoad(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+		const std::vector<std::string>& defines = {});
+	/**
+	 * @brief Waits for the load begun by startLoad(), throwing if the shaders failed to compile
+	 * or link, and caches the program's binary if it was compiled.
+	 */
+	void finishLoad();
 
 	void activate();
 
-	void setUniform(const std::string& uniformName, bool value);
-	void setUniform(const std::string& uniformName, int32_t value);
-	void setUniform(const std::string& uniformName, float value);
-	void setUniform(const std::string& uniformName, const glm::vec2& value);
-	void setUniform(const std::string& uniformName, const glm::vec3& value);
-	void setUniform(const std::string& uniformName, const glm::vec4& value);
-	void setUniform(const std::string& uniformName, const glm::mat2& value);
-	void setUniform(const std::string& uniformName, const glm::mat3& value);
-	void setUniform(const std::string& uniformName, const glm::mat4& value);
-};
\ No newline at end of file
+	/**
+	 * @brief The OpenGL name of the program. Copies of a ShaderProgram share the same program.
+	 */
+	uint32_t getProgramId() const;
+
+	/**
+	 * @brief Whether the program reads its model matrix from the per-instance instanceModel
+	 * attribute rather than the model uniform, so it must be drawn instanced.
+	 */
+	bool isInstanced() const;
+
+	/**
+	 * @brief Looks up an active uniform. Array uniforms can be looked up as "name" or
+	 * "name[0]" for their first element, and as "name[i]" for the others.
+	 */
+	UniformHandle uniformHandle(UniformName uniformName) const;
+
+	// Uniform values are set on the active program, which must be this one. A value equal to
+	// the one last set is not sent to OpenGL again.
+	void setUniform(UniformHandle uniform, bool value);
+	void setUniform(UniformHandle uniform, int32_t value);
+	void setUniform(UniformHandle uniform, float value);
+	void setUniform(UniformHandle uniform, const glm::vec2& value);
+	void setUniform(UniformHandle uniform, const glm::vec3& value);
+	void setUniform(UniformHandle uniform, const glm::vec4& value);
+	void setUniform(UniformHandle uniform, const glm::mat2& value);
+	void setUniform(UniformHandle uniform, const glm::mat3& value);
+	void setUniform(UniformHandle uniform, const glm::mat4& value);
+
+	void setUniform(UniformName uniformName, bool value);
+	void setUniform(UniformName uniformName, int32_t value);
+	void setUniform(UniformName uniformName, float value);
+	void setUniform(UniformName uniformName, const glm::vec2& value);
+	void setUniform(UniformName uniformName, const glm::vec3& value);
+	void setUniform(UniformName uniformName, const glm::vec4& value);
+	void setUniform(UniformName uniformName, const glm::mat2& value);
+	void setUniform(UniformName uniformName, const glm::mat3& value);
+	void setUniform(UniformName uniformName, const glm::mat4& value);
+
+	/**
+	 * @brief The uniform calls made since the last reset, across every program.
+	 */
+	static UniformCallStats uniformCallStats();
+	static void resetUniformCallStats();
+};
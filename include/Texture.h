@@ -2,7 +2,12 @@
 #include <glad/glad.h>
 #include <string>
 #include <filesystem>
+#include <memory>
 #include "StbImage.h"
+#include "CompressedTexture.h"
+#include "GLHandle.h"
+#include "GLState.h"
+#include "GpuMemory.h"
 
 /**
  * @brief Represents a texture that has been loaded into VRAM, and is expected to be bound
@@ -13,14 +18,26 @@ struct Texture {
 	uint32_t textureId;
 	// The name of the sampler2D uniform in the fragment shader that this texture will bind to.
 	std::string samplerName;
+	// The texture's size in VRAM, including its mipmaps; 0 if the texture isn't owned by a Texture.
+	size_t byteSize = 0;
+	// Deletes the texture once the last Texture referring to it is gone. Empty for textures owned
+	// elsewhere, like the render targets of a framebuffer.
+	std::shared_ptr<const GLTexture> owner;
+
+	/**
+	 * @brief Creates a texture object, to be shared by the Textures that refer to it.
+	 */
+	static std::shared_ptr<const GLTexture> createOwner() {
+		return std::make_shared<const GLTexture>(GLTexture::create());
+	}
 
 	/**
 	 * @brief Loads an SFML Image into VRAM and returns a Texture object identifying it.
 	 */
 	static Texture loadImage(const StbImage& texture, const std::string& samplerName) {
-		uint32_t texId;
-		glGenTextures(1, &texId);
-		glBindTexture(GL_TEXTURE_2D, texId);
+		auto owner = createOwner();
+		auto texId = owner->get();
+		GLState::bindTexture(texId);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -28,8 +45,33 @@ struct Texture {
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture.getWidth(), texture.getHeight(), 0, GL_RGBA,
 			GL_UNSIGNED_BYTE, texture.getData());
 		glGenerateMipmap(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		GLState::bindTexture(0);
+
+		// A full mipmap chain adds a third to the size of the base level.
+		size_t baseBytes = static_cast<size_t>(texture.getWidth()) * texture.getHeight() * 4;
+		GpuMemory::shared().track(GpuObject::Texture, texId, GpuCategory::Textures, baseBytes * 4 / 3, "Texture");
+		return Texture{ texId, samplerName, baseBytes * 4 / 3, std::move(owner) };
+	}
 
-		return Texture{ texId, samplerName };
+	/**
+	 * @brief Loads a block-compressed texture and all its mip levels into VRAM.
+	 */
+	static Texture loadCompressed(const CompressedTexture& texture, const std::string& samplerName) {
+		auto owner = createOwner();
+		auto texId = owner->get();
+		GLState::bindTexture(texId);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levelCount() - 1));
+		for (size_t i = 0; i < texture.levelCount(); i++) {
+			auto& level = texture.level(i);
+			glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), texture.glInternalFormat(), level.width,
+				level.height, 0, static_cast<GLsizei>(level.size), texture.levelData(i));
+		}
+		GLState::bindTexture(0);
+		GpuMemory::shared().track(GpuObject::Texture, texId, GpuCategory::Textures, texture.gpuBytes(), "Texture");
+		return Texture{ texId, samplerName, texture.gpuBytes(), std::move(owner) };
 	}
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include "CompressedTexture.h"
+#include "StbImage.h"
+#include "Texture.h"
+#include "TextureStreamer.h"
+
+/**
+ * @brief The version of the texture encoder. Bump this whenever its output changes, so stale
+ * cooked textures are re-encoded.
+ */
+const uint32_t TEXTURE_COOKER_VERSION = 2;
+
+/**
+ * @brief Picks the block format for an image: BC5 for normal and distortion maps, BC3 if any
+ * texel is translucent, and BC1 otherwise.
+ */
+BlockFormat chooseBlockFormat(const StbImage& image, const std::string& samplerName);
+
+/**
+ * @brief Builds a full mip chain for an image used through the given sampler and block-compresses
+ * every level, spreading the work across all hardware threads. Returns the result as a KTX2
+ * container.
+ */
+std::vector<uint8_t> cookTexture(const StbImage& image, const std::string& samplerName, BlockFormat format,
+	uint64_t sourceHash);
+
+/**
+ * @brief The path of the cooked texture for an image file used through the given sampler.
+ */
+std::filesystem::path textureCachePath(const std::string& sourcePath, const std::string& samplerName);
+
+/**
+ * @brief An image that is ready to upload: either cooked to a compressed texture, or decoded
+ * to RGBA8 pixels when compression is off.
+ */
+struct PreparedImage {
+	StbImage pixels;
+	CompressedTexture compressed;
+	// Whether the compressed texture came from the texture cache rather than being cooked now.
+	bool cacheHit = false;
+};
+
+/**
+ * @brief Does the CPU work of loading an image file. With compression on, the cooked texture
+ * is read from the cache, or cooked and cached if the image changed since it was last cooked.
+ * Makes no OpenGL calls, so it may run on any thread.
+ */
+PreparedImage prepareImage(const std::string& path, const std::string& samplerName, bool compress);
+
+/**
+ * @brief Uploads a prepared image, or hands it to a streamer to upload over the next frames.
+ */
+Texture uploadImage(PreparedImage&& image, const std::string& samplerName, TextureStreamer* streamer = nullptr);
@@ -0,0 +1,89 @@
+#pragma once
+#include <glad/glad.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CompressedTexture.h"
+#include "StbImage.h"
+#include "Texture.h"
+
+/**
+ * @brief Uploads textures to VRAM a few rows at a time, spread across frames, instead of
+ * stalling the render loop on one large glTexImage2D.
+ *
+ * A streamed texture gets its immutable storage immediately and samples as a 1x1 placeholder
+ * color until every row of its base level has been uploaded; its mipmaps are then generated
+ * and the full texture becomes visible. Pixels are staged through a ring of pixel buffer
+ * objects that is persistently mapped when the driver supports it (GL 4.4), split into one
+ * slot per frame in flight, each guarded by a fence.
+ *
+ * Compressed textures already carry their mip chain, so they stream from the smallest level up:
+ * the smallest level is uploaded immediately as the placeholder, and each larger level becomes
+ * visible as soon as all its block rows have arrived.
+ */
+class TextureStreamer {
+private:
+	struct PendingUpload {
+		uint32_t textureId;
+		// Keeps the texture alive until its upload is done, even if nothing draws with it anymore.
+		std::shared_ptr<const GLTexture> owner;
+		// Exactly one of these holds the texture's data.
+		StbImage image;
+		CompressedTexture compressed;
+		// The mip level being uploaded, and the number of its rows (of texels, or of blocks for a
+		// compressed texture) uploaded so far.
+		int level;
+		int rowsUploaded;
+	};
+
+	static const uint32_t FRAMES_IN_FLIGHT = 3;
+
+	GLBuffer m_pbo;
+	uint8_t* m_persistentMapping;
+	size_t m_slotBytes;
+	size_t m_budgetBytes;
+	uint32_t m_frame;
+	GLsync m_fences[FRAMES_IN_FLIGHT];
+	std::deque<PendingUpload> m_pending;
+
+	size_t m_bytesStreamed;
+	size_t m_texturesCompleted;
+
+	void finish(uint32_t textureId);
+	void finishLevel(uint32_t textureId, int level);
+
+public:
+	/**
+	 * @brief Creates the staging ring.
+	 * @param budgetBytes the most pixel data uploaded per frame.
+	 */
+	explicit TextureStreamer(size_t budgetBytes = 2 * 1024 * 1024);
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	/**
+	 * @brief Creates a texture for an image and queues its pixels for upload. The returned
+	 * texture can be bound immediately; it shows a placeholder until it is resident.
+	 */
+	Texture enqueue(StbImage&& image, const std::string& samplerName);
+	/**
+	 * @brief Creates a compressed texture and queues its levels for upload, largest last.
+	 */
+	Texture enqueue(CompressedTexture&& texture, const std::string& samplerName);
+
+	/**
+	 * @brief Uploads up to the per-frame budget of queued pixels. Call once per frame.
+	 */
+	void update();
+
+	/**
+	 * @brief Whether every queued texture is resident.
+	 */
+	bool idle() const;
+	size_t pendingCount() const;
+	size_t bytesStreamed() const;
+	size_t texturesCompleted() const;
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A fixed set of worker threads that run submitted tasks in FIFO order.
+ * Tasks must not touch OpenGL; only the thread that owns the context may do that.
+ */
+class ThreadPool {
+private:
+	std::vector<std::thread> m_workers;
+	std::deque<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stopping;
+
+	void workerLoop();
+
+public:
+	/**
+	 * @brief Starts the given number of workers; by default, one per hardware thread.
+	 */
+	explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+	/**
+	 * @brief Finishes every queued task, then joins the workers.
+	 */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t size() const;
+
+	/**
+	 * @brief Whether the calling thread is a worker of any ThreadPool. Work done inside a task
+	 * should run serially on it rather than start threads of its own.
+	 */
+	static bool isWorkerThread();
+
+	/**
+	 * @brief Queues a task, returning a future for its result. Exceptions thrown by the task
+	 * are rethrown from the future's get().
+	 */
+	template <typename F>
+	auto submit(F&& task) -> std::future<std::invoke_result_t<F>> {
+		using Result = std::invoke_result_t<F>;
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		auto future = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.emplace_back([packaged]() { (*packaged)(); });
+		}
+		m_wake.notify_one();
+		return future;
+	}
+};
@@ -0,0 +1,144 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+class WorkStealingPool;
+
+/**
+ * @brief The transforms of a scene graph, kept as parallel arrays, one per component, rather
+ * than in the nodes of a tree. The arrays are ordered so that every node comes after its
+ * parent, so all world matrices are brought up to date in one forward sweep that reads the
+ * parent's result from earlier in the same array. Once sorted they are also grouped by depth,
+ * so that the nodes of each level can be updated in parallel. Nodes are named by ids that stay
+ * valid as the arrays are re-sorted; Object3D is a handle to one.
+ *
+ * Changing a node's transform only flags it dirty. update() rebuilds the local matrix of each
+ * dirty node and the world matrix of each node whose local matrix or ancestors changed, and
+ * returns at once when nothing did. Different nodes' transforms may be changed from different
+ * threads at once; nothing else may run alongside any other call.
+ */
+class TransformHierarchy {
+public:
+	using NodeId = uint32_t;
+	static constexpr NodeId NO_NODE = UINT32_MAX;
+
+private:
+	// Indexed by position in the sorted order.
+	std::vector<glm::vec3> m_positions;
+	std::vector<glm::vec3> m_orientations;
+	std::vector<glm::vec3> m_scales;
+	std::vector<glm::vec3> m_centers;
+	std::vector<glm::mat4> m_baseTransforms;
+	std::vector<glm::mat4> m_localMatrices;
+	std::vector<glm::mat4> m_worldMatrices;
+	std::vector<glm::mat3> m_normalMatrices;
+	// The index of each node's parent, or NO_NODE for a root. Always less than the node's own
+	// index once sorted.
+	std::vector<uint32_t> m_parents;
+	std::vector<uint8_t> m_localDirty;
+	// Set during a sweep for each node whose world matrix was recomputed.
+	std::vector<uint8_t> m_changed;
+	// The update in which each node's world matrix last changed.
+	std::vector<uint32_t> m_worldVersions;
+	// The id of the node at each index, or NO_NODE for a released node awaiting compaction.
+	std::vector<NodeId> m_ids;
+
+	// The index of each id, or NO_NODE for ids that are free.
+	std::vector<uint32_t> m_indices;
+	std::vector<NodeId> m_freeIds;
+	// Where each level of the sorted arrays starts, then where the last ends.
+	std::vector<uint32_t> m_levelStarts;
+	size_t m_released;
+	uint32_t m_updateCount;
+	// Whether every node comes after its parent, and whether the levels are still laid out as
+	// m_levelStarts says.
+	bool m_sorted;
+	bool m_levelsValid;
+	std::atomic<bool> m_dirty;
+
+	uint32_t index(NodeId node) const;
+	void markDirty(uint32_t index);
+	void sort();
+	void sweep(size_t begin, size_t end);
+
+public:
+	TransformHierarchy();
+	TransformHierarchy(const TransformHierarchy&) = delete;
+	TransformHierarchy& operator=(const TransformHierarchy&) = delete;
+
+	/**
+	 * @brief The hierarchy Object3Ds are created in unless they are given another.
+	 */
+	static TransformHierarchy& shared();
+
+	/**
+	 * @brief Builds a local->parent matrix: scale and rotate around the center, then translate,
+	 * applied after the base transform.
+	 */
+	static glm::mat4 localMatrix(const glm::vec3& position, const glm::vec3& orientation, const glm::vec3& scale,
+		const glm::vec3& center, const glm::mat4& baseTransform);
+	/**
+	 * @brief The matrix that transforms normals by a model matrix: the inverse transpose of its
+	 * upper 3x3, or just a rescaled copy of it when the model matrix scales uniformly.
+	 */
+	static glm::mat3 normalMatrix(const glm::mat4& model);
+
+	/**
+	 * @brief Adds a root node with the identity transform after the given base transform.
+	 */
+	NodeId create(const glm::mat4& baseTransform = glm::mat4(1));
+	/**
+	 * @brief Adds a root node with the same local transform as another node.
+	 */
+	NodeId clone(NodeId source);
+	/**
+	 * @brief Removes a node. Its children, if any are left, become roots.
+	 */
+	void release(NodeId node);
+	/**
+	 * @brief Moves a node under a new parent, or makes it a root given NO_NODE. The hierarchy
+	 * must not form a cycle.
+	 */
+	void setParent(NodeId node, NodeId parent);
+	NodeId getParent(NodeId node) const;
+
+	const glm::vec3& getPosition(NodeId node) const;
+	const glm::vec3& getOrientation(NodeId node) const;
+	const glm::vec3& getScale(NodeId node) const;
+	const glm::vec3& getCenter(NodeId node) const;
+	void setPosition(NodeId node, const glm::vec3& position);
+	void setOrientation(NodeId node, const glm::vec3& orientation);
+	void setScale(NodeId node, const glm::vec3& scale);
+	void setCenter(NodeId node, const glm::vec3& center);
+
+	/**
+	 * @brief Re-sorts the arrays if nodes were re-parented ahead of their parents or released,
+	 * then recomputes the local and world matrices that are out of date.
+	 */
+	void update();
+	/**
+	 * @brief Updates the matrices as update() does, one level of the hierarchy at a time, each
+	 * level split across a pool's threads. Re-sorts the arrays if nodes were added or moved
+	 * since the levels were laid out.
+	 */
+	void update(WorkStealingPool& pool);
+
+	/**
+	 * @brief The node's local->world matrix, and the matrix that transforms its normals, as of
+	 * the last update.
+	 */
+	const glm::mat4& getWorldMatrix(NodeId node) const;
+	const glm::mat3& getNormalMatrix(NodeId node) const;
+	/**
+	 * @brief Changes whenever an update changes the node's world matrix, so that anything
+	 * derived from it can tell when it must be recomputed.
+	 */
+	uint32_t getWorldVersion(NodeId node) const;
+
+	/**
+	 * @brief The number of nodes.
+	 */
+	size_t size() const;
+};
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <glm/glm.hpp>
+#include "GLHandle.h"
+
+/**
+ * @brief The binding points of the uniform blocks shared by the shaders. ShaderProgram binds
+ * each block it finds by name to its point when the program is linked.
+ */
+const uint32_t FRAME_UNIFORMS_BINDING = 0;
+const uint32_t LIGHTING_UNIFORMS_BINDING = 1;
+
+/**
+ * @brief The binding point for a uniform block name, or -1 if it isn't one of the shared blocks.
+ */
+int32_t uniformBlockBinding(std::string_view blockName);
+
+/**
+ * @brief The FrameUniforms block: everything that changes between render passes. Laid out by
+ * std140 rules; must match the block declared in the shaders.
+ */
+struct FrameUniforms {
+	glm::mat4 view;
+	glm::mat4 projection;
+	// The camera position, in world space.
+	glm::vec3 viewPos;
+	float padding0 = 0;
+	// Geometry on the negative side of this plane is clipped, when GL_CLIP_DISTANCE0 is enabled.
+	glm::vec4 plane;
+
+	FrameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos, const glm::vec4& plane)
+		: view(view), projection(projection), viewPos(viewPos), plane(plane) {}
+};
+static_assert(offsetof(FrameUniforms, viewPos) == 128 && offsetof(FrameUniforms, plane) == 144
+	&& sizeof(FrameUniforms) == 160, "FrameUniforms must follow std140 layout");
+
+/**
+ * @brief The Light struct of the lighting shaders, in std140 layout.
+ */
+struct PointLightUniforms {
+	glm::vec3 position;
+	float padding0 = 0;
+	glm::vec3 ambient;
+	float padding1 = 0;
+	glm::vec3 diffuse;
+	float padding2 = 0;
+	glm::vec3 specular;
+	float constant;
+	float linear;
+	float quadratic;
+	float padding3[2] = { 0, 0 };
+};
+static_assert(offsetof(PointLightUniforms, constant) == 60 && sizeof(PointLightUniforms) == 80,
+	"PointLightUniforms must follow std140 layout");
+
+/**
+ * @brief The LightingUniforms block: the scene's lights. Laid out by std140 rules; must match
+ * the block declared in the shaders.
+ */
+struct LightingUniforms {
+	glm::vec3 ambientColor;
+	float padding0 = 0;
+	// The direction the directional light shines in.
+	glm::vec3 directionalLight;
+	float padding1 = 0;
+	glm::vec3 directionalColor;
+	float padding2 = 0;
+	PointLightUniforms light;
+};
+static_assert(offsetof(LightingUniforms, light) == 48 && sizeof(LightingUniforms) == 128,
+	"LightingUniforms must follow std140 layout");
+
+/**
+ * @brief A uniform buffer holding one or more copies of a uniform block, each in its own slot
+ * at the alignment the GL requires. Writing each render pass's values to a different slot
+ * keeps later passes from overwriting data an earlier pass may still be drawing with.
+ */
+class UniformBuffer {
+private:
+	GLBuffer m_buffer;
+	uint32_t m_binding;
+	size_t m_blockSize;
+	size_t m_stride;
+	size_t m_slotCount;
+
+	void updateBytes(size_t slot, const void* data, size_t size);
+
+public:
+	/**
+	 * @brief Creates the buffer. Must run on the thread that owns the OpenGL context.
+	 * @param binding the uniform block binding point the slots are bound to.
+	 */
+	UniformBuffer(uint32_t binding, size_t blockSize, size_t slotCount = 1);
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	/**
+	 * @brief Replaces the contents of a slot with a block of the size the buffer was created for.
+	 */
+	template <typename T>
+	void update(size_t slot, const T& block) {
+		static_assert(std::is_trivially_copyable_v<T>, "uniform blocks are copied bytewise");
+		updateBytes(slot, &block, sizeof(T));
+	}
+
+	/**
+	 * @brief Binds a slot to the buffer's binding point, so every program's block reads from it.
+	 */
+	void bind(size_t slot) const;
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Mesh3D.h"
+
+/**
+ * @brief The largest error packing introduced into any vertex of a mesh.
+ */
+struct PackingError {
+	// Distance along any axis, in model units.
+	float position;
+	// Change in any normal component.
+	float normal;
+	// Change in either texture coordinate.
+	float texCoord;
+};
+
+/**
+ * @brief The most error a mesh may pick up by being packed; meshes that would exceed it keep
+ * full float vertices.
+ */
+struct PackingTolerance {
+	// Relative to the diagonal of the mesh's bounding box.
+	float position = 1.0f / 10000;
+	float normal = 1.0f / 256;
+	// A quarter texel of a 1024x1024 texture.
+	float texCoord = 1.0f / 4096;
+};
+
+/**
+ * @brief Converts a float to the nearest IEEE half float.
+ */
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t half);
+
+/**
+ * @brief The quantization that spreads 16-bit positions across the bounds of a set of vertices.
+ */
+VertexQuantization quantizationFor(const std::vector<Vertex3D>& vertices);
+
+PackedVertex3D packVertex(const Vertex3D& vertex, const VertexQuantization& quantization);
+/**
+ * @brief Decodes a packed vertex the same way the vertex shader does.
+ */
+Vertex3D unpackVertex(const PackedVertex3D& vertex, const VertexQuantization& quantization);
+
+/**
+ * @brief Packs a mesh's vertices and measures the error that introduces.
+ * @return whether the error is within the tolerance. If not, packed is left empty.
+ */
+bool packVertices(const std::vector<Vertex3D>& vertices, const PackingTolerance& tolerance,
+	std::vector<PackedVertex3D>& packed, VertexQuantization& quantization, PackingError& error);
@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Worker threads for splitting one job, like a frame's animation or transform update,
+ * across cores. Unlike ThreadPool, which runs independent tasks in order, a job here is a
+ * range of items whose pieces are balanced by work stealing: each thread splits the range it
+ * takes in halves, keeping the halves in its own queue and working on the newest, while idle
+ * threads steal the oldest, largest pieces from the others. The thread that starts a job works
+ * on it too, and waits for it to finish.
+ * Jobs must not touch OpenGL; only the thread that owns the context may do that.
+ */
+class WorkStealingPool {
+private:
+	struct Job {
+		const std::function<void(size_t, size_t)>* body;
+		size_t grain;
+		// Items not yet processed; the job is done at zero.
+		std::atomic<size_t> remaining;
+		std::mutex errorMutex;
+		std::exception_ptr error;
+	};
+	// A piece of a job's range of items.
+	struct Task {
+		Job* job;
+		size_t begin;
+		size_t end;
+	};
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::thread> m_workers;
+	// One queue per worker, and a last one for threads outside the pool.
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	// Tasks in all queues, so that idle workers know whether to look for any.
+	std::atomic<size_t> m_queued;
+	std::atomic<size_t> m_sleeping;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	bool m_stopping;
+
+	size_t queueIndex() const;
+	void push(size_t queue, const Task& task);
+	bool pop(size_t queue, Task& task);
+	bool steal(size_t queue, Task& task);
+	void run(size_t queue, Task task);
+	void workerLoop(size_t index);
+
+public:
+	/**
+	 * @brief Starts the given number of workers; by default, enough that with the thread that
+	 * starts a job there is one per hardware thread. With none, jobs run on the calling thread.
+	 */
+	explicit WorkStealingPool(size_t threadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1);
+	/**
+	 * @brief Joins the workers. No job may be running.
+	 */
+	~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	/**
+	 * @brief The number of threads that work on a job: the workers and the one that starts it.
+	 */
+	size_t size() const;
+
+	/**
+	 * @brief Calls body(begin, end) over disjoint ranges covering [0, count), on any of the
+	 * threads, and returns once every call has. Ranges are split no smaller than grain items.
+	 * May be called from within a job. If calls throw, the first exception is rethrown here
+	 * after the rest of the job has run.
+	 */
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+};
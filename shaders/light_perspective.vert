@@ -5,26 +5,53 @@ layout (location=0) in vec3 vPosition;
 layout (location=1) in vec3 vNormal;
 layout (location=2) in vec2 vTexCoord;
 
-uniform mat4 projection;
-uniform mat4 view;
+// Per-pass values, shared by every program. Must match FrameUniforms in UniformBuffer.h.
+layout (std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    vec4 plane;
+};
+
+#ifdef INSTANCED
+// Each instance's model matrix, from the render queue's instance buffer. Takes locations 3-6.
+layout (location=3) in mat4 instanceModel;
+// Decodes quantized positions of packed meshes; the identity for unpacked ones. Per instance,
+// since one multi-draw can draw many meshes.
+layout (location=7) in vec3 instancePositionScale;
+layout (location=8) in vec3 instancePositionOffset;
+// Each instance's normal matrix. Takes locations 9-11.
+layout (location=9) in mat3 instanceNormalMatrix;
+#else
 uniform mat4 model;
-uniform vec4 plane;
+// The inverse transpose of the model matrix, computed once per object on the CPU.
+uniform mat3 normalMatrix;
+// Decodes quantized positions of packed meshes; the identity for unpacked ones.
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+#endif
 
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragWorldPos;
 
 void main() {
+#ifdef INSTANCED
+    mat4 model = instanceModel;
+    vec3 positionScale = instancePositionScale;
+    vec3 positionOffset = instancePositionOffset;
+    mat3 normalMatrix = instanceNormalMatrix;
+#endif
+    vec3 position = vPosition * positionScale + positionOffset;
     // Transform the vertex position from local space to clip space.
-    gl_Position = projection * view * model * vec4(vPosition, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
     // Pass along the vertex texture coordinate.
     TexCoord = vTexCoord;
     // Transform the vertex normal from local space to world space, using the Normal matrix.
-    mat4 normalMatrix = transpose(inverse(model));
-    Normal = mat3(normalMatrix) * vNormal;
+    Normal = normalMatrix * vNormal;
     
     // TODO: transform the vertex position into world space, and assign it to FragWorldPos.
-    FragWorldPos = vec3(model * vec4(vPosition, 1.0));
+    FragWorldPos = vec3(model * vec4(position, 1.0));
 
-    gl_ClipDistance[0] = dot(model * vec4(vPosition, 1.0), plane);
+    gl_ClipDistance[0] = dot(model * vec4(position, 1.0), plane);
 }
\ No newline at end of file
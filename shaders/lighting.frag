@@ -16,13 +16,6 @@ uniform sampler2D baseTexture;
 // Material parameters for the whole mesh: k_a, k_d, k_s, shininess.
 uniform vec4 material;
 
-// Ambient light color.
-uniform vec3 ambientColor;
-
-// Direction and color of a single directional light.
-uniform vec3 directionalLight; // this is the "I" vector, not the "L" vector.
-uniform vec3 directionalColor;
-
 // Point light
 struct Light {
     vec3 position;
@@ -36,10 +29,23 @@ struct Light {
     float quadratic;
 };
 
-uniform Light light;
+// The scene's lights, shared by every program. Must match LightingUniforms in UniformBuffer.h.
+layout (std140) uniform LightingUniforms {
+    // Ambient light color.
+    vec3 ambientColor;
+    // Direction and color of a single directional light.
+    vec3 directionalLight; // this is the "I" vector, not the "L" vector.
+    vec3 directionalColor;
+    Light light;
+};
 
-// Location of the camera.
-uniform vec3 viewPos;
+// Per-pass values, shared by every program. Must match FrameUniforms in UniformBuffer.h.
+layout (std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    vec4 plane;
+};
 
 
 void main() {
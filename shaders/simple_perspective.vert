@@ -4,8 +4,12 @@ layout (location=0) in vec3 vPosition;
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
+// Decodes quantized positions of packed meshes; the identity for unpacked ones.
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 
 void main() {
+    vec3 position = vPosition * positionScale + positionOffset;
     // Project the position to clip space.
-    gl_Position = projection * view * model * vec4(vPosition, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
\ No newline at end of file
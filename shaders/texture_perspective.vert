@@ -7,16 +7,21 @@ layout (location=2) in vec2 vTexCoord;
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
+// The inverse transpose of the model matrix, computed once per object on the CPU.
+uniform mat3 normalMatrix;
+// Decodes quantized positions of packed meshes; the identity for unpacked ones.
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 
 out vec2 TexCoord;
 out vec3 Normal;
 
 void main() {
+    vec3 position = vPosition * positionScale + positionOffset;
     // Transform the position to clip space.
-    gl_Position = projection * view * model * vec4(vPosition, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
     // Pass along the vertex texture coordinate.
     TexCoord = vTexCoord;
     // Transform the vertex normal from local space to world space, using the Normal matrix.
-    mat4 normalMatrix = transpose(inverse(model));
-    Normal = mat3(normalMatrix) * vNormal;
+    Normal = normalMatrix * vNormal;
 }
\ No newline at end of file
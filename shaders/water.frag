@@ -11,8 +11,30 @@ uniform sampler2D refractionTexture;
 uniform sampler2D dudvMap;
 uniform sampler2D normalMap;
 
+// Point light
+struct Light {
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// The scene's lights, shared by every program. Must match LightingUniforms in UniformBuffer.h.
+layout (std140) uniform LightingUniforms {
+    // Ambient light color.
+    vec3 ambientColor;
+    // Direction and color of a single directional light.
+    vec3 directionalLight; // this is the "I" vector, not the "L" vector.
+    vec3 directionalColor;
+    Light light;
+};
+
 uniform float moveFactor;
-uniform vec3 lightColor;
 
 const float waveStrength = 0.04;
 const float shineDamper = 20.0;
@@ -46,14 +68,17 @@ void main() {
     float refractiveFactor = dot(viewVector, vec3(0.0, 1.0, 0.0));
     refractiveFactor = pow(refractiveFactor, 0.7);
 
-    vec4 normalMapColor = texture(normalMap, distortedTexCoords);
-    vec3 normal = vec3(normalMapColor.r * 2.0 - 1.0, normalMapColor.b, normalMapColor.g * 2.0 - 1.0);
+    // Only the red and green channels are stored (compressed normal maps have no blue), so rebuild
+    // the blue one from them.
+    vec2 normalXY = texture(normalMap, distortedTexCoords).rg * 2.0 - 1.0;
+    float normalZ = sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)) * 0.5 + 0.5;
+    vec3 normal = vec3(normalXY.x, normalZ, normalXY.y);
     normal = normalize(normal);
 
     vec3 reflectedLight = reflect(normalize(fromLightVector), normal);
     float specular = max(dot(reflectedLight, viewVector), 0.0);
     specular = pow(specular, shineDamper);
-    vec3 specularHighlights = lightColor * specular * reflectivity;
+    vec3 specularHighlights = light.specular * specular * reflectivity;
 
     FragColor = mix(reflectColor, refractionColor, refractiveFactor);
     FragColor = mix(FragColor, vec4(0.0, 0.3, 0.5, 1.0), 0.3) + vec4(specularHighlights, 0.0);
@@ -4,12 +4,50 @@ layout (location=0) in vec3 vPosition;
 layout (location=1) in vec3 vNormal;
 layout (location=2) in vec2 vTexCoord;
 
-uniform mat4 projection;
-uniform mat4 view;
+// Per-pass values, shared by every program. Must match FrameUniforms in UniformBuffer.h.
+layout (std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    vec4 plane;
+};
+
+// Point light
+struct Light {
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// The scene's lights, shared by every program. Must match LightingUniforms in UniformBuffer.h.
+layout (std140) uniform LightingUniforms {
+    // Ambient light color.
+    vec3 ambientColor;
+    // Direction and color of a single directional light.
+    vec3 directionalLight; // this is the "I" vector, not the "L" vector.
+    vec3 directionalColor;
+    Light light;
+};
+
+#ifdef INSTANCED
+// Each instance's model matrix, from the render queue's instance buffer. Takes locations 3-6.
+layout (location=3) in mat4 instanceModel;
+// Decodes quantized positions of packed meshes; the identity for unpacked ones. Per instance,
+// since one multi-draw can draw many meshes.
+layout (location=7) in vec3 instancePositionScale;
+layout (location=8) in vec3 instancePositionOffset;
+#else
 uniform mat4 model;
-uniform vec4 plane;
-uniform vec3 viewPos;
-uniform vec3 lightPos;
+// Decodes quantized positions of packed meshes; the identity for unpacked ones.
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+#endif
 
 out vec2 TexCoord;
 out vec4 ClipSpace;
@@ -19,8 +57,14 @@ out vec3 fromLightVector;
 const float tiling = 4.0;
 
 void main() {
+#ifdef INSTANCED
+    mat4 model = instanceModel;
+    vec3 positionScale = instancePositionScale;
+    vec3 positionOffset = instancePositionOffset;
+#endif
+    vec3 position = vPosition * positionScale + positionOffset;
     // Transform the vertex position from local space to clip space.
-    vec4 worldPos = model * vec4(vPosition, 1.0);
+    vec4 worldPos = model * vec4(position, 1.0);
     gl_Position = projection * view * worldPos;
     ClipSpace = gl_Position;
 
@@ -29,7 +73,7 @@ void main() {
 
     toCameraVector = viewPos - worldPos.xyz;
 
-    fromLightVector = worldPos.xyz - lightPos;
+    fromLightVector = worldPos.xyz - light.position;
 
-    gl_ClipDistance[0] = dot(model * vec4(vPosition, 1.0), plane);
+    gl_ClipDistance[0] = dot(model * vec4(position, 1.0), plane);
 }
\ No newline at end of file
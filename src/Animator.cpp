@@ -42,3 +42,9 @@ void Animator::start() {
 	m_currentTime = 0;
 	nextAnimation();
 }
+
+void Animator::collectTargets(std::vector<Object3D*>& targets) const {
+	for (auto& animation : m_animations) {
+		targets.push_back(&animation->object());
+	}
+}
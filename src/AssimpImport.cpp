@@ -1,17 +1,58 @@
 #include "AssimpImport.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjImport.h"
+#include "VertexPacking.h"
 #include <iostream>
+#include <sstream>
+#include <chrono>
 #include <assimp/Importer.hpp>
+#include <assimp/DefaultIOSystem.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <filesystem>
 #include <unordered_map>
+#include <cstring>
+#include <optional>
+#include <atomic>
+#include <cctype>
+#include <algorithm>
 
 const size_t FLOATS_PER_VERTEX = 3;
 const size_t VERTICES_PER_FACE = 3;
 
-std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName, const std::filesystem::path& modelPath,
-	std::unordered_map<std::filesystem::path, Texture>& loadedTextures) {
-	std::vector<Texture> textures;
+namespace {
+	std::atomic<bool> objImportEnabled = true;
+	std::atomic<size_t> objImportThreads = 1;
+
+	/**
+	 * @brief Opens files as Assimp otherwise would, recording the path of every file other than
+	 * the model itself that the importer tries to open, such as material libraries and buffers.
+	 */
+	class RecordingIOSystem : public Assimp::DefaultIOSystem {
+	private:
+		std::string m_modelPath;
+		std::vector<std::string>& m_opened;
+
+	public:
+		RecordingIOSystem(const std::string& modelPath, std::vector<std::string>& opened)
+			: m_modelPath(modelPath), m_opened(opened) {
+		}
+
+		Assimp::IOStream* Open(const char* file, const char* mode) override {
+			// Files that fail to open are recorded too, since creating them changes the import.
+			if (!ComparePaths(file, m_modelPath.c_str())
+				&& std::find(m_opened.begin(), m_opened.end(), file) == m_opened.end()) {
+				m_opened.push_back(file);
+			}
+			return DefaultIOSystem::Open(file, mode);
+		}
+	};
+}
+
+std::vector<TextureBinding> loadMaterialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName, const std::filesystem::path& modelPath,
+	std::unordered_map<std::filesystem::path, uint32_t>& loadedTextures, ModelData& model) {
+	std::vector<TextureBinding> textures;
 	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString name;
@@ -22,33 +63,34 @@ std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, c
 
 		auto existing = loadedTextures.find(texPath);
 		if (existing != loadedTextures.end()) {
-			textures.push_back(existing->second);
+			textures.push_back({ existing->second, typeName });
 		}
 		else {
-			StbImage image;
-			image.loadFromFile(texPath.string());
-			Texture tex = Texture::loadImage(image, typeName);
-			textures.push_back(tex);
-			loadedTextures.insert(std::make_pair(texPath, tex));
+			auto image = static_cast<uint32_t>(model.images.size());
+			model.images.push_back(texPath.string());
+			textures.push_back({ image, typeName });
+			loadedTextures.insert(std::make_pair(texPath, image));
 		}
 	}
 	return textures;
 }
 
-Mesh3D fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesystem::path& modelPath,
-	std::unordered_map<std::filesystem::path, Texture>& loadedTextures) {
-	std::vector<Vertex3D> vertices;
+MeshData fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesystem::path& modelPath,
+	std::unordered_map<std::filesystem::path, uint32_t>& loadedTextures, ModelData& model) {
+	MeshData data;
+	std::vector<Vertex3D>& vertices = data.vertices;
+	vertices.reserve(mesh->mNumVertices);
 
-	// TODO: fill in this vertices list, by iterating over each element of 
+	// TODO: fill in this vertices list, by iterating over each element of
 	// the mVertices field of the aiMesh pointer. Each element of mVertices
 	// has x, y, and z values that you can use to construct a Vertex3D object.
-	// To find the u and v texture coordinates of a vertex, access the 
+	// To find the u and v texture coordinates of a vertex, access the
 	// x and y fields of each element of mTextureCoords.
 	// To find the normal vector of a vertex, access the x, y, and z fields
 	// of each eleemnt of mNormals.
 	for (size_t i = 0; i < mesh->mNumVertices; i++) {
 		auto& meshVertex = mesh->mVertices[i];
-		auto& texCoord = mesh->mTextureCoords[0][i];
+		auto texCoord = mesh->mTextureCoords[0] != nullptr ? mesh->mTextureCoords[0][i] : aiVector3D{ 0, 0, 0 };
 		auto& normal = mesh->mNormals[i];
 
 		// See above.
@@ -56,11 +98,12 @@ Mesh3D fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::files
                             texCoord.x, texCoord.y });
 	}
 
-	std::vector<uint32_t> faces;
+	std::vector<uint32_t>& faces = data.indices;
+	faces.reserve(mesh->mNumFaces * VERTICES_PER_FACE);
 	// TODO: fill in the faces list, by iterating over each element of
 	// the mFaces field of the aiMesh pointer. Each element of mFaces
-	// has an mIndices list, which will have three elements of its own at 
-	// [0], [1], and [2]. Each of those should be pushed individually onto 
+	// has an mIndices list, which will have three elements of its own at
+	// [0], [1], and [2]. Each of those should be pushed individually onto
 	// the faces list.
 	for (size_t i = 0; i < mesh->mNumFaces; i++) {
 		auto& meshFace = mesh->mFaces[i];
@@ -71,81 +114,265 @@ Mesh3D fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::files
 	}
 
 	// Load any base textures, specular maps, and normal maps associated with the mesh.
-	std::vector<Texture> textures = {};
+	std::vector<TextureBinding>& textures = data.textures;
 	if (mesh->mMaterialIndex >= 0)
 	{
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-		std::vector<Texture> diffuseMaps = loadMaterialTextures(material,
-			aiTextureType_DIFFUSE, "baseTexture", modelPath, loadedTextures);
+		std::vector<TextureBinding> diffuseMaps = loadMaterialTextures(material,
+			aiTextureType_DIFFUSE, "baseTexture", modelPath, loadedTextures, model);
 		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		std::vector<Texture> specularMaps = loadMaterialTextures(material,
-			aiTextureType_SPECULAR, "specMap", modelPath, loadedTextures);
+		std::vector<TextureBinding> specularMaps = loadMaterialTextures(material,
+			aiTextureType_SPECULAR, "specMap", modelPath, loadedTextures, model);
 		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-		std::vector<Texture> normalMaps = loadMaterialTextures(material,
-			aiTextureType_HEIGHT, "normalMap", modelPath, loadedTextures);
+		std::vector<TextureBinding> normalMaps = loadMaterialTextures(material,
+			aiTextureType_HEIGHT, "normalMap", modelPath, loadedTextures, model);
 		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
 		normalMaps = loadMaterialTextures(material,
-			aiTextureType_NORMALS, "normalMap", modelPath, loadedTextures);
+			aiTextureType_NORMALS, "normalMap", modelPath, loadedTextures, model);
 		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
 	}
 
-	return Mesh3D(std::move(vertices), std::move(faces), std::move(textures));
+	return data;
 }
 
+/**
+ * @brief Optimizes the triangle and vertex order of each mesh, generates its levels of detail,
+ * then switches each mesh whose vertices can be packed within the tolerance to the packed
+ * vertex format. Reports the vertex cache efficiency, levels of detail and vertex bytes of
+ * each mesh.
+ */
+void optimizeMeshes(ModelData& model, const std::string& path) {
+	PackingTolerance tolerance;
+	std::ostringstream report;
+	report.precision(3);
+	size_t packedCount = 0, floatBytes = 0, packedBytes = 0;
+	for (size_t i = 0; i < model.meshes.size(); i++) {
+		auto& mesh = model.meshes[i];
+		auto optimization = optimizeMesh(mesh.vertices, mesh.indices);
+		mesh.lods = generateLods(mesh.vertices, mesh.indices);
+		PackingError error;
+		bool packed = packVertices(mesh.vertices, tolerance, mesh.packedVertices, mesh.quantization, error);
+		floatBytes += mesh.vertices.size() * sizeof(Vertex3D);
+		packedBytes += mesh.vertices.size() * (packed ? sizeof(PackedVertex3D) : sizeof(Vertex3D));
+		packedCount += packed ? 1 : 0;
+		report << "  mesh " << i << ": " << mesh.vertices.size() << " vertices, ACMR "
+			<< optimization.before.acmr << " -> " << optimization.after.acmr << ", ATVR "
+			<< optimization.before.atvr << " -> " << optimization.after.atvr << ", LOD triangles";
+		for (auto& lod : mesh.lods) {
+			report << " " << lod.indexCount / 3;
+		}
+		report << ", " << (packed ? "packed" : "kept as floats") << " (max error: position " << error.position
+			<< ", normal " << error.normal << ", uv " << error.texCoord << ")\n";
+	}
+	// Write the report in one go, since models are imported on several threads at once.
+	std::cout << "Optimized " << model.meshes.size() << " meshes in " << path << ", packed " << packedCount
+		<< ": vertex data " << floatBytes / 1024 << " KB -> " << packedBytes / 1024 << " KB\n" + report.str() << std::flush;
+}
 
-
-Object3D assimpLoad(const std::string& path, bool flipTextureCoords) {
-	Assimp::Importer importer;
-
-	auto options = aiProcessPreset_TargetRealtime_MaxQuality;
+uint32_t assimpImportFlags(bool flipTextureCoords) {
+	uint32_t options = aiProcessPreset_TargetRealtime_MaxQuality;
 	if (flipTextureCoords) {
 		options |= aiProcess_FlipUVs;
 	}
-	const aiScene* scene = importer.ReadFile(path, options);
+	return options;
+}
+
+ModelData assimpConvert(const std::string& path, uint32_t importFlags) {
+	std::vector<std::string> dependencies;
+	Assimp::Importer importer;
+	// The importer takes ownership of the IO system.
+	importer.SetIOHandler(new RecordingIOSystem(path, dependencies));
+	const aiScene* scene = importer.ReadFile(path, importFlags);
 
 	// If the import failed, report it
 	if (nullptr == scene) {
 		auto* error = importer.GetErrorString();
 		std::cerr << "Error loading assimp file: " + std::string(error) << std::endl;
 		throw std::runtime_error("Error loading assimp file: " + std::string(error));
+	}
 
+	ModelData model;
+	model.dependencies = std::move(dependencies);
+	std::filesystem::path modelPath(path);
+	std::unordered_map<std::filesystem::path, uint32_t> loadedTextures;
+	model.meshes.reserve(scene->mNumMeshes);
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		model.meshes.push_back(fromAssimpMesh(scene->mMeshes[i], scene, modelPath, loadedTextures, model));
 	}
-	else {
 
+	// Flatten the node hierarchy breadth-first, so each node's children are contiguous.
+	std::vector<const aiNode*> queue = { scene->mRootNode };
+	for (size_t n = 0; n < queue.size(); n++) {
+		const aiNode* node = queue[n];
+		NodeData data;
+		data.name = node->mName.C_Str();
+		for (auto i = 0; i < 4; i++) {
+			for (auto j = 0; j < 4; j++) {
+				data.transform[i][j] = node->mTransformation[j][i];
+			}
+		}
+		data.meshes.assign(node->mMeshes, node->mMeshes + node->mNumMeshes);
+		data.firstChild = static_cast<uint32_t>(queue.size());
+		data.childCount = node->mNumChildren;
+		queue.insert(queue.end(), node->mChildren, node->mChildren + node->mNumChildren);
+		model.nodes.push_back(std::move(data));
 	}
-	std::vector<Mesh3D> meshes;
-	std::unordered_map<std::filesystem::path, Texture> loadedTextures;
-	auto ret = processAssimpNode(scene->mRootNode, scene, std::filesystem::path(path), loadedTextures);
-	return ret;
+	return model;
 }
 
-Object3D processAssimpNode(aiNode* node, const aiScene* scene,
-	const std::filesystem::path& modelPath,
-	std::unordered_map<std::filesystem::path, Texture>& loadedTextures) {
+void setObjImport(bool enabled, size_t threadCount) {
+	objImportEnabled = enabled;
+	objImportThreads = threadCount;
+}
 
-	// Load the aiNode's meshes.
-	std::vector<Mesh3D> meshes;
-	for (auto i = 0; i < node->mNumMeshes; i++) {
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.emplace_back(fromAssimpMesh(mesh, scene, modelPath, loadedTextures));
+ModelImporter modelImporterFor(const std::string& path) {
+	auto extension = std::filesystem::path(path).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+		return static_cast<char>(std::tolower(c));
+	});
+	return objImportEnabled && extension == ".obj" ? ModelImporter::Obj : ModelImporter::Assimp;
+}
+
+ModelData convertModel(const std::string& path, uint32_t importFlags) {
+	if (modelImporterFor(path) == ModelImporter::Obj) {
+		return objConvert(path, importFlags, objImportThreads);
+	}
+	return assimpConvert(path, importFlags);
+}
+
+ModelData assimpImport(const std::string& path, uint32_t importFlags) {
+	auto model = convertModel(path, importFlags);
+	optimizeMeshes(model, path);
+	return model;
+}
+
+CachedModel loadCachedModel(const std::string& path, uint32_t importFlags, bool& cacheHit) {
+	CachedModel cached;
+	auto importer = modelImporterFor(path);
+	uint64_t sourceHash = 0;
+	if (!hashFile(path, sourceHash)) {
+		// Let the importer report the missing or unreadable file.
+		convertModel(path, importFlags);
 	}
 
-	std::vector<Texture> textures;
-	for (auto& p : loadedTextures) {
-		textures.push_back(p.second);
+	auto cachePath = modelCachePath(path, importFlags, importer);
+	cacheHit = cached.open(cachePath) && cached.matches(path, sourceHash, importFlags, importer);
+	if (cacheHit) {
+		return cached;
+	}
+
+	auto bytes = serializeModel(assimpImport(path, importFlags), path, sourceHash, importFlags, importer);
+	if (writeCacheFile(cachePath, bytes) && cached.open(cachePath)) {
+		return cached;
+	}
+	// The cache directory isn't writable; use the serialized data straight from memory.
+	cached.adopt(std::move(bytes));
+	return cached;
+}
+
+/**
+ * @brief Instantiates a node and its subtree.
+ * @param uses how many more nodes reference each mesh. A mesh is moved into the last node that
+ * references it, and copied into the others.
+ */
+Object3D instantiateNode(const CachedModel& model, size_t index, std::vector<Mesh3D>& meshes, std::vector<uint32_t>& uses) {
+	auto& record = model.node(index);
+
+	// Nodes share the meshes they reference, rather than uploading them again.
+	std::vector<Mesh3D> nodeMeshes;
+	nodeMeshes.reserve(model.nodeMeshes(index).size());
+	for (auto mesh : model.nodeMeshes(index)) {
+		if (--uses[mesh] == 0) {
+			nodeMeshes.push_back(std::move(meshes[mesh]));
+		}
+		else {
+			nodeMeshes.push_back(meshes[mesh]);
+		}
 	}
 	glm::mat4 baseTransform;
-	for (auto i = 0; i < 4; i++) {
-		for (auto j = 0; j < 4; j++) {
-			baseTransform[i][j] = node->mTransformation[j][i];
+	std::memcpy(&baseTransform[0][0], record.transform, sizeof(record.transform));
+
+	auto parent = Object3D(std::move(nodeMeshes), baseTransform);
+	parent.setName(std::string(model.nodeName(index)));
+	for (uint32_t i = 0; i < record.childCount; i++) {
+		parent.addChild(instantiateNode(model, record.firstChild + i, meshes, uses));
+	}
+	return parent;
+}
+
+PreparedModel prepareModel(const std::string& path, uint32_t importFlags, bool compressTextures) {
+	auto start = std::chrono::steady_clock::now();
+	PreparedModel prepared{ path };
+	prepared.model = loadCachedModel(path, importFlags, prepared.cacheHit);
+
+	// An image is cooked for the first sampler that uses it.
+	auto& header = prepared.model.header();
+	std::vector<std::string> samplerNames(header.imageCount);
+	for (size_t mesh = header.meshCount; mesh-- > 0; ) {
+		for (auto& binding : prepared.model.bindings(mesh)) {
+			samplerNames.at(binding.image) = prepared.model.samplerName(binding);
 		}
 	}
-	auto parent = Object3D(std::move(meshes), baseTransform);
+	prepared.images.reserve(header.imageCount);
+	for (size_t i = 0; i < header.imageCount; i++) {
+		prepared.images.push_back(prepareImage(std::string(prepared.model.image(i)), samplerNames[i], compressTextures));
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	prepared.prepareMilliseconds = elapsed.count();
+	return prepared;
+}
 
-	for (auto i = 0; i < node->mNumChildren; i++) {
-		Object3D child = processAssimpNode(node->mChildren[i], scene, modelPath, loadedTextures);
-		parent.addChild(std::move(child));
+Object3D instantiateModel(PreparedModel&& prepared, TextureStreamer* streamer, GeometryArena* arena) {
+	auto& model = prepared.model;
+	auto& header = model.header();
+
+	// Upload each image the first time a mesh references it.
+	std::vector<std::optional<Texture>> images(header.imageCount);
+	std::vector<Mesh3D> meshes;
+	meshes.reserve(header.meshCount);
+	for (size_t i = 0; i < header.meshCount; i++) {
+		std::vector<Texture> textures;
+		for (auto& binding : model.bindings(i)) {
+			auto& image = images.at(binding.image);
+			if (!image) {
+				image = uploadImage(std::move(prepared.images[binding.image]), std::string(model.samplerName(binding)), streamer);
+			}
+			textures.push_back(Texture{ image->textureId, std::string(model.samplerName(binding)), image->byteSize,
+				image->owner });
+		}
+		auto indices = model.indices(i);
+		if (model.vertexFormat(i) == VertexFormat::Packed) {
+			auto vertices = model.packedVertices(i);
+			meshes.emplace_back(vertices.data(), vertices.size(), model.quantization(i), indices.data(), indices.size(),
+				std::move(textures), arena);
+		}
+		else {
+			auto vertices = model.vertices(i);
+			meshes.emplace_back(vertices.data(), vertices.size(), indices.data(), indices.size(), std::move(textures), arena);
+		}
+		auto lods = model.lods(i);
+		meshes.back().setLods(std::vector<MeshLod>(lods.begin(), lods.end()));
+	}
+	std::vector<uint32_t> uses(meshes.size());
+	for (size_t node = 0; node < header.nodeCount; node++) {
+		for (auto mesh : model.nodeMeshes(node)) {
+			uses[mesh]++;
+		}
 	}
+	return instantiateNode(model, 0, meshes, uses);
+}
 
-	return parent;
+Object3D assimpLoad(const std::string& path, bool flipTextureCoords, TextureStreamer* streamer, bool compressTextures,
+	GeometryArena* arena) {
+	auto prepared = prepareModel(path, assimpImportFlags(flipTextureCoords), compressTextures);
+	auto cacheHit = prepared.cacheHit;
+	auto prepareTime = prepared.prepareMilliseconds;
+	auto start = std::chrono::steady_clock::now();
+	auto ret = instantiateModel(std::move(prepared), streamer, arena);
+	std::chrono::duration<double, std::milli> uploadTime = std::chrono::steady_clock::now() - start;
+
+	std::cout << (cacheHit ? "[cache hit]  " : "[cache miss] ") << path << ": "
+		<< prepareTime << " ms " << (cacheHit ? "mapped" : "imported") << ", "
+		<< uploadTime.count() << " ms uploaded" << std::endl;
+	return ret;
 }
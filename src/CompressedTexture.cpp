@@ -0,0 +1,312 @@
+#include "CompressedTexture.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace {
+	const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	const char* SOURCE_HASH_KEY = "GraphicsSourceHash";
+	const char* COOKER_VERSION_KEY = "GraphicsCookerVersion";
+
+	struct Ktx2Header {
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+
+	struct Ktx2LevelIndex {
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	// Khronos Data Format color models and channel ids for the formats we write.
+	const uint8_t KHR_DF_MODEL_BC1A = 128;
+	const uint8_t KHR_DF_MODEL_BC3 = 130;
+	const uint8_t KHR_DF_MODEL_BC5 = 132;
+	const uint8_t KHR_DF_CHANNEL_COLOR = 0;
+	const uint8_t KHR_DF_CHANNEL_GREEN = 1;
+	const uint8_t KHR_DF_CHANNEL_BC3_ALPHA = 15;
+
+	void appendU32(std::vector<uint8_t>& out, uint32_t value) {
+		auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+		out.insert(out.end(), bytes, bytes + 4);
+	}
+
+	void padTo(std::vector<uint8_t>& out, size_t alignment) {
+		out.resize((out.size() + alignment - 1) / alignment * alignment);
+	}
+
+	/**
+	 * @brief Builds the data format descriptor: one basic block with a sample per 64-bit half
+	 * of the texel block.
+	 */
+	std::vector<uint8_t> dataFormatDescriptor(BlockFormat format) {
+		struct Sample {
+			uint32_t bitOffset;
+			uint8_t channel;
+		};
+		uint8_t colorModel;
+		std::vector<Sample> samples;
+		switch (format) {
+		case BlockFormat::BC1:
+			colorModel = KHR_DF_MODEL_BC1A;
+			samples = { { 0, KHR_DF_CHANNEL_COLOR } };
+			break;
+		case BlockFormat::BC3:
+			colorModel = KHR_DF_MODEL_BC3;
+			samples = { { 0, KHR_DF_CHANNEL_BC3_ALPHA }, { 64, KHR_DF_CHANNEL_COLOR } };
+			break;
+		default:
+			colorModel = KHR_DF_MODEL_BC5;
+			samples = { { 0, KHR_DF_CHANNEL_COLOR }, { 64, KHR_DF_CHANNEL_GREEN } };
+			break;
+		}
+		auto blockSize = static_cast<uint32_t>(24 + 16 * samples.size());
+
+		std::vector<uint8_t> dfd;
+		appendU32(dfd, 4 + blockSize);
+		// Vendor Khronos, descriptor type basic; version 2 of the basic block.
+		appendU32(dfd, 0);
+		appendU32(dfd, 2 | (blockSize << 16));
+		// Color model, BT.709 primaries, linear transfer, straight alpha.
+		appendU32(dfd, colorModel | (1 << 8) | (1 << 16));
+		// 4x4x1x1 texel blocks, stored as dimension - 1.
+		appendU32(dfd, 3 | (3 << 8));
+		appendU32(dfd, blockBytes(format));
+		appendU32(dfd, 0);
+		for (auto& sample : samples) {
+			appendU32(dfd, sample.bitOffset | (63u << 16) | (uint32_t(sample.channel) << 24));
+			appendU32(dfd, 0);
+			appendU32(dfd, 0);
+			appendU32(dfd, 0xFFFFFFFF);
+		}
+		return dfd;
+	}
+
+	void appendKeyValue(std::vector<uint8_t>& kvd, const std::string& key, const std::string& value) {
+		auto length = static_cast<uint32_t>(key.size() + 1 + value.size() + 1);
+		appendU32(kvd, length);
+		kvd.insert(kvd.end(), key.begin(), key.end());
+		kvd.push_back(0);
+		kvd.insert(kvd.end(), value.begin(), value.end());
+		kvd.push_back(0);
+		padTo(kvd, 4);
+	}
+}
+
+uint32_t blockBytes(BlockFormat format) {
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+CompressedTexture::CompressedTexture()
+	: m_data(nullptr), m_size(0), m_format(BlockFormat::BC1), m_width(0), m_height(0),
+	m_sourceHash(0), m_cookerVersion(0) {
+}
+
+bool CompressedTexture::open(const std::filesystem::path& path) {
+	if (!m_file.open(path.string())) {
+		return false;
+	}
+	m_data = m_file.data();
+	m_size = m_file.size();
+	return parse();
+}
+
+bool CompressedTexture::adopt(std::vector<uint8_t>&& bytes) {
+	m_file = MappedFile();
+	m_bytes = std::move(bytes);
+	m_data = m_bytes.data();
+	m_size = m_bytes.size();
+	return parse();
+}
+
+bool CompressedTexture::parse() {
+	m_levels.clear();
+	Ktx2Header header;
+	if (m_size < sizeof(header)) {
+		return false;
+	}
+	std::memcpy(&header, m_data, sizeof(header));
+	auto format = static_cast<BlockFormat>(header.vkFormat);
+	if (std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0
+		|| (format != BlockFormat::BC1 && format != BlockFormat::BC3 && format != BlockFormat::BC5)
+		|| header.supercompressionScheme != 0 || header.levelCount == 0 || header.levelCount > 32
+		|| sizeof(header) + header.levelCount * sizeof(Ktx2LevelIndex) > m_size) {
+		return false;
+	}
+	m_format = format;
+	m_width = header.pixelWidth;
+	m_height = header.pixelHeight;
+
+	for (uint32_t i = 0; i < header.levelCount; i++) {
+		Ktx2LevelIndex index;
+		std::memcpy(&index, m_data + sizeof(header) + i * sizeof(index), sizeof(index));
+		CompressedLevel level{ std::max(m_width >> i, 1u), std::max(m_height >> i, 1u),
+			static_cast<size_t>(index.byteOffset), static_cast<size_t>(index.byteLength) };
+		size_t expected = static_cast<size_t>((level.width + 3) / 4) * ((level.height + 3) / 4) * blockBytes(m_format);
+		if (index.byteOffset > m_size || index.byteLength > m_size - index.byteOffset || index.byteLength != expected) {
+			return false;
+		}
+		m_levels.push_back(level);
+	}
+
+	// Read back the key/value pairs identifying what the texture was cooked from.
+	m_sourceHash = 0;
+	m_cookerVersion = 0;
+	if (header.kvdByteOffset <= m_size && header.kvdByteLength <= m_size - header.kvdByteOffset) {
+		size_t position = header.kvdByteOffset;
+		size_t end = position + header.kvdByteLength;
+		while (position + 4 <= end) {
+			uint32_t length;
+			std::memcpy(&length, m_data + position, 4);
+			if (length > end - position - 4) {
+				break;
+			}
+			std::string_view pair(reinterpret_cast<const char*>(m_data + position + 4), length);
+			auto split = pair.find('\0');
+			if (split != std::string_view::npos) {
+				auto key = pair.substr(0, split);
+				std::string value(pair.substr(split + 1));
+				if (key == SOURCE_HASH_KEY) {
+					m_sourceHash = std::strtoull(value.c_str(), nullptr, 16);
+				}
+				else if (key == COOKER_VERSION_KEY) {
+					m_cookerVersion = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+				}
+			}
+			position += (4 + length + 3) / 4 * 4;
+		}
+	}
+	return true;
+}
+
+std::vector<uint8_t> CompressedTexture::serialize(BlockFormat format, const std::vector<std::vector<uint8_t>>& levels,
+	uint32_t width, uint32_t height, uint64_t sourceHash, uint32_t cookerVersion) {
+	auto levelCount = static_cast<uint32_t>(levels.size());
+	auto dfd = dataFormatDescriptor(format);
+	std::vector<uint8_t> kvd;
+	char hash[17];
+	std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(sourceHash));
+	appendKeyValue(kvd, COOKER_VERSION_KEY, std::to_string(cookerVersion));
+	appendKeyValue(kvd, SOURCE_HASH_KEY, hash);
+
+	Ktx2Header header{};
+	std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat = static_cast<uint32_t>(format);
+	header.typeSize = 1;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.faceCount = 1;
+	header.levelCount = levelCount;
+
+	std::vector<uint8_t> out(sizeof(header) + levelCount * sizeof(Ktx2LevelIndex));
+	header.dfdByteOffset = static_cast<uint32_t>(out.size());
+	header.dfdByteLength = static_cast<uint32_t>(dfd.size());
+	out.insert(out.end(), dfd.begin(), dfd.end());
+	header.kvdByteOffset = static_cast<uint32_t>(out.size());
+	header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+	out.insert(out.end(), kvd.begin(), kvd.end());
+
+	// KTX2 stores the smallest level first, each aligned to the block size.
+	std::vector<Ktx2LevelIndex> index(levelCount);
+	for (auto i = levelCount; i-- > 0;) {
+		padTo(out, blockBytes(format));
+		index[i] = { out.size(), levels[i].size(), levels[i].size() };
+		out.insert(out.end(), levels[i].begin(), levels[i].end());
+	}
+	std::memcpy(out.data(), &header, sizeof(header));
+	std::memcpy(out.data() + sizeof(header), index.data(), index.size() * sizeof(Ktx2LevelIndex));
+	return out;
+}
+
+bool CompressedTexture::isValid() const {
+	return !m_levels.empty();
+}
+
+BlockFormat CompressedTexture::format() const {
+	return m_format;
+}
+
+uint32_t CompressedTexture::width() const {
+	return m_width;
+}
+
+uint32_t CompressedTexture::height() const {
+	return m_height;
+}
+
+size_t CompressedTexture::levelCount() const {
+	return m_levels.size();
+}
+
+const CompressedLevel& CompressedTexture::level(size_t index) const {
+	return m_levels[index];
+}
+
+const uint8_t* CompressedTexture::levelData(size_t index) const {
+	return m_data + m_levels[index].offset;
+}
+
+uint64_t CompressedTexture::sourceHash() const {
+	return m_sourceHash;
+}
+
+uint32_t CompressedTexture::cookerVersion() const {
+	return m_cookerVersion;
+}
+
+size_t CompressedTexture::gpuBytes() const {
+	size_t bytes = 0;
+	for (auto& level : m_levels) {
+		bytes += level.size;
+	}
+	return bytes;
+}
+
+GLenum CompressedTexture::glInternalFormat() const {
+	switch (m_format) {
+	case BlockFormat::BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	default:
+		return GL_COMPRESSED_RG_RGTC2;
+	}
+}
+
+bool CompressedTexture::isSupported() {
+	// RGTC (BC5) is core since OpenGL 3.0; S3TC (BC1/BC3) is an extension, though one that
+	// every desktop driver exposes.
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		auto* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (name != nullptr && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+			return true;
+		}
+	}
+	return false;
+}
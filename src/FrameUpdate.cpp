@@ -0,0 +1,99 @@
+#include "FrameUpdate.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+	// Each stage is split into about this many tasks per thread, so that threads that finish
+	// early have something left to steal.
+	const size_t TASKS_PER_THREAD = 8;
+
+	/**
+	 * @brief Finds the representative of an element's set, halving the path to it.
+	 */
+	size_t findSet(std::vector<size_t>& parents, size_t i) {
+		while (parents[i] != i) {
+			parents[i] = parents[parents[i]];
+			i = parents[i];
+		}
+		return i;
+	}
+}
+
+FrameUpdate::FrameUpdate(WorkStealingPool& pool, TransformHierarchy& transforms)
+	: m_pool(pool), m_transforms(transforms) {
+}
+
+void FrameUpdate::addAnimators(std::vector<Animator>& animators) {
+	for (auto& animator : animators) {
+		m_animators.push_back(&animator);
+	}
+	groupAnimators();
+}
+
+void FrameUpdate::addObjects(std::vector<Object3D>& objects) {
+	for (auto& object : objects) {
+		m_roots.push_back(&object);
+	}
+}
+
+void FrameUpdate::removeObject(const Object3D& object) {
+	m_roots.erase(std::remove(m_roots.begin(), m_roots.end(), &object), m_roots.end());
+}
+
+/**
+ * @brief Joins animators into sets that share a target object, with a union-find over the
+ * animators keyed by the first animator seen to move each object. Groups keep the animators'
+ * order.
+ */
+void FrameUpdate::groupAnimators() {
+	std::vector<size_t> parents(m_animators.size());
+	std::iota(parents.begin(), parents.end(), 0);
+	std::unordered_map<const Object3D*, size_t> firstAnimator;
+	std::vector<Object3D*> targets;
+	for (size_t i = 0; i < m_animators.size(); i++) {
+		targets.clear();
+		m_animators[i]->collectTargets(targets);
+		for (auto target : targets) {
+			auto [first, inserted] = firstAnimator.emplace(target, i);
+			if (!inserted) {
+				parents[findSet(parents, i)] = findSet(parents, first->second);
+			}
+		}
+	}
+
+	m_animatorGroups.clear();
+	std::unordered_map<size_t, size_t> groupOfSet;
+	for (size_t i = 0; i < m_animators.size(); i++) {
+		auto [group, inserted] = groupOfSet.emplace(findSet(parents, i), m_animatorGroups.size());
+		if (inserted) {
+			m_animatorGroups.emplace_back();
+		}
+		m_animatorGroups[group->second].push_back(m_animators[i]);
+	}
+}
+
+void FrameUpdate::run(float dt) {
+	auto grain = [this](size_t count) {
+		return std::max<size_t>(1, count / (m_pool.size() * TASKS_PER_THREAD));
+	};
+	m_pool.parallelFor(m_animatorGroups.size(), grain(m_animatorGroups.size()), [this, dt](size_t begin, size_t end) {
+		PROFILE_SCOPE("Animator::tick");
+		for (auto i = begin; i < end; i++) {
+			for (auto animator : m_animatorGroups[i]) {
+				animator->tick(dt);
+			}
+		}
+	});
+	{
+		PROFILE_SCOPE("transforms");
+		m_transforms.update(m_pool);
+	}
+	m_pool.parallelFor(m_roots.size(), grain(m_roots.size()), [this](size_t begin, size_t end) {
+		PROFILE_SCOPE("bounds");
+		for (auto i = begin; i < end; i++) {
+			m_roots[i]->updateBounds();
+		}
+	});
+}
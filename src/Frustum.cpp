@@ -0,0 +1,145 @@
+#include "Frustum.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE 1
+#include <immintrin.h>
+#endif
+
+namespace {
+	// Volumes are tested in groups of this many, one per SSE lane.
+	const size_t LANES = 4;
+
+	/**
+	 * @brief Writes the result of testing one group of volumes, given a mask with bit i set if
+	 * volume i was outside some plane.
+	 */
+	void writeGroup(int outsideMask, size_t count, uint8_t* visible) {
+		for (size_t i = 0; i < count; i++) {
+			visible[i] = (outsideMask >> i) & 1 ? 0 : 1;
+		}
+	}
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection, const glm::vec4& clipPlane) {
+	// Each plane is the last row of the matrix plus or minus one of the others: a point is inside
+	// when -w <= x, y, z <= w in clip space.
+	auto row = [&](int i) {
+		return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	};
+	setPlane(0, row(3) + row(0));
+	setPlane(1, row(3) - row(0));
+	setPlane(2, row(3) + row(1));
+	setPlane(3, row(3) - row(1));
+	setPlane(4, row(3) + row(2));
+	setPlane(5, row(3) - row(2));
+	if (clipPlane != glm::vec4(0)) {
+		setPlane(6, clipPlane);
+	}
+	else {
+		setPlane(6, glm::vec4(0, 0, 0, std::numeric_limits<float>::max()));
+	}
+	setPlane(7, glm::vec4(0, 0, 0, std::numeric_limits<float>::max()));
+}
+
+void Frustum::setPlane(size_t index, const glm::vec4& plane) {
+	// Normalizing makes the plane equation give distances, which are compared against radii.
+	auto length = glm::length(glm::vec3(plane));
+	auto normalized = length > 0 ? plane / length : plane;
+	m_normalX[index] = normalized.x;
+	m_normalY[index] = normalized.y;
+	m_normalZ[index] = normalized.z;
+	m_distance[index] = normalized.w;
+}
+
+bool Frustum::intersects(const BoundingBox& box) const {
+	uint8_t visible;
+	cullBoxes(&box, 1, &visible);
+	return visible != 0;
+}
+
+/**
+ * @brief A box is outside a plane when its center is further behind it than the box reaches
+ * towards it: dot(n, c) + d < -dot(|n|, e), with e the box's half extent.
+ */
+void Frustum::cullBoxes(const BoundingBox* boxes, size_t count, uint8_t* visible) const {
+	for (size_t first = 0; first < count; first += LANES) {
+		auto group = std::min(LANES, count - first);
+		alignas(16) float center[3][LANES] = {};
+		alignas(16) float extent[3][LANES] = {};
+		for (size_t i = 0; i < group; i++) {
+			auto& box = boxes[first + i];
+			for (int axis = 0; axis < 3; axis++) {
+				center[axis][i] = (box.min[axis] + box.max[axis]) * 0.5f;
+				extent[axis][i] = (box.max[axis] - box.min[axis]) * 0.5f;
+			}
+		}
+		int outside = 0;
+#ifdef FRUSTUM_SSE
+		auto cx = _mm_load_ps(center[0]), cy = _mm_load_ps(center[1]), cz = _mm_load_ps(center[2]);
+		auto ex = _mm_load_ps(extent[0]), ey = _mm_load_ps(extent[1]), ez = _mm_load_ps(extent[2]);
+		auto signMask = _mm_set1_ps(-0.0f);
+		auto outsideLanes = _mm_setzero_ps();
+		for (size_t p = 0; p < PLANE_COUNT; p++) {
+			auto nx = _mm_set1_ps(m_normalX[p]), ny = _mm_set1_ps(m_normalY[p]), nz = _mm_set1_ps(m_normalZ[p]);
+			auto distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+				_mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(m_distance[p])));
+			auto reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+				_mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+			outsideLanes = _mm_or_ps(outsideLanes, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+		outside = _mm_movemask_ps(outsideLanes);
+#else
+		for (size_t i = 0; i < group; i++) {
+			for (size_t p = 0; p < PLANE_COUNT; p++) {
+				auto distance = m_normalX[p] * center[0][i] + m_normalY[p] * center[1][i] + m_normalZ[p] * center[2][i]
+					+ m_distance[p];
+				auto reach = std::abs(m_normalX[p]) * extent[0][i] + std::abs(m_normalY[p]) * extent[1][i]
+					+ std::abs(m_normalZ[p]) * extent[2][i];
+				if (distance + reach < 0) {
+					outside |= 1 << i;
+					break;
+				}
+			}
+		}
+#endif
+		writeGroup(outside, group, visible + first);
+	}
+}
+
+void Frustum::cullSpheres(const glm::vec4* spheres, size_t count, uint8_t* visible) const {
+	for (size_t first = 0; first < count; first += LANES) {
+		auto group = std::min(LANES, count - first);
+		int outside = 0;
+#ifdef FRUSTUM_SSE
+		// Load four spheres and transpose them to one register per component.
+		__m128 lanes[LANES];
+		for (size_t i = 0; i < LANES; i++) {
+			lanes[i] = i < group ? _mm_loadu_ps(&spheres[first + i].x) : _mm_setzero_ps();
+		}
+		_MM_TRANSPOSE4_PS(lanes[0], lanes[1], lanes[2], lanes[3]);
+		auto outsideLanes = _mm_setzero_ps();
+		for (size_t p = 0; p < PLANE_COUNT; p++) {
+			auto distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m_normalX[p]), lanes[0]),
+				_mm_mul_ps(_mm_set1_ps(m_normalY[p]), lanes[1])),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m_normalZ[p]), lanes[2]), _mm_set1_ps(m_distance[p])));
+			outsideLanes = _mm_or_ps(outsideLanes, _mm_cmplt_ps(_mm_add_ps(distance, lanes[3]), _mm_setzero_ps()));
+		}
+		outside = _mm_movemask_ps(outsideLanes);
+#else
+		for (size_t i = 0; i < group; i++) {
+			auto& sphere = spheres[first + i];
+			for (size_t p = 0; p < PLANE_COUNT; p++) {
+				auto distance = m_normalX[p] * sphere.x + m_normalY[p] * sphere.y + m_normalZ[p] * sphere.z + m_distance[p];
+				if (distance + sphere.w < 0) {
+					outside |= 1 << i;
+					break;
+				}
+			}
+		}
+#endif
+		writeGroup(outside, group, visible + first);
+	}
+}
@@ -0,0 +1,48 @@
+#include "GLHandle.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include <glad/glad.h>
+
+uint32_t GLBufferTraits::create() {
+	uint32_t name;
+	glGenBuffers(1, &name);
+	return name;
+}
+
+void GLBufferTraits::destroy(uint32_t name) {
+	glDeleteBuffers(1, &name);
+	GpuMemory::shared().forget(GpuObject::Buffer, name);
+}
+
+uint32_t GLVertexArrayTraits::create() {
+	uint32_t name;
+	glGenVertexArrays(1, &name);
+	return name;
+}
+
+void GLVertexArrayTraits::destroy(uint32_t name) {
+	glDeleteVertexArrays(1, &name);
+	GLState::vertexArrayDeleted(name);
+}
+
+uint32_t GLTextureTraits::create() {
+	uint32_t name;
+	glGenTextures(1, &name);
+	return name;
+}
+
+void GLTextureTraits::destroy(uint32_t name) {
+	glDeleteTextures(1, &name);
+	GLState::textureDeleted(name);
+	GpuMemory::shared().forget(GpuObject::Texture, name);
+}
+
+uint32_t GLQueryTraits::create() {
+	uint32_t name;
+	glGenQueries(1, &name);
+	return name;
+}
+
+void GLQueryTraits::destroy(uint32_t name) {
+	glDeleteQueries(1, &name);
+}
@@ -0,0 +1,211 @@
+#include "GLState.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	// Marks a state whose value isn't known, so the next change to it always reaches OpenGL.
+	const uint32_t UNKNOWN = UINT32_MAX;
+	// Texture units past this many are bound without being shadowed.
+	const uint32_t SHADOWED_TEXTURE_UNITS = 32;
+
+	const std::array<GLenum, 6> SHADOWED_CAPABILITIES = {
+		GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST, GL_STENCIL_TEST, GL_CLIP_DISTANCE0
+	};
+
+	struct Shadow {
+		uint32_t program = UNKNOWN;
+		uint32_t vertexArray = UNKNOWN;
+		uint32_t framebuffer = UNKNOWN;
+		uint32_t activeUnit = UNKNOWN;
+		std::array<uint32_t, SHADOWED_TEXTURE_UNITS> textures;
+		// 0 or 1 when known.
+		std::array<uint32_t, SHADOWED_CAPABILITIES.size()> capabilities;
+
+		Shadow() {
+			textures.fill(UNKNOWN);
+			capabilities.fill(UNKNOWN);
+		}
+	};
+
+	Shadow shadow;
+	bool verifying = false;
+	uint64_t deletedVertexArrays = 0;
+	GLStateStats counters{ 0, 0 };
+
+	/**
+	 * @brief Records a state change, and whether it is needed. Returns true if the caller must
+	 * make the GL call.
+	 */
+	bool change(uint32_t& state, uint32_t value) {
+		if (state == value) {
+			counters.skipped++;
+			return false;
+		}
+		state = value;
+		counters.issued++;
+		return true;
+	}
+
+	void check(const char* state, uint32_t shadowed, GLint actual) {
+		if (shadowed != UNKNOWN && shadowed != static_cast<uint32_t>(actual)) {
+			throw std::runtime_error(std::string("GL state cache is stale: ") + state + " is " + std::to_string(actual)
+				+ ", shadowed as " + std::to_string(shadowed));
+		}
+	}
+
+	void verifyIfEnabled() {
+		if (verifying) {
+			GLState::verify();
+		}
+	}
+}
+
+bool GLState::useProgram(uint32_t program) {
+	bool issued = change(shadow.program, program);
+	if (issued) {
+		glUseProgram(program);
+	}
+	verifyIfEnabled();
+	return issued;
+}
+
+bool GLState::bindVertexArray(uint32_t vertexArray) {
+	bool issued = change(shadow.vertexArray, vertexArray);
+	if (issued) {
+		glBindVertexArray(vertexArray);
+	}
+	verifyIfEnabled();
+	return issued;
+}
+
+bool GLState::bindFramebuffer(uint32_t framebuffer) {
+	bool issued = change(shadow.framebuffer, framebuffer);
+	if (issued) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	}
+	verifyIfEnabled();
+	return issued;
+}
+
+bool GLState::activeTexture(uint32_t unit) {
+	bool issued = change(shadow.activeUnit, unit);
+	if (issued) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+	verifyIfEnabled();
+	return issued;
+}
+
+bool GLState::bindTexture(uint32_t texture) {
+	bool issued;
+	if (shadow.activeUnit >= SHADOWED_TEXTURE_UNITS) {
+		// The active unit is unknown or not shadowed; bind without remembering it.
+		counters.issued++;
+		issued = true;
+	}
+	else {
+		issued = change(shadow.textures[shadow.activeUnit], texture);
+	}
+	if (issued) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+	}
+	verifyIfEnabled();
+	return issued;
+}
+
+bool GLState::bindTexture(uint32_t unit, uint32_t texture) {
+	if (unit < SHADOWED_TEXTURE_UNITS && shadow.textures[unit] == texture) {
+		counters.skipped++;
+		return false;
+	}
+	activeTexture(unit);
+	return bindTexture(texture);
+}
+
+bool GLState::setEnabled(GLenum capability, bool enabled) {
+	bool issued = true;
+	auto shadowed = std::find(SHADOWED_CAPABILITIES.begin(), SHADOWED_CAPABILITIES.end(), capability);
+	if (shadowed != SHADOWED_CAPABILITIES.end()) {
+		issued = change(shadow.capabilities[shadowed - SHADOWED_CAPABILITIES.begin()], enabled ? 1 : 0);
+	}
+	else {
+		counters.issued++;
+	}
+	if (issued) {
+		if (enabled) {
+			glEnable(capability);
+		}
+		else {
+			glDisable(capability);
+		}
+	}
+	verifyIfEnabled();
+	return issued;
+}
+
+void GLState::invalidate() {
+	shadow = Shadow();
+}
+
+void GLState::vertexArrayDeleted(uint32_t vertexArray) {
+	deletedVertexArrays++;
+	if (shadow.vertexArray == vertexArray) {
+		shadow.vertexArray = 0;
+	}
+}
+
+uint64_t GLState::vertexArrayDeletions() {
+	return deletedVertexArrays;
+}
+
+void GLState::textureDeleted(uint32_t texture) {
+	for (auto& bound : shadow.textures) {
+		if (bound == texture) {
+			bound = 0;
+		}
+	}
+}
+
+void GLState::setVerifying(bool enabled) {
+	verifying = enabled;
+}
+
+void GLState::verify() {
+	GLint value;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+	check("GL_CURRENT_PROGRAM", shadow.program, value);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+	check("GL_VERTEX_ARRAY_BINDING", shadow.vertexArray, value);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &value);
+	check("GL_DRAW_FRAMEBUFFER_BINDING", shadow.framebuffer, value);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &value);
+	check("GL_READ_FRAMEBUFFER_BINDING", shadow.framebuffer, value);
+
+	GLint activeTexture;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+	check("GL_ACTIVE_TEXTURE", shadow.activeUnit, activeTexture - GL_TEXTURE0);
+	for (uint32_t unit = 0; unit < SHADOWED_TEXTURE_UNITS; unit++) {
+		if (shadow.textures[unit] == UNKNOWN) {
+			continue;
+		}
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &value);
+		check(("GL_TEXTURE_BINDING_2D of unit " + std::to_string(unit)).c_str(), shadow.textures[unit], value);
+	}
+	glActiveTexture(activeTexture);
+
+	for (size_t i = 0; i < SHADOWED_CAPABILITIES.size(); i++) {
+		check(("capability " + std::to_string(SHADOWED_CAPABILITIES[i])).c_str(), shadow.capabilities[i],
+			glIsEnabled(SHADOWED_CAPABILITIES[i]) ? 1 : 0);
+	}
+}
+
+GLStateStats GLState::stats() {
+	return counters;
+}
+
+void GLState::resetStats() {
+	counters = GLStateStats{ 0, 0 };
+}
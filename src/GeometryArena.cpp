@@ -0,0 +1,183 @@
+#include "GeometryArena.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include <algorithm>
+#include <utility>
+#include <glad/glad.h>
+
+namespace {
+	// Returned by takeFree when no free run is large enough.
+	const size_t NO_RANGE = SIZE_MAX;
+
+	size_t vertexBytes(bool packed) {
+		return packed ? sizeof(PackedVertex3D) : sizeof(Vertex3D);
+	}
+
+	/**
+	 * @brief Replaces a buffer with a larger one holding the same first usedBytes. Leaves the new
+	 * buffer bound to target.
+	 */
+	void growBuffer(GLenum target, GLBuffer& buffer, size_t usedBytes, size_t newBytes) {
+		auto grown = GLBuffer::create();
+		glBindBuffer(target, grown.get());
+		glBufferData(target, newBytes, nullptr, GL_STATIC_DRAW);
+		GpuMemory::shared().track(GpuObject::Buffer, grown.get(), GpuCategory::GeometryArena, newBytes, "GeometryArena");
+		if (buffer) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer.get());
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, target, 0, 0, usedBytes);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		// Deletes the old buffer.
+		buffer = std::move(grown);
+	}
+}
+
+GeometryArena::GeometryArena(size_t initialVertices, size_t initialIndices)
+	: m_initialVertices(initialVertices), m_initialIndices(initialIndices) {
+}
+
+/**
+ * @brief Makes sure a pool has room for the given number of additional vertices and indices,
+ * creating or growing its buffers. Leaves the pool's vertex array bound.
+ */
+void GeometryArena::reserve(Pool& pool, bool packed, size_t vertexCount, size_t indexCount) {
+	if (!pool.vertexArray) {
+		pool.vertexArray = GLVertexArray::create();
+	}
+	GLState::bindVertexArray(pool.vertexArray.get());
+
+	auto stride = vertexBytes(packed);
+	if (pool.vertexCount + vertexCount > pool.vertexCapacity) {
+		auto capacity = std::max({ pool.vertexCapacity * 2, pool.vertexCount + vertexCount, m_initialVertices });
+		growBuffer(GL_ARRAY_BUFFER, pool.vertexBuffer, pool.vertexCount * stride, capacity * stride);
+		pool.vertexCapacity = capacity;
+		// The vertex array refers to the buffer it read attributes from, so point it at the new one.
+		Mesh3D::describeVertexLayout(packed);
+	}
+	if (pool.indexCount + indexCount > pool.indexCapacity) {
+		auto capacity = std::max({ pool.indexCapacity * 2, pool.indexCount + indexCount, m_initialIndices });
+		// Binding the element array buffer while the vertex array is bound attaches it to it.
+		growBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBuffer, pool.indexCount * sizeof(uint32_t),
+			capacity * sizeof(uint32_t));
+		pool.indexCapacity = capacity;
+	}
+}
+
+/**
+ * @brief Takes count items from the first free run that holds them. Returns their offset, or
+ * NO_RANGE if no run is large enough.
+ */
+size_t GeometryArena::takeFree(std::vector<Range>& free, size_t count) {
+	if (count == 0) {
+		return NO_RANGE;
+	}
+	for (size_t i = 0; i < free.size(); i++) {
+		auto& range = free[i];
+		if (range.count >= count) {
+			auto offset = range.offset;
+			range.offset += count;
+			range.count -= count;
+			if (range.count == 0) {
+				free.erase(free.begin() + i);
+			}
+			return offset;
+		}
+	}
+	return NO_RANGE;
+}
+
+/**
+ * @brief Returns a run of items to the free list, merging it with its neighbors. A run that
+ * ends the used part of the buffer shortens it instead.
+ */
+void GeometryArena::giveBack(std::vector<Range>& free, size_t& used, size_t offset, size_t count) {
+	if (count == 0) {
+		return;
+	}
+	auto next = std::lower_bound(free.begin(), free.end(), offset, [](const Range& range, size_t offset) {
+		return range.offset < offset;
+	});
+	next = free.insert(next, Range{ offset, count });
+	if (next + 1 != free.end() && next->offset + next->count == (next + 1)->offset) {
+		next->count += (next + 1)->count;
+		free.erase(next + 1);
+	}
+	if (next != free.begin() && (next - 1)->offset + (next - 1)->count == next->offset) {
+		(next - 1)->count += next->count;
+		free.erase(next);
+	}
+	if (!free.empty() && free.back().offset + free.back().count == used) {
+		used = free.back().offset;
+		free.pop_back();
+	}
+}
+
+std::shared_ptr<const GeometryAllocation> GeometryArena::add(Pool& pool, bool packed, const void* vertices,
+	size_t vertexCount, const uint32_t* indices, size_t indexCount) {
+	auto baseVertex = takeFree(pool.freeVertices, vertexCount);
+	auto firstIndex = takeFree(pool.freeIndices, indexCount);
+	// Data that fits in no free run goes at the end.
+	reserve(pool, packed, baseVertex == NO_RANGE ? vertexCount : 0, firstIndex == NO_RANGE ? indexCount : 0);
+	if (baseVertex == NO_RANGE) {
+		baseVertex = pool.vertexCount;
+		pool.vertexCount += vertexCount;
+	}
+	if (firstIndex == NO_RANGE) {
+		firstIndex = pool.indexCount;
+		pool.indexCount += indexCount;
+	}
+
+	auto stride = vertexBytes(packed);
+	glBindBuffer(GL_ARRAY_BUFFER, pool.vertexBuffer.get());
+	glBufferSubData(GL_ARRAY_BUFFER, baseVertex * stride, vertexCount * stride, vertices);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex * sizeof(uint32_t), indexCount * sizeof(uint32_t), indices);
+	GLState::bindVertexArray(0);
+
+	auto allocation = new GeometryAllocation{ pool.vertexArray.get(), static_cast<uint32_t>(baseVertex),
+		static_cast<uint32_t>(firstIndex), static_cast<uint32_t>(vertexCount), static_cast<uint32_t>(indexCount), packed };
+	return std::shared_ptr<const GeometryAllocation>(allocation, [this](const GeometryAllocation* allocation) {
+		release(*allocation);
+		delete allocation;
+	});
+}
+
+std::shared_ptr<const GeometryAllocation> GeometryArena::add(const Vertex3D* vertices, size_t vertexCount,
+	const uint32_t* indices, size_t indexCount) {
+	return add(m_pools[0], false, vertices, vertexCount, indices, indexCount);
+}
+
+std::shared_ptr<const GeometryAllocation> GeometryArena::add(const PackedVertex3D* vertices, size_t vertexCount,
+	const uint32_t* indices, size_t indexCount) {
+	return add(m_pools[1], true, vertices, vertexCount, indices, indexCount);
+}
+
+void GeometryArena::release(const GeometryAllocation& allocation) {
+	auto& pool = m_pools[allocation.packed ? 1 : 0];
+	giveBack(pool.freeVertices, pool.vertexCount, allocation.baseVertex, allocation.vertexCount);
+	giveBack(pool.freeIndices, pool.indexCount, allocation.firstIndex, allocation.indexCount);
+}
+
+size_t GeometryArena::usedBytes() const {
+	size_t bytes = 0;
+	for (size_t i = 0; i < 2; i++) {
+		auto& pool = m_pools[i];
+		auto vertices = pool.vertexCount;
+		for (auto& range : pool.freeVertices) {
+			vertices -= range.count;
+		}
+		auto indices = pool.indexCount;
+		for (auto& range : pool.freeIndices) {
+			indices -= range.count;
+		}
+		bytes += vertices * vertexBytes(i == 1) + indices * sizeof(uint32_t);
+	}
+	return bytes;
+}
+
+size_t GeometryArena::bufferBytes() const {
+	size_t bytes = 0;
+	for (size_t i = 0; i < 2; i++) {
+		bytes += m_pools[i].vertexCapacity * vertexBytes(i == 1) + m_pools[i].indexCapacity * sizeof(uint32_t);
+	}
+	return bytes;
+}
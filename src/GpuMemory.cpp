@@ -0,0 +1,120 @@
+#include "GpuMemory.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace {
+	double megabytes(size_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+}
+
+GpuMemory::GpuMemory()
+	: m_usage(), m_totalBytes(0), m_peakBytes(0) {
+}
+
+GpuMemory& GpuMemory::shared() {
+	static GpuMemory memory;
+	return memory;
+}
+
+uint64_t GpuMemory::key(GpuObject kind, uint32_t name) {
+	return (static_cast<uint64_t>(kind) << 32) | name;
+}
+
+void GpuMemory::track(GpuObject kind, uint32_t name, GpuCategory category, size_t bytes, const char* owner) {
+	forget(kind, name);
+	// Shared pools, like the geometry arena, belong to no one model even if one made them grow.
+	bool labeled = !m_ownerLabel.empty() && (category == GpuCategory::MeshBuffers || category == GpuCategory::Textures);
+	m_records.emplace(key(kind, name), Record{ category, bytes, labeled ? m_ownerLabel : owner });
+
+	auto& usage = m_usage[static_cast<size_t>(category)];
+	usage.objects++;
+	usage.bytes += bytes;
+	usage.peakBytes = std::max(usage.peakBytes, usage.bytes);
+	m_totalBytes += bytes;
+	m_peakBytes = std::max(m_peakBytes, m_totalBytes);
+}
+
+void GpuMemory::forget(GpuObject kind, uint32_t name) {
+	auto record = m_records.find(key(kind, name));
+	if (record == m_records.end()) {
+		return;
+	}
+	auto& usage = m_usage[static_cast<size_t>(record->second.category)];
+	usage.objects--;
+	usage.bytes -= record->second.bytes;
+	m_totalBytes -= record->second.bytes;
+	m_records.erase(record);
+}
+
+GpuMemory::OwnerLabel::OwnerLabel(const std::string& owner)
+	: m_previous(std::move(GpuMemory::shared().m_ownerLabel)) {
+	GpuMemory::shared().m_ownerLabel = owner;
+}
+
+GpuMemory::OwnerLabel::~OwnerLabel() {
+	GpuMemory::shared().m_ownerLabel = std::move(m_previous);
+}
+
+size_t GpuMemory::totalBytes() const {
+	return m_totalBytes;
+}
+
+size_t GpuMemory::peakBytes() const {
+	return m_peakBytes;
+}
+
+GpuCategoryUsage GpuMemory::usage(GpuCategory category) const {
+	return m_usage[static_cast<size_t>(category)];
+}
+
+size_t GpuMemory::ownerBytes(const std::string& owner) const {
+	size_t bytes = 0;
+	for (auto& [name, record] : m_records) {
+		if (record.owner == owner) {
+			bytes += record.bytes;
+		}
+	}
+	return bytes;
+}
+
+const char* GpuMemory::categoryName(GpuCategory category) {
+	switch (category) {
+	case GpuCategory::MeshBuffers:
+		return "Mesh buffers";
+	case GpuCategory::GeometryArena:
+		return "Geometry arena";
+	case GpuCategory::Textures:
+		return "Textures";
+	case GpuCategory::RenderTargets:
+		return "Render targets";
+	case GpuCategory::DynamicBuffers:
+		return "Dynamic buffers";
+	default:
+		return "Unknown";
+	}
+}
+
+void GpuMemory::printReport(std::ostream& out, size_t topOwners) const {
+	out << "GPU memory: " << megabytes(m_totalBytes) << " MB in " << m_records.size() << " objects (peak "
+		<< megabytes(m_peakBytes) << " MB)" << std::endl;
+	for (size_t i = 0; i < m_usage.size(); i++) {
+		auto& usage = m_usage[i];
+		out << "  " << categoryName(static_cast<GpuCategory>(i)) << ": " << usage.objects << " objects, "
+			<< megabytes(usage.bytes) << " MB (peak " << megabytes(usage.peakBytes) << " MB)" << std::endl;
+	}
+
+	std::unordered_map<std::string, size_t> byOwner;
+	for (auto& [name, record] : m_records) {
+		byOwner[record.owner] += record.bytes;
+	}
+	std::vector<std::pair<std::string, size_t>> owners(byOwner.begin(), byOwner.end());
+	std::sort(owners.begin(), owners.end(), [](auto& a, auto& b) {
+		return a.second > b.second;
+	});
+	owners.resize(std::min(owners.size(), topOwners));
+	for (auto& [owner, bytes] : owners) {
+		out << "  " << owner << ": " << megabytes(bytes) << " MB" << std::endl;
+	}
+}
@@ -0,0 +1,362 @@
+#define _USE_MATH_DEFINES
+#include "LakeScene.h"
+#include "Frustum.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include "TextureCooker.h"
+#include <glad/glad.h>
+#include <glm/ext.hpp>
+#include <math.h>
+
+namespace {
+	const float FIELD_OF_VIEW = glm::radians(45.0f);
+	// Levels of detail are picked per pass. The reflection and refraction are only seen
+	// rippled through the water, so they accept coarser meshes than the main pass.
+	const float REFLECTION_LOD_BIAS = 4.0f;
+	const float REFRACTION_LOD_BIAS = 4.0f;
+	// How fast the water's ripples move.
+	const float WAVE_SPEED = 0.02f;
+	// The bass eats the duck this many seconds in.
+	const float DUCK_EATEN_SECONDS = 10.0f;
+
+	/**
+	 * @brief Starts loading a shader program that applies the Phong reflection model. The
+	 * instanced variant reads each object's model matrix from the render queue's instance buffer,
+	 * so copies of a model are drawn together.
+	 */
+	void startPhongLightingShader(ShaderProgram& shader, bool instanced = true) {
+		std::vector<std::string> defines;
+		if (instanced) {
+			defines.push_back("INSTANCED");
+		}
+		shader.startLoad("shaders/light_perspective.vert", "shaders/lighting.frag", defines);
+	}
+
+	/**
+	 * @brief Starts loading a shader program for the water.
+	 */
+	void startWaterShader(ShaderProgram& shader) {
+		shader.startLoad("shaders/water.vert", "shaders/water.frag");
+	}
+
+	/**
+	 * @brief Loads an image from the given path into an OpenGL texture, block-compressed if requested.
+	 */
+	Texture loadTexture(const std::string& path, const std::string& samplerName, bool compress) {
+		return uploadImage(prepareImage(path, samplerName, compress), samplerName);
+	}
+
+	/**
+	 * @brief Constructs a flat square with a water shader.
+	 */
+	Scene water(ShaderProgram shaderProgram, uint32_t reflectionId, uint32_t refractionID, bool compressTextures) {
+		Scene scene{ shaderProgram };
+		// Built with push_back rather than braced lists, which copy their elements.
+		std::vector<Texture> textures;
+		textures.push_back(Texture{ reflectionId, "reflectionTexture" });
+		textures.push_back(Texture{ refractionID, "refractionTexture" });
+		textures.push_back(loadTexture("models/water/waterDUDV.png", "dudvMap", compressTextures));
+		textures.push_back(loadTexture("models/water/normalMap.png", "normalMap", compressTextures));
+		std::vector<Mesh3D> meshes;
+		meshes.push_back(Mesh3D::square(std::move(textures)));
+		auto lake = Object3D(std::move(meshes));
+		lake.rotate(glm::vec3(-M_PI / 2, 0, 0));
+		lake.move(glm::vec3(0.5, 0, 0.1));
+		lake.grow(glm::vec3(7.6, 8.8, 1));
+		scene.objects.push_back(std::move(lake));
+
+		return scene;
+	}
+
+	/**
+	 * @brief Constructs a scene of a lake surrounded by cliffs. Does not include the water plane.
+	 */
+	Scene lake(ShaderProgram shaderProgram, ModelRegistry& models) {
+		Scene scene{ shaderProgram };
+
+		auto cliff1 = models.instantiate("models/cliff/Cliff.obj", true);
+		cliff1.move(glm::vec3(0, -2.5, -5));
+		cliff1.grow(glm::vec3(3, 1.5, 1));
+		scene.objects.push_back(std::move(cliff1));
+
+		auto cliff2 = models.instantiate("models/cliff/Cliff.obj", true);
+		cliff2.move(glm::vec3(5, -2.5, 0));
+		cliff2.grow(glm::vec3(3, 1.5, 1));
+		cliff2.rotate(glm::vec3(0, -M_PI / 2, 0));
+		scene.objects.push_back(std::move(cliff2));
+
+		auto cliff3 = models.instantiate("models/cliff/Cliff.obj", true);
+		cliff3.move(glm::vec3(-5, -2.5, 0));
+		cliff3.grow(glm::vec3(3, 1.5, 1));
+		cliff3.rotate(glm::vec3(0, -M_PI / 2, 0));
+		scene.objects.push_back(std::move(cliff3));
+
+		auto cliff4 = models.instantiate("models/cliff/Cliff.obj", true);
+		cliff4.move(glm::vec3(0, -2.5, 5));
+		cliff4.grow(glm::vec3(3, 1.5, 1));
+		cliff4.rotate(glm::vec3(0, M_PI, 0));
+		scene.objects.push_back(std::move(cliff4));
+
+		auto lakeBottom = models.instantiate("models/Rock_terrain/Rock_terrain_retopo.obj", true);
+		lakeBottom.move(glm::vec3(.5, -2.8, .5));
+		lakeBottom.grow(glm::vec3(1.4, 1.4, 1.4));
+		scene.objects.push_back(std::move(lakeBottom));
+
+		auto tree = models.instantiate("models/tree/scene.gltf", true);
+		tree.move(glm::vec3(-4, 3, -4));
+		scene.objects.push_back(std::move(tree));
+
+		auto torch = models.instantiate("models/torch/scene.gltf", true);
+		torch.move(glm::vec3(0, 1, -4));
+		torch.rotate(glm::vec3(M_PI / 4, 0, 0));
+		scene.objects.push_back(std::move(torch));
+
+		return scene;
+	}
+
+	/**
+	 * @brief Constructs a scene of a bass swimming up to eat a duck.
+	 */
+	Scene bass(ShaderProgram shaderProgram, ModelRegistry& models) {
+		Scene scene{ shaderProgram };
+
+		auto bass = models.instantiate("models/bass/scene.gltf", true);
+		bass.grow(glm::vec3(7, 7, 7));
+		bass.move(glm::vec3(-5, -2, 0));
+		bass.rotate(glm::vec3(0, M_PI / 2, 0));
+		scene.objects.push_back(std::move(bass));
+
+		auto duck = models.instantiate("models/duck/source/Yellow rubber duck/Rubbish_Duck.gltf", true);
+		duck.grow(glm::vec3(.25, 0.25, 0.25));
+		duck.rotate(glm::vec3(0, M_PI / 4, 0));
+		duck.move(glm::vec3(-3, 0, -3));
+		scene.objects.push_back(std::move(duck));
+
+		// Duck slowly moving to center of lake
+		Animator moveDuck;
+		moveDuck.addAnimation(std::make_unique<TranslationAnimation>(scene.objects[1], 10.0, glm::vec3(3, 0, 3)));
+		scene.animators.push_back(std::move(moveDuck));
+		// Bass rotating up to eat duck
+		Animator rotateBass;
+		rotateBass.addAnimation(std::make_unique<PauseAnimation>(scene.objects[0], 7.0));
+		rotateBass.addAnimation(std::make_unique<RotationAnimation>(scene.objects[0], 3, glm::vec3(0, 0, M_PI / 4)));
+		rotateBass.addAnimation(std::make_unique<RotationAnimation>(scene.objects[0], 1, glm::vec3(0, 0, -M_PI / 4)));
+		rotateBass.addAnimation(std::make_unique<RotationAnimation>(scene.objects[0], 2, glm::vec3(0, 0, -M_PI / 4)));
+		rotateBass.addAnimation(std::make_unique<RotationAnimation>(scene.objects[0], 2, glm::vec3(0, 0, M_PI / 4)));
+		scene.animators.push_back(std::move(rotateBass));
+
+		Animator quadraticBass;
+		quadraticBass.addAnimation(std::make_unique<PauseAnimation>(scene.objects[0], 5.0));
+		quadraticBass.addAnimation(std::make_unique<QuadraticBezierAnimation>(scene.objects[0], 5.0,
+			glm::vec3(-5, -2, 0),
+			glm::vec3(-2, -1.75, 0),
+			glm::vec3(-0.5, -0.25, 0)));
+		quadraticBass.addAnimation(std::make_unique<QuadraticBezierAnimation>(scene.objects[0], 5.0,
+			glm::vec3(-0.5, -0.25, 0),
+			glm::vec3(2, -0.5, 0),
+			glm::vec3(4, -2, 0)));
+		scene.animators.push_back(std::move(quadraticBass));
+
+		return scene;
+	}
+}
+
+std::vector<std::string> LakeScene::modelPaths() {
+	return {
+		"models/cliff/Cliff.obj",
+		"models/Rock_terrain/Rock_terrain_retopo.obj",
+		"models/tree/scene.gltf",
+		"models/torch/scene.gltf",
+		"models/bass/scene.gltf",
+		"models/duck/source/Yellow rubber duck/Rubbish_Duck.gltf",
+	};
+}
+
+LakeScene::LakeScene(ModelRegistry& models, WorkStealingPool& workers, uint32_t width, uint32_t height,
+	bool compressTextures)
+	: m_width(width), m_height(height), m_reflectionFramebuffer(0), m_refractionFramebuffer(0),
+	// The camera and lights live in uniform blocks that every program reads. Each pass writes
+	// its camera to its own slot of the frame block.
+	m_frameUniforms(FRAME_UNIFORMS_BINDING, sizeof(FrameUniforms), PASS_COUNT),
+	m_lightingUniforms(LIGHTING_UNIFORMS_BINDING, sizeof(LightingUniforms)),
+	m_frameUpdate(workers),
+	m_perspective(glm::perspective(glm::radians(45.0), static_cast<double>(width) / height, 0.1, 100.0)),
+	m_projectionScale(projectionScaleFor(FIELD_OF_VIEW, static_cast<float>(height))),
+	m_time(0), m_moveFactor(0), m_passes() {
+	// Both programs are started before either is waited for, so drivers that compile on threads
+	// of their own build them at the same time.
+	ShaderProgram phongShader, waterShader;
+	startPhongLightingShader(phongShader);
+	startWaterShader(waterShader);
+	phongShader.finishLoad();
+	waterShader.finishLoad();
+	m_lake = lake(phongShader, models);
+	m_bass = bass(phongShader, models);
+
+	GLState::setEnabled(GL_DEPTH_TEST, true);
+	GLState::setEnabled(GL_CULL_FACE, true);
+
+	m_lake.program.activate();
+	m_lake.program.setUniform("material", glm::vec4(0.3, 0.7, 1, 24));
+
+	LightingUniforms lighting;
+	lighting.ambientColor = glm::vec3(1, 1, 1);
+	lighting.directionalLight = glm::vec3(0, -1, 0);
+	lighting.directionalColor = glm::vec3(1, 1, 1);
+	lighting.light.position = glm::vec3(0, 1, -4);
+	lighting.light.ambient = glm::vec3(1, 0.84, 0.69);
+	lighting.light.diffuse = glm::vec3(1, 0.84, 0.69);
+	lighting.light.specular = glm::vec3(1, 0.84, 0.69);
+	lighting.light.constant = 1.0f;
+	lighting.light.linear = 0.7f;
+	lighting.light.quadratic = 1.8f;
+	m_lightingUniforms.update(0, lighting);
+	m_lightingUniforms.bind(0);
+
+	createRenderTarget(m_reflectionTarget, m_reflectionFramebuffer, "water reflection");
+	createRenderTarget(m_refractionTarget, m_refractionFramebuffer, "water refraction");
+	m_water = water(waterShader, m_reflectionTarget.get(), m_refractionTarget.get(), compressTextures);
+	m_water.program.activate();
+	m_water.program.setUniform("moveFactor", 0.0f);
+	m_lake.program.activate();
+
+	for (auto& animator : m_bass.animators) {
+		animator.start();
+	}
+	m_frameUpdate.addAnimators(m_bass.animators);
+	for (auto* scene : { &m_lake, &m_bass, &m_water }) {
+		m_frameUpdate.addObjects(scene->objects);
+	}
+}
+
+LakeScene::~LakeScene() {
+	GLState::bindFramebuffer(0);
+	glDeleteFramebuffers(1, &m_reflectionFramebuffer);
+	glDeleteFramebuffers(1, &m_refractionFramebuffer);
+}
+
+/**
+ * @brief Generates a framebuffer with a texture of the viewport's size attached, for the water
+ * to sample.
+ */
+void LakeScene::createRenderTarget(GLTexture& texture, uint32_t& framebuffer, const char* owner) {
+	glGenFramebuffers(1, &framebuffer);
+	GLState::bindFramebuffer(framebuffer);
+
+	texture = GLTexture::create();
+	GLState::bindTexture(texture.get());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, m_width, m_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	// Drivers store RGB8 texels in 4 bytes.
+	GpuMemory::shared().track(GpuObject::Texture, texture.get(), GpuCategory::RenderTargets,
+		static_cast<size_t>(m_width) * m_height * 4, owner);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.get(), 0);
+}
+
+void LakeScene::update(float dt) {
+	m_time += dt;
+	m_frameUpdate.run(dt);
+	// Remove the duck once it has been eaten by the bass. Its animation ended with the tick
+	// that brought the time past the end, so no animator moves it any more.
+	if (m_time > DUCK_EATEN_SECONDS && m_bass.objects.size() > 1) {
+		m_frameUpdate.removeObject(m_bass.objects.back());
+		m_bass.objects.pop_back();
+	}
+	m_moveFactor = fmod(m_moveFactor + WAVE_SPEED * dt, 1.0f);
+}
+
+void LakeScene::render(const glm::vec3& cameraPos, const glm::vec3& center, const glm::vec3& up,
+	uint32_t framebuffer, GpuProfiler& gpuProfiler) {
+	GLState::bindFramebuffer(framebuffer);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearColor(0.65f, 0.8f, 0.92f, 1.0f); // set the background to sky color
+	auto camera = glm::lookAt(cameraPos, center, up);
+
+	// Render the reflection texture. The framebuffers keep the textures attached at setup.
+	GLState::setEnabled(GL_CLIP_DISTANCE0, true);
+	GLState::bindFramebuffer(m_reflectionFramebuffer);
+	// Mirror the camera below the water, and clip away everything under it.
+	auto reflectedPos = glm::vec3(cameraPos.x, -cameraPos.y, cameraPos.z);
+	auto reflectedView = glm::lookAt(reflectedPos, center, up);
+	m_frameUniforms.update(REFLECTION_PASS, FrameUniforms(reflectedView, m_perspective, reflectedPos, glm::vec4(0, 1, 0, 0)));
+	m_frameUniforms.bind(REFLECTION_PASS);
+	// The clip plane also culls whatever lies wholly under the water.
+	Frustum reflectionFrustum(m_perspective * reflectedView, glm::vec4(0, 1, 0, 0));
+	RenderContext reflectionPass{ reflectedPos, m_projectionScale, REFLECTION_LOD_BIAS, REFLECTION_PASS, &reflectionFrustum };
+	{
+		PROFILE_SCOPE("reflection pass");
+		PROFILE_GPU_SCOPE(gpuProfiler, "reflection pass");
+		for (auto& o : m_lake.objects) {
+			o.enqueue(m_lake.program, reflectionPass, m_renderQueue);
+		}
+		for (auto& o : m_bass.objects) {
+			o.enqueue(m_bass.program, reflectionPass, m_renderQueue);
+		}
+		m_renderQueue.flush(reflectionPass.stats);
+	}
+
+	// Render the refraction texture, clipping away everything above the water.
+	GLState::bindFramebuffer(m_refractionFramebuffer);
+	m_frameUniforms.update(REFRACTION_PASS, FrameUniforms(camera, m_perspective, cameraPos, glm::vec4(0, -1, 0, 0)));
+	m_frameUniforms.bind(REFRACTION_PASS);
+	Frustum refractionFrustum(m_perspective * camera, glm::vec4(0, -1, 0, 0));
+	RenderContext refractionPass{ cameraPos, m_projectionScale, REFRACTION_LOD_BIAS, REFRACTION_PASS, &refractionFrustum };
+	{
+		PROFILE_SCOPE("refraction pass");
+		PROFILE_GPU_SCOPE(gpuProfiler, "refraction pass");
+		for (auto& o : m_lake.objects) {
+			o.enqueue(m_lake.program, refractionPass, m_renderQueue);
+		}
+		for (auto& o : m_bass.objects) {
+			o.enqueue(m_bass.program, refractionPass, m_renderQueue);
+		}
+		m_renderQueue.flush(refractionPass.stats);
+	}
+
+	// Render the scene objects into the target framebuffer.
+	GLState::bindFramebuffer(framebuffer);
+	GLState::setEnabled(GL_CLIP_DISTANCE0, false);
+	m_frameUniforms.update(MAIN_PASS, FrameUniforms(camera, m_perspective, cameraPos, glm::vec4(0)));
+	m_frameUniforms.bind(MAIN_PASS);
+	Frustum mainFrustum(m_perspective * camera);
+	RenderContext mainPass{ cameraPos, m_projectionScale, 1.0f, MAIN_PASS, &mainFrustum };
+	{
+		PROFILE_SCOPE("main pass");
+		{
+			PROFILE_GPU_SCOPE(gpuProfiler, "main pass");
+			for (auto& o : m_lake.objects) {
+				o.enqueue(m_lake.program, mainPass, m_renderQueue);
+			}
+			for (auto& o : m_bass.objects) {
+				o.enqueue(m_bass.program, mainPass, m_renderQueue);
+			}
+			m_renderQueue.flush(mainPass.stats);
+		}
+
+		// The water is drawn last in the main pass, in a flush of its own so that its draw is
+		// timed apart from the rest; GPU scopes can't nest. Its mesh binds the reflection and
+		// refraction textures along with its own.
+		{
+			PROFILE_SCOPE("water");
+			PROFILE_GPU_SCOPE(gpuProfiler, "water");
+			m_water.program.activate();
+			m_water.program.setUniform("moveFactor", m_moveFactor);
+			m_water.objects[0].enqueue(m_water.program, mainPass, m_renderQueue);
+			m_renderQueue.flush(mainPass.stats);
+		}
+	}
+
+	m_passes = { reflectionPass, refractionPass, mainPass };
+	for (auto& pass : m_passes) {
+		pass.frustum = nullptr;
+	}
+}
+
+const std::array<RenderContext, LakeScene::PASS_COUNT>& LakeScene::passes() const {
+	return m_passes;
+}
+
+float LakeScene::time() const {
+	return m_time;
+}
@@ -1,74 +1,254 @@
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include "Mesh3D.h"
 #include <glad/glad.h>
+#include "GLState.h"
+#include "GeometryArena.h"
+#include "GpuMemory.h"
 
+namespace {
+	constexpr UniformName POSITION_SCALE_UNIFORM("positionScale");
+	constexpr UniformName POSITION_OFFSET_UNIFORM("positionOffset");
+
+	// A braced list would copy the texture, as initializer lists can't be moved from.
+	std::vector<Texture> singleTexture(Texture&& texture) {
+		std::vector<Texture> textures;
+		textures.push_back(std::move(texture));
+		return textures;
+	}
+
+	/**
+	 * @brief Finds the bounding box of count positions, then the radius of the sphere around
+	 * its center that holds them all, which is often much tighter than the box's half diagonal.
+	 */
+	template <typename Position>
+	void computeBounds(size_t count, Position position, glm::vec3& min, glm::vec3& max, float& radius) {
+		min = max = glm::vec3(0);
+		for (size_t i = 0; i < count; i++) {
+			auto p = position(i);
+			min = i == 0 ? p : glm::min(min, p);
+			max = i == 0 ? p : glm::max(max, p);
+		}
+		auto center = (min + max) * 0.5f;
+		float radiusSquared = 0;
+		for (size_t i = 0; i < count; i++) {
+			auto offset = position(i) - center;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		radius = std::sqrt(radiusSquared);
+	}
+}
 
 Mesh3D::Mesh3D(std::vector<Vertex3D>&& vertices, std::vector<uint32_t>&& faces,
 	Texture texture)
-	: Mesh3D(std::move(vertices), std::move(faces), std::vector<Texture>{texture}) {
+	: Mesh3D(std::move(vertices), std::move(faces), singleTexture(std::move(texture))) {
 }
 
 Mesh3D::Mesh3D(std::vector<Vertex3D>&& vertices, std::vector<uint32_t>&& faces, std::vector<Texture>&& textures)
-	: m_vertexCount(vertices.size()), m_faceCount(faces.size()), m_textures(textures) {
+	: Mesh3D(vertices.data(), vertices.size(), faces.data(), faces.size(), std::move(textures)) {
+}
+
+Mesh3D::Mesh3D(const Vertex3D* vertices, size_t vertexCount, const uint32_t* faces, size_t faceCount,
+	std::vector<Texture>&& textures, GeometryArena* arena)
+	: m_vertexCount(vertexCount), m_faceCount(faceCount), m_baseVertex(0), m_firstIndex(0), m_textures(std::move(textures)),
+	m_vertexBytes(sizeof(Vertex3D)), m_quantization{ glm::vec3(1), glm::vec3(0) },
+	m_lods{ { 0, static_cast<uint32_t>(faceCount), 0 } } {
+
+	computeBounds(vertexCount, [&](size_t i) {
+		return glm::vec3(vertices[i].x, vertices[i].y, vertices[i].z);
+	}, m_boundsMin, m_boundsMax, m_boundsRadius);
+	if (arena != nullptr) {
+		auto allocation = arena->add(vertices, vertexCount, faces, faceCount);
+		m_vao = allocation->vertexArray;
+		m_baseVertex = allocation->baseVertex;
+		m_firstIndex = allocation->firstIndex;
+		m_storage = std::move(allocation);
+		return;
+	}
+	upload(vertices, faces);
+	describeVertexLayout(false);
+
+	// Unbind the vertex array, so no one else can accidentally mess with it.
+	GLState::bindVertexArray(0);
+}
+
+Mesh3D::Mesh3D(const PackedVertex3D* vertices, size_t vertexCount, const VertexQuantization& quantization,
+	const uint32_t* faces, size_t faceCount, std::vector<Texture>&& textures, GeometryArena* arena)
+	: m_vertexCount(vertexCount), m_faceCount(faceCount), m_baseVertex(0), m_firstIndex(0), m_textures(std::move(textures)),
+	m_vertexBytes(sizeof(PackedVertex3D)), m_quantization(quantization),
+	m_lods{ { 0, static_cast<uint32_t>(faceCount), 0 } } {
+
+	computeBounds(vertexCount, [&](size_t i) {
+		return glm::vec3(vertices[i].x, vertices[i].y, vertices[i].z) * quantization.scale + quantization.offset;
+	}, m_boundsMin, m_boundsMax, m_boundsRadius);
+	if (arena != nullptr) {
+		auto allocation = arena->add(vertices, vertexCount, faces, faceCount);
+		m_vao = allocation->vertexArray;
+		m_baseVertex = allocation->baseVertex;
+		m_firstIndex = allocation->firstIndex;
+		m_storage = std::move(allocation);
+		return;
+	}
+	upload(vertices, faces);
+	describeVertexLayout(true);
+	GLState::bindVertexArray(0);
+}
+
+void Mesh3D::describeVertexLayout(bool packed) {
+	if (!packed) {
+		// Inform OpenGL how to interpret the buffer: each vertex is 3 floats for position...
+		glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex3D), 0);
+		glEnableVertexAttribArray(0);
+
+		// Inform OpenGL how to interpret the buffer: ... then 3 floats for normal vector...
+		glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex3D), (void*)12);
+		glEnableVertexAttribArray(1);
+
+		// Inform OpenGL how to interpret the buffer: ... the 2 floats for texture coordinate.
+		glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex3D), (void*)24);
+		glEnableVertexAttribArray(2);
+		return;
+	}
+	// Each vertex is 3 shorts for position, converted to floats as-is; the vertex shader applies
+	// the mesh's quantization scale and offset...
+	glVertexAttribPointer(0, 3, GL_SHORT, false, sizeof(PackedVertex3D), 0);
+	glEnableVertexAttribArray(0);
+
+	// ... then the normal vector as signed normalized 10-bit components...
+	glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, true, sizeof(PackedVertex3D), (void*)8);
+	glEnableVertexAttribArray(1);
 
+	// ... then 2 half floats for texture coordinate.
+	glVertexAttribPointer(2, 2, GL_HALF_FLOAT, false, sizeof(PackedVertex3D), (void*)12);
+	glEnableVertexAttribArray(2);
+}
+
+/**
+ * @brief Creates the vertex array and uploads the vertex and index buffers. Leaves the vertex
+ * array bound so the caller can describe the vertex layout.
+ */
+void Mesh3D::upload(const void* vertices, const uint32_t* faces) {
+	auto buffers = std::make_shared<MeshBuffers>();
 	// Generate a vertex array object on the GPU.
-	glGenVertexArrays(1, &m_vao);
+	buffers->vertexArray = GLVertexArray::create();
+	m_vao = buffers->vertexArray.get();
 	// "Bind" the newly-generated vao, which makes future functions operate on that specific object.
-	glBindVertexArray(m_vao);
+	GLState::bindVertexArray(m_vao);
 
 	// Generate a vertex buffer object on the GPU.
-	uint32_t vbo;
-	glGenBuffers(1, &vbo);
+	buffers->vertexBuffer = GLBuffer::create();
 
 	// "Bind" the newly-generated vbo, which makes future functions operate on that specific object.
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers->vertexBuffer.get());
 	// This vbo is now associated with m_vao.
 	// Copy the contents of the vertices list to the buffer that lives on the GPU.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex3D), &vertices[0], GL_STATIC_DRAW);
-	// Inform OpenGL how to interpret the buffer: each vertex is 3 floats for position...
-	glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex3D), 0);
-	glEnableVertexAttribArray(0);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<size_t>(m_vertexCount) * m_vertexBytes, vertices, GL_STATIC_DRAW);
+	GpuMemory::shared().track(GpuObject::Buffer, buffers->vertexBuffer.get(), GpuCategory::MeshBuffers,
+		static_cast<size_t>(m_vertexCount) * m_vertexBytes, "Mesh3D");
 
-	// Inform OpenGL how to interpret the buffer: ... then 3 floats for normal vector...
-	glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex3D), (void*)12);
-	glEnableVertexAttribArray(1);
+	// Generate a second buffer, to store the indices of each triangle in the mesh.
+	buffers->indexBuffer = GLBuffer::create();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->indexBuffer.get());
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_faceCount * sizeof(uint32_t), faces, GL_STATIC_DRAW);
+	GpuMemory::shared().track(GpuObject::Buffer, buffers->indexBuffer.get(), GpuCategory::MeshBuffers,
+		m_faceCount * sizeof(uint32_t), "Mesh3D");
+	m_storage = std::move(buffers);
+}
 
-	// Inform OpenGL how to interpret the buffer: ... the 2 floats for texture coordinate.
-	glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex3D), (void*)24);
-	glEnableVertexAttribArray(2);
+void Mesh3D::addTexture(Texture texture) {
+	m_textures.push_back(std::move(texture));
+}
 
+void Mesh3D::setLods(std::vector<MeshLod>&& lods) {
+	m_lods = std::move(lods);
+}
 
-	// Generate a second buffer, to store the indices of each triangle in the mesh.
-	uint32_t ebo;
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(uint32_t), &faces[0], GL_STATIC_DRAW);
+size_t Mesh3D::lodCount() const {
+	return m_lods.size();
+}
 
-	// Unbind the vertex array, so no one else can accidentally mess with it.
-	glBindVertexArray(0);
+const MeshLod& Mesh3D::getLod(size_t lod) const {
+	return m_lods[lod];
 }
 
-void Mesh3D::addTexture(Texture texture) {
-	m_textures.push_back(texture);
+const glm::vec3& Mesh3D::getBoundsMin() const {
+	return m_boundsMin;
+}
+
+const glm::vec3& Mesh3D::getBoundsMax() const {
+	return m_boundsMax;
+}
+
+glm::vec4 Mesh3D::getBoundingSphere() const {
+	return glm::vec4((m_boundsMin + m_boundsMax) * 0.5f, m_boundsRadius);
+}
+
+const VertexQuantization& Mesh3D::getQuantization() const {
+	return m_quantization;
+}
+
+const std::vector<Texture>& Mesh3D::getTextures() const {
+	return m_textures;
+}
+
+uint32_t Mesh3D::getVertexArray() const {
+	return m_vao;
+}
+
+uint64_t Mesh3D::getGeometryId() const {
+	return (static_cast<uint64_t>(m_vao) << 32) | m_baseVertex;
+}
+
+long Mesh3D::storageUseCount() const {
+	return m_storage.use_count();
+}
+
+DrawElementsIndirectCommand Mesh3D::indirectCommand(size_t lod, uint32_t instanceCount, uint32_t baseInstance) const {
+	auto& range = m_lods[lod];
+	return DrawElementsIndirectCommand{ range.indexCount, instanceCount, m_firstIndex + range.firstIndex,
+		static_cast<int32_t>(m_baseVertex), baseInstance };
+}
+
+size_t Mesh3D::bufferBytes() const {
+	return static_cast<size_t>(m_vertexCount) * m_vertexBytes + m_faceCount * sizeof(uint32_t);
 }
 
 void Mesh3D::render(ShaderProgram& program) const {
-	glBindVertexArray(m_vao);
+	render(program, 0);
+}
+
+void Mesh3D::render(ShaderProgram& program, size_t lod, RenderStats* stats) const {
+	// Binds that are already in place are skipped by GLState, so the vertex array and textures
+	// are left bound after drawing rather than unbound.
+	bool vertexArrayBound = GLState::bindVertexArray(m_vao);
+	// Unpacked meshes use the identity quantization.
+	program.setUniform(POSITION_SCALE_UNIFORM, m_quantization.scale);
+	program.setUniform(POSITION_OFFSET_UNIFORM, m_quantization.offset);
+	size_t texturesBound = 0;
 	for (auto i = 0; i < m_textures.size(); i++) {
 		program.setUniform(m_textures[i].samplerName, i);
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_textures[i].textureId);
+		texturesBound += GLState::bindTexture(i, m_textures[i].textureId);
 	}
 
-	// Draw the vertex array, using its "element buffer" to identify the faces.
-	glDrawElements(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr);
-	// Deactivate the mesh's vertex array and texture.
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	draw(lod);
+	if (stats != nullptr) {
+		stats->drawCalls++;
+		stats->meshesDrawn++;
+		stats->vertexArrayBinds += vertexArrayBound;
+		stats->textureBinds += texturesBound;
+	}
 }
 
+void Mesh3D::draw(size_t lod) const {
+	// Draw the vertex array, using the level of detail's range of its "element buffer" to identify the faces.
+	auto& range = m_lods[lod];
+	auto offset = static_cast<size_t>(m_firstIndex + range.firstIndex) * sizeof(uint32_t);
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, reinterpret_cast<const void*>(offset),
+		static_cast<GLint>(m_baseVertex));
+}
 
-Mesh3D Mesh3D::square(const std::vector<Texture>& textures) {
+Mesh3D Mesh3D::square(std::vector<Texture>&& textures) {
 	return Mesh3D(
 		{
 			{ 0.5, 0.5, 0, 0, 0, 1, 1, 0 },    // TR
@@ -80,6 +260,6 @@ Mesh3D Mesh3D::square(const std::vector<Texture>& textures) {
 			2, 1, 3,
 			3, 1, 0,
 		},
-		std::vector<Texture>(textures)
+		std::move(textures)
 	);
 }
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace {
+	const size_t NOT_CACHED = std::numeric_limits<size_t>::max();
+
+	/**
+	 * @brief The triangles that use each vertex, in compressed sparse row form.
+	 */
+	struct VertexAdjacency {
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+
+		VertexAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount)
+			: offsets(vertexCount + 1, 0), triangles(indices.size()) {
+			for (auto index : indices) {
+				offsets[index + 1]++;
+			}
+			std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++) {
+				triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		uint32_t count(uint32_t vertex) const {
+			return offsets[vertex + 1] - offsets[vertex];
+		}
+	};
+
+	glm::vec3 position(const Vertex3D& vertex) {
+		return glm::vec3(vertex.x, vertex.y, vertex.z);
+	}
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+	// A vertex is in a FIFO cache if fewer than cacheSize misses happened since it was inserted.
+	std::vector<size_t> insertedAt(vertexCount, NOT_CACHED);
+	size_t misses = 0, referenced = 0;
+	for (auto index : indices) {
+		if (insertedAt[index] == NOT_CACHED) {
+			referenced++;
+		}
+		if (insertedAt[index] == NOT_CACHED || misses - insertedAt[index] >= cacheSize) {
+			insertedAt[index] = misses++;
+		}
+	}
+	auto triangles = indices.size() / 3;
+	return VertexCacheStats{
+		triangles > 0 ? static_cast<float>(misses) / triangles : 0.0f,
+		referenced > 0 ? static_cast<float>(misses) / referenced : 0.0f,
+	};
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<size_t>* clusters, uint32_t cacheSize) {
+	auto triangleCount = indices.size() / 3;
+	if (clusters != nullptr) {
+		clusters->assign(1, 0);
+	}
+	if (triangleCount == 0) {
+		return;
+	}
+	VertexAdjacency adjacency(indices, vertexCount);
+	std::vector<uint32_t> liveTriangles(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		liveTriangles[v] = adjacency.count(v);
+	}
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	// Tipsify fans around one vertex at a time, then picks the next fanning vertex among the
+	// ones just emitted, preferring those still in the cache with few triangles left.
+	size_t timestamp = cacheSize + 1;
+	uint32_t cursor = 0;
+	int64_t fanning = indices[0];
+	while (fanning >= 0) {
+		candidates.clear();
+		auto f = static_cast<uint32_t>(fanning);
+		for (auto i = adjacency.offsets[f]; i < adjacency.offsets[f + 1]; i++) {
+			auto triangle = adjacency.triangles[i];
+			if (emitted[triangle]) {
+				continue;
+			}
+			emitted[triangle] = true;
+			for (int corner = 0; corner < 3; corner++) {
+				auto v = indices[triangle * 3 + corner];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (timestamp - cacheTime[v] > cacheSize) {
+					cacheTime[v] = timestamp++;
+				}
+			}
+		}
+
+		fanning = -1;
+		int64_t bestPriority = -1;
+		for (auto v : candidates) {
+			if (liveTriangles[v] == 0) {
+				continue;
+			}
+			// Prefer the oldest vertex that will still be cached after fanning around it.
+			int64_t priority = 0;
+			if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+				priority = static_cast<int64_t>(timestamp - cacheTime[v]);
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fanning = v;
+			}
+		}
+		if (fanning >= 0) {
+			continue;
+		}
+
+		// Dead end: back up through recently emitted vertices, then scan for any vertex left.
+		if (clusters != nullptr && output.size() < indices.size()) {
+			clusters->push_back(output.size());
+		}
+		while (!deadEnd.empty() && fanning < 0) {
+			auto v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0) {
+				fanning = v;
+			}
+		}
+		while (cursor < vertexCount && fanning < 0) {
+			if (liveTriangles[cursor] > 0) {
+				fanning = cursor;
+			}
+			cursor++;
+		}
+	}
+	indices = std::move(output);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex3D>& vertices,
+	const std::vector<size_t>& clusters, float threshold, uint32_t cacheSize) {
+	if (indices.empty()) {
+		return;
+	}
+
+	// Split each cluster wherever the part so far is already nearly as cache-efficient as the
+	// whole cluster, so reordering the parts costs few extra cache misses. Each simulation
+	// starts cold: only vertices inserted since its first miss count as cached.
+	std::vector<size_t> starts;
+	std::vector<size_t> insertedAt(vertices.size(), NOT_CACHED);
+	size_t misses = 0;
+	auto simulate = [&](size_t first, size_t coldSince) {
+		for (auto i = first; i < first + 3; i++) {
+			auto v = indices[i];
+			if (insertedAt[v] == NOT_CACHED || insertedAt[v] < coldSince || misses - insertedAt[v] >= cacheSize) {
+				insertedAt[v] = misses++;
+			}
+		}
+	};
+	for (size_t c = 0; c < clusters.size(); c++) {
+		auto begin = clusters[c];
+		auto end = c + 1 < clusters.size() ? clusters[c + 1] : indices.size();
+		auto coldSince = misses;
+		for (auto i = begin; i < end; i += 3) {
+			simulate(i, coldSince);
+		}
+		auto clusterAcmr = static_cast<float>(misses - coldSince) / ((end - begin) / 3);
+
+		starts.push_back(begin);
+		coldSince = misses;
+		size_t triangles = 0;
+		for (auto i = begin; i < end; i += 3) {
+			simulate(i, coldSince);
+			triangles++;
+			if (i + 3 < end && misses - coldSince <= threshold * clusterAcmr * triangles) {
+				starts.push_back(i + 3);
+				coldSince = misses;
+				triangles = 0;
+			}
+		}
+	}
+
+	// Draw clusters that face away from the mesh's center first: from any viewpoint outside
+	// the mesh, they tend to cover the clusters behind them.
+	glm::vec3 meshCenter(0);
+	for (auto& vertex : vertices) {
+		meshCenter += position(vertex) / static_cast<float>(vertices.size());
+	}
+	struct Cluster {
+		size_t begin;
+		size_t end;
+		float sortKey;
+	};
+	std::vector<Cluster> sorted;
+	for (size_t s = 0; s < starts.size(); s++) {
+		Cluster cluster{ starts[s], s + 1 < starts.size() ? starts[s + 1] : indices.size(), 0 };
+		glm::vec3 normal(0), center(0);
+		float area = 0;
+		for (auto i = cluster.begin; i < cluster.end; i += 3) {
+			auto a = position(vertices[indices[i]]), b = position(vertices[indices[i + 1]]), c = position(vertices[indices[i + 2]]);
+			auto cross = glm::cross(b - a, c - a);
+			auto triangleArea = glm::length(cross);
+			normal += cross;
+			center += (a + b + c) / 3.0f * triangleArea;
+			area += triangleArea;
+		}
+		auto normalLength = glm::length(normal);
+		if (area > 0 && normalLength > 0) {
+			cluster.sortKey = glm::dot(center / area - meshCenter, normal / normalLength);
+		}
+		sorted.push_back(cluster);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (auto& cluster : sorted) {
+		output.insert(output.end(), indices.begin() + cluster.begin, indices.begin() + cluster.end);
+	}
+	indices = std::move(output);
+}
+
+void optimizeVertexFetch(std::vector<Vertex3D>& vertices, std::vector<uint32_t>& indices) {
+	const uint32_t unmapped = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> remap(vertices.size(), unmapped);
+	std::vector<Vertex3D> reordered;
+	reordered.reserve(vertices.size());
+	for (auto& index : indices) {
+		if (remap[index] == unmapped) {
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(reordered);
+}
+
+MeshOptimizationReport optimizeMesh(std::vector<Vertex3D>& vertices, std::vector<uint32_t>& indices) {
+	MeshOptimizationReport report;
+	report.before = analyzeVertexCache(indices, vertices.size());
+	std::vector<size_t> clusters;
+	optimizeVertexCache(indices, vertices.size(), &clusters);
+	optimizeOverdraw(indices, vertices, clusters);
+	optimizeVertexFetch(vertices, indices);
+	report.after = analyzeVertexCache(indices, vertices.size());
+	return report;
+}
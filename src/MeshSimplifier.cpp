@@ -0,0 +1,266 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+	// Meshes with fewer triangles than this are drawn at full detail at any distance.
+	const size_t LOD_MIN_TRIANGLES = 256;
+	// A level is only kept if it has at most this fraction of the previous level's triangles.
+	const float LOD_MIN_REDUCTION = 0.8f;
+	// The largest error allowed in any level, relative to the diagonal of the mesh's bounding box.
+	const float LOD_MAX_RELATIVE_ERROR = 0.05f;
+
+	/**
+	 * @brief The area-weighted sum of squared distances to a set of planes, as a symmetric 4x4
+	 * matrix, and the total weight of the planes.
+	 */
+	struct Quadric {
+		double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+		double weight = 0;
+
+		void addPlane(double a, double b, double c, double d, double w) {
+			a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+			b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+			c2 += w * c * c; cd += w * c * d;
+			d2 += w * d * d;
+			weight += w;
+		}
+
+		Quadric& operator+=(const Quadric& other) {
+			a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+			b2 += other.b2; bc += other.bc; bd += other.bd;
+			c2 += other.c2; cd += other.cd;
+			d2 += other.d2;
+			weight += other.weight;
+			return *this;
+		}
+
+		double evaluate(const glm::vec3& p) const {
+			double x = p.x, y = p.y, z = p.z;
+			return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z
+				+ d2;
+		}
+	};
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		// The area-weighted error, which orders collapses so small features go first.
+		double cost;
+		// The mean squared distance from the merged planes, which limits collapses.
+		double error;
+	};
+
+	uint64_t edgeKey(uint32_t a, uint32_t b) {
+		return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+	}
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex3D>& vertices, const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float maxError, float* resultError) {
+	auto vertexCount = vertices.size();
+	std::vector<glm::vec3> positions;
+	positions.reserve(vertexCount);
+	for (auto& vertex : vertices) {
+		positions.emplace_back(vertex.x, vertex.y, vertex.z);
+	}
+
+	// Each vertex starts with the planes of the triangles around it.
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		auto& p0 = positions[indices[i]];
+		auto normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+		auto length = glm::length(normal);
+		if (length <= 0) {
+			continue;
+		}
+		normal /= length;
+		Quadric plane;
+		plane.addPlane(normal.x, normal.y, normal.z, -glm::dot(normal, p0), length * 0.5);
+		for (int corner = 0; corner < 3; corner++) {
+			quadrics[indices[i + corner]] += plane;
+		}
+	}
+
+	// Lock every vertex on an edge that isn't shared by exactly two triangles.
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeUses;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			for (int corner = 0; corner < 3; corner++) {
+				edgeUses[edgeKey(indices[i + corner], indices[i + (corner + 1) % 3])]++;
+			}
+		}
+		for (auto& edge : edgeUses) {
+			if (edge.second != 2) {
+				locked[edge.first >> 32] = true;
+				locked[edge.first & 0xffffffff] = true;
+			}
+		}
+	}
+
+	std::vector<uint32_t> result = indices;
+	double maxSquaredError = static_cast<double>(maxError) * maxError;
+	double worstError = 0;
+	std::vector<Collapse> best(vertexCount);
+	std::vector<uint32_t> collapseTo(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<Collapse> candidates;
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+
+	// Each pass makes the cheapest collapses whose neighborhoods don't overlap, then rebuilds.
+	while (result.size() > targetIndexCount) {
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			best[v] = { v, v, std::numeric_limits<double>::infinity(), 0 };
+		}
+		auto consider = [&](uint32_t from, uint32_t to) {
+			if (locked[from]) {
+				return;
+			}
+			Quadric combined = quadrics[from];
+			combined += quadrics[to];
+			auto cost = std::max(combined.evaluate(positions[to]), 0.0);
+			if (cost < best[from].cost) {
+				best[from] = { from, to, cost, combined.weight > 0 ? cost / combined.weight : 0 };
+			}
+		};
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int corner = 0; corner < 3; corner++) {
+				auto a = result[i + corner], b = result[i + (corner + 1) % 3];
+				consider(a, b);
+				consider(b, a);
+			}
+		}
+		candidates.clear();
+		for (auto& collapse : best) {
+			if (collapse.cost < std::numeric_limits<double>::infinity() && collapse.error <= maxSquaredError) {
+				candidates.push_back(collapse);
+			}
+		}
+		if (candidates.empty()) {
+			break;
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) {
+			return a.cost < b.cost;
+		});
+
+		// The triangles around each vertex.
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (auto index : result) {
+			adjacencyOffsets[index + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(result.size());
+		{
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < result.size(); i++) {
+				adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			collapseTo[v] = v;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+		size_t trianglesLeft = result.size() / 3, targetTriangles = targetIndexCount / 3;
+		size_t applied = 0;
+		for (auto& collapse : candidates) {
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+			// Reject collapses that would flip a triangle over.
+			bool flips = false;
+			size_t removed = 0;
+			for (auto a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; a++) {
+				auto* triangle = &result[adjacency[a] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+					removed++;
+					continue;
+				}
+				glm::vec3 before[3], after[3];
+				for (int corner = 0; corner < 3; corner++) {
+					before[corner] = positions[triangle[corner]];
+					after[corner] = positions[triangle[corner] == collapse.from ? collapse.to : triangle[corner]];
+				}
+				auto normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				auto normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				flips = glm::dot(normalBefore, normalAfter) <= 0;
+			}
+			if (flips) {
+				continue;
+			}
+
+			// Nothing around this collapse may change again until the next pass.
+			for (auto a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++) {
+				for (int corner = 0; corner < 3; corner++) {
+					touched[result[adjacency[a] * 3 + corner]] = true;
+				}
+			}
+			collapseTo[collapse.from] = collapse.to;
+			quadrics[collapse.to] += quadrics[collapse.from];
+			worstError = std::max(worstError, collapse.error);
+			applied++;
+			trianglesLeft -= std::min(removed, trianglesLeft);
+			if (trianglesLeft <= targetTriangles) {
+				break;
+			}
+		}
+		if (applied == 0) {
+			break;
+		}
+
+		// Apply the collapses and drop the triangles that became degenerate.
+		size_t kept = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			auto a = collapseTo[result[i]], b = collapseTo[result[i + 1]], c = collapseTo[result[i + 2]];
+			if (a != b && b != c && a != c) {
+				result[kept++] = a;
+				result[kept++] = b;
+				result[kept++] = c;
+			}
+		}
+		result.resize(kept);
+	}
+
+	if (resultError != nullptr) {
+		*resultError = static_cast<float>(std::sqrt(worstError));
+	}
+	return result;
+}
+
+std::vector<MeshLod> generateLods(const std::vector<Vertex3D>& vertices, std::vector<uint32_t>& indices) {
+	std::vector<MeshLod> lods = { { 0, static_cast<uint32_t>(indices.size()), 0 } };
+	if (indices.size() / 3 < LOD_MIN_TRIANGLES || vertices.empty()) {
+		return lods;
+	}
+	glm::vec3 low(vertices[0].x, vertices[0].y, vertices[0].z), high = low;
+	for (auto& vertex : vertices) {
+		low = glm::min(low, glm::vec3(vertex.x, vertex.y, vertex.z));
+		high = glm::max(high, glm::vec3(vertex.x, vertex.y, vertex.z));
+	}
+	auto maxError = LOD_MAX_RELATIVE_ERROR * glm::length(high - low);
+
+	// Every level is simplified from the full mesh, so its error is measured against it.
+	const std::vector<uint32_t> base(indices);
+	for (uint32_t level = 1; level < MAX_MESH_LODS; level++) {
+		auto target = (base.size() >> level) / 3 * 3;
+		float error;
+		auto simplified = simplifyMesh(vertices, base, target, maxError, &error);
+		if (simplified.size() > lods.back().indexCount * LOD_MIN_REDUCTION) {
+			break;
+		}
+		optimizeVertexCache(simplified, vertices.size());
+		lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(simplified.size()),
+			std::max(error, lods.back().error) });
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+	}
+	return lods;
+}
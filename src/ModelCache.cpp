@@ -0,0 +1,417 @@
+#include "ModelCache.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+
+namespace {
+	const char CACHE_MAGIC[4] = { 'G', 'M', 'D', 'L' };
+	const char* CACHE_DIRECTORY = "cache/models";
+	// Vertex and index arrays are aligned so they can be read in place.
+	const size_t CACHE_ALIGNMENT = 16;
+
+	/**
+	 * @brief Accumulates the sections of a cache file.
+	 */
+	class CacheWriter {
+	public:
+		std::vector<uint8_t> bytes;
+		std::string strings;
+
+		size_t align() {
+			bytes.resize((bytes.size() + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT);
+			return bytes.size();
+		}
+
+		size_t append(const void* data, size_t size) {
+			auto offset = align();
+			bytes.resize(offset + size);
+			if (size > 0) {
+				std::memcpy(bytes.data() + offset, data, size);
+			}
+			return offset;
+		}
+
+		template <typename T>
+		size_t append(const std::vector<T>& values) {
+			return append(values.data(), values.size() * sizeof(T));
+		}
+
+		CacheStringRef addString(const std::string& s) {
+			CacheStringRef ref{ static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(s.size()) };
+			strings += s;
+			return ref;
+		}
+	};
+
+	/**
+	 * @brief Hashes a file a model depends on, or gives 0 if it cannot be read, so a file that
+	 * appears or disappears also changes the hash.
+	 */
+	uint64_t hashDependency(const std::string& path) {
+		uint64_t hash = 0;
+		return hashFile(path, hash) ? hash : 0;
+	}
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+	const uint64_t prime = 0x100000001b3ull;
+	auto* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * prime;
+	}
+	for (; i < size; i++) {
+		hash = (hash ^ bytes[i]) * prime;
+	}
+	return hash;
+}
+
+bool hashFile(const std::string& path, uint64_t& hash) {
+	MappedFile file;
+	if (!file.open(path)) {
+		return false;
+	}
+	hash = hashBytes(file.data(), file.size());
+	return true;
+}
+
+std::filesystem::path modelCachePath(const std::string& sourcePath, uint32_t importFlags, ModelImporter importer) {
+	auto key = hashBytes(sourcePath.data(), sourcePath.size());
+	key = hashBytes(&importFlags, sizeof(importFlags), key);
+	key = hashBytes(&importer, sizeof(importer), key);
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << key << ".mesh";
+	return std::filesystem::path(CACHE_DIRECTORY) / name.str();
+}
+
+std::vector<uint8_t> serializeModel(const ModelData& model, const std::string& sourcePath,
+	uint64_t sourceHash, uint32_t importFlags, ModelImporter importer) {
+	CacheWriter writer;
+	CacheHeader header{};
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = MODEL_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.importFlags = importFlags;
+	header.importer = importer;
+	header.sourcePath = writer.addString(sourcePath);
+	header.imageCount = static_cast<uint32_t>(model.images.size());
+	header.meshCount = static_cast<uint32_t>(model.meshes.size());
+	header.nodeCount = static_cast<uint32_t>(model.nodes.size());
+	// Reserve room for the header; it is patched once every offset is known.
+	writer.append(&header, sizeof(header));
+
+	std::vector<CacheStringRef> images;
+	for (auto& image : model.images) {
+		images.push_back(writer.addString(image));
+	}
+	header.imagesOffset = writer.append(images);
+
+	std::vector<CacheMeshRecord> meshes;
+	std::vector<CacheBindingRecord> bindings;
+	for (auto& mesh : model.meshes) {
+		CacheMeshRecord record{};
+		if (!mesh.packedVertices.empty()) {
+			record.vertexFormat = VertexFormat::Packed;
+			record.vertexOffset = writer.append(mesh.packedVertices);
+			record.vertexCount = static_cast<uint32_t>(mesh.packedVertices.size());
+			std::memcpy(record.positionScale, &mesh.quantization.scale[0], sizeof(record.positionScale));
+			std::memcpy(record.positionOffset, &mesh.quantization.offset[0], sizeof(record.positionOffset));
+		}
+		else {
+			record.vertexFormat = VertexFormat::Float;
+			record.vertexOffset = writer.append(mesh.vertices);
+			record.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		}
+		record.indexOffset = writer.append(mesh.indices);
+		record.indexCount = static_cast<uint32_t>(mesh.indices.size());
+		if (mesh.lods.empty()) {
+			record.lodCount = 1;
+			record.lods[0] = { 0, record.indexCount, 0 };
+		}
+		else {
+			record.lodCount = static_cast<uint32_t>(std::min<size_t>(mesh.lods.size(), MAX_MESH_LODS));
+			std::copy_n(mesh.lods.begin(), record.lodCount, record.lods);
+		}
+		record.firstBinding = static_cast<uint32_t>(bindings.size());
+		record.bindingCount = static_cast<uint32_t>(mesh.textures.size());
+		for (auto& binding : mesh.textures) {
+			bindings.push_back({ binding.image, writer.addString(binding.samplerName) });
+		}
+		meshes.push_back(record);
+	}
+	header.meshesOffset = writer.append(meshes);
+	header.bindingCount = static_cast<uint32_t>(bindings.size());
+	header.bindingsOffset = writer.append(bindings);
+
+	std::vector<CacheNodeRecord> nodes;
+	std::vector<uint32_t> nodeMeshes;
+	for (auto& node : model.nodes) {
+		CacheNodeRecord record{};
+		std::memcpy(record.transform, &node.transform[0][0], sizeof(record.transform));
+		record.name = writer.addString(node.name);
+		record.firstMesh = static_cast<uint32_t>(nodeMeshes.size());
+		record.meshCount = static_cast<uint32_t>(node.meshes.size());
+		record.firstChild = node.firstChild;
+		record.childCount = node.childCount;
+		nodeMeshes.insert(nodeMeshes.end(), node.meshes.begin(), node.meshes.end());
+		nodes.push_back(record);
+	}
+	header.nodesOffset = writer.append(nodes);
+	header.nodeMeshCount = static_cast<uint32_t>(nodeMeshes.size());
+	header.nodeMeshesOffset = writer.append(nodeMeshes);
+
+	std::vector<CacheDependencyRecord> dependencies;
+	for (auto& dependency : model.dependencies) {
+		dependencies.push_back({ writer.addString(dependency), hashDependency(dependency) });
+	}
+	header.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	header.dependenciesOffset = writer.append(dependencies);
+	header.stringsOffset = writer.append(writer.strings.data(), writer.strings.size());
+
+	std::memcpy(writer.bytes.data(), &header, sizeof(header));
+	return std::move(writer.bytes);
+}
+
+bool writeCacheFile(const std::filesystem::path& cachePath, const std::vector<uint8_t>& bytes) {
+	std::error_code error;
+	std::filesystem::create_directories(cachePath.parent_path(), error);
+	if (error) {
+		return false;
+	}
+	// Write to a temporary file first, so a crash never leaves a truncated cache behind. The
+	// name is per thread, since loader threads may cook the same file at once.
+	auto tempPath = cachePath;
+	tempPath += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			return false;
+		}
+		out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+		if (!out) {
+			return false;
+		}
+	}
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error) {
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
+
+CachedModel::CachedModel()
+	: m_data(nullptr), m_size(0) {
+}
+
+bool CachedModel::open(const std::filesystem::path& cachePath) {
+	if (!m_file.open(cachePath.string())) {
+		return false;
+	}
+	m_data = m_file.data();
+	m_size = m_file.size();
+	return validate();
+}
+
+bool CachedModel::adopt(std::vector<uint8_t>&& bytes) {
+	m_file = MappedFile();
+	m_bytes = std::move(bytes);
+	m_data = m_bytes.data();
+	m_size = m_bytes.size();
+	return validate();
+}
+
+/**
+ * @brief Checks that every section referenced by the header lies within the data, and that
+ * every index stored in it refers to something that exists, so a truncated, corrupt or foreign
+ * file is rejected instead of read out of bounds.
+ */
+bool CachedModel::validate() {
+	// Sections are aligned by the writer, and read in place as arrays of records.
+	auto fits = [this](uint64_t offset, uint64_t count, uint64_t elementSize) {
+		return offset % CACHE_ALIGNMENT == 0 && offset <= m_size && count <= (m_size - offset) / elementSize;
+	};
+	if (m_size < sizeof(CacheHeader)) {
+		return false;
+	}
+	auto& h = header();
+	bool valid = std::memcmp(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+		&& h.version == MODEL_CACHE_VERSION
+		&& fits(h.imagesOffset, h.imageCount, sizeof(CacheStringRef))
+		&& fits(h.meshesOffset, h.meshCount, sizeof(CacheMeshRecord))
+		&& fits(h.bindingsOffset, h.bindingCount, sizeof(CacheBindingRecord))
+		&& fits(h.nodesOffset, h.nodeCount, sizeof(CacheNodeRecord))
+		&& fits(h.nodeMeshesOffset, h.nodeMeshCount, sizeof(uint32_t))
+		&& fits(h.dependenciesOffset, h.dependencyCount, sizeof(CacheDependencyRecord))
+		&& h.stringsOffset <= m_size
+		&& h.nodeCount > 0;
+	if (!valid) {
+		return false;
+	}
+	auto stringFits = [this, &h](const CacheStringRef& ref) {
+		return uint64_t(ref.offset) + ref.length <= m_size - h.stringsOffset;
+	};
+	if (!stringFits(h.sourcePath)) {
+		return false;
+	}
+	for (auto& image : records<CacheStringRef>(h.imagesOffset, h.imageCount)) {
+		if (!stringFits(image)) {
+			return false;
+		}
+	}
+	for (auto& dependency : records<CacheDependencyRecord>(h.dependenciesOffset, h.dependencyCount)) {
+		if (!stringFits(dependency.path)) {
+			return false;
+		}
+	}
+	for (auto& binding : records<CacheBindingRecord>(h.bindingsOffset, h.bindingCount)) {
+		if (binding.image >= h.imageCount || !stringFits(binding.samplerName)) {
+			return false;
+		}
+	}
+	for (auto& mesh : records<CacheMeshRecord>(h.meshesOffset, h.meshCount)) {
+		if ((mesh.vertexFormat != VertexFormat::Float && mesh.vertexFormat != VertexFormat::Packed)
+			|| !fits(mesh.vertexOffset, mesh.vertexCount,
+				mesh.vertexFormat == VertexFormat::Packed ? sizeof(PackedVertex3D) : sizeof(Vertex3D))
+			|| !fits(mesh.indexOffset, mesh.indexCount, sizeof(uint32_t))
+			|| mesh.firstBinding + uint64_t(mesh.bindingCount) > h.bindingCount
+			|| mesh.lodCount == 0 || mesh.lodCount > MAX_MESH_LODS) {
+			return false;
+		}
+		for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+			if (mesh.lods[lod].firstIndex + uint64_t(mesh.lods[lod].indexCount) > mesh.indexCount) {
+				return false;
+			}
+		}
+		// The indices go straight to the GPU, which would read past the vertices otherwise.
+		for (auto index : records<uint32_t>(mesh.indexOffset, mesh.indexCount)) {
+			if (index >= mesh.vertexCount) {
+				return false;
+			}
+		}
+	}
+	for (auto mesh : records<uint32_t>(h.nodeMeshesOffset, h.nodeMeshCount)) {
+		if (mesh >= h.meshCount) {
+			return false;
+		}
+	}
+	auto nodes = records<CacheNodeRecord>(h.nodesOffset, h.nodeCount);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		auto& node = nodes[i];
+		// Children come after their parent, so walking the hierarchy always ends.
+		if (node.firstMesh + uint64_t(node.meshCount) > h.nodeMeshCount
+			|| node.firstChild + uint64_t(node.childCount) > h.nodeCount
+			|| (node.childCount > 0 && node.firstChild <= i)
+			|| !stringFits(node.name)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CachedModel::matches(const std::string& sourcePath, uint64_t sourceHash, uint32_t importFlags,
+	ModelImporter importer) const {
+	auto& h = header();
+	if (h.sourceHash != sourceHash || h.importFlags != importFlags || h.importer != importer
+		|| string(h.sourcePath) != sourcePath) {
+		return false;
+	}
+	for (auto& dependency : records<CacheDependencyRecord>(h.dependenciesOffset, h.dependencyCount)) {
+		if (hashDependency(std::string(string(dependency.path))) != dependency.hash) {
+			return false;
+		}
+	}
+	return true;
+}
+
+std::string_view CachedModel::string(const CacheStringRef& ref) const {
+	auto offset = header().stringsOffset + ref.offset;
+	if (offset + ref.length > m_size) {
+		return {};
+	}
+	return std::string_view(reinterpret_cast<const char*>(m_data + offset), ref.length);
+}
+
+const CacheHeader& CachedModel::header() const {
+	return *reinterpret_cast<const CacheHeader*>(m_data);
+}
+
+bool CachedModel::isMapped() const {
+	return m_file.isOpen();
+}
+
+size_t CachedModel::byteSize() const {
+	return m_size;
+}
+
+std::string_view CachedModel::image(size_t index) const {
+	return string(records<CacheStringRef>(header().imagesOffset, header().imageCount)[index]);
+}
+
+VertexFormat CachedModel::vertexFormat(size_t mesh) const {
+	return records<CacheMeshRecord>(header().meshesOffset, header().meshCount)[mesh].vertexFormat;
+}
+
+std::span<const Vertex3D> CachedModel::vertices(size_t mesh) const {
+	auto& record = records<CacheMeshRecord>(header().meshesOffset, header().meshCount)[mesh];
+	if (record.vertexFormat != VertexFormat::Float) {
+		return {};
+	}
+	return records<Vertex3D>(record.vertexOffset, record.vertexCount);
+}
+
+std::span<const PackedVertex3D> CachedModel::packedVertices(size_t mesh) const {
+	auto& record = records<CacheMeshRecord>(header().meshesOffset, header().meshCount)[mesh];
+	if (record.vertexFormat != VertexFormat::Packed) {
+		return {};
+	}
+	return records<PackedVertex3D>(record.vertexOffset, record.vertexCount);
+}
+
+VertexQuantization CachedModel::quantization(size_t mesh) const {
+	auto& record = records<CacheMeshRecord>(header().meshesOffset, header().meshCount)[mesh];
+	if (record.vertexFormat != VertexFormat::Packed) {
+		return { glm::vec3(1), glm::vec3(0) };
+	}
+	return { glm::make_vec3(record.positionScale), glm::make_vec3(record.positionOffset) };
+}
+
+std::span<const uint32_t> CachedModel::indices(size_t mesh) const {
+	auto& record = records<CacheMeshRecord>(header().meshesOffset, header().meshCount)[mesh];
+	return records<uint32_t>(record.indexOffset, record.indexCount);
+}
+
+std::span<const MeshLod> CachedModel::lods(size_t mesh) const {
+	auto& record = records<CacheMeshRecord>(header().meshesOffset, header().meshCount)[mesh];
+	return std::span<const MeshLod>(record.lods, record.lodCount);
+}
+
+std::span<const CacheBindingRecord> CachedModel::bindings(size_t mesh) const {
+	auto& record = records<CacheMeshRecord>(header().meshesOffset, header().meshCount)[mesh];
+	return records<CacheBindingRecord>(header().bindingsOffset, header().bindingCount)
+		.subspan(record.firstBinding, record.bindingCount);
+}
+
+std::string_view CachedModel::samplerName(const CacheBindingRecord& binding) const {
+	return string(binding.samplerName);
+}
+
+const CacheNodeRecord& CachedModel::node(size_t index) const {
+	return records<CacheNodeRecord>(header().nodesOffset, header().nodeCount)[index];
+}
+
+std::span<const uint32_t> CachedModel::nodeMeshes(size_t node) const {
+	auto& record = this->node(node);
+	return records<uint32_t>(header().nodeMeshesOffset, header().nodeMeshCount)
+		.subspan(record.firstMesh, record.meshCount);
+}
+
+std::string_view CachedModel::nodeName(size_t node) const {
+	return string(this->node(node).name);
+}
@@ -0,0 +1,254 @@
+#include "ModelRegistry.h"
+#include "AssimpImport.h"
+#include "GpuMemory.h"
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+
+namespace {
+	void collectGpuBytes(const Object3D& object, std::unordered_set<uint64_t>& geometries,
+		std::unordered_set<uint32_t>& textures, size_t& bytes) {
+		for (auto& mesh : object.getMeshes()) {
+			if (geometries.insert(mesh.getGeometryId()).second) {
+				bytes += mesh.bufferBytes();
+			}
+			for (auto& texture : mesh.getTextures()) {
+				if (textures.insert(texture.textureId).second) {
+					bytes += texture.byteSize;
+				}
+			}
+		}
+		for (size_t i = 0; i < object.numberOfChildren(); i++) {
+			collectGpuBytes(object.getChild(i), geometries, textures, bytes);
+		}
+	}
+
+	/**
+	 * @brief Counts how many of an object's meshes refer to each mesh storage, and how many
+	 * meshes anywhere do.
+	 */
+	void countStorageUses(const Object3D& object, std::unordered_map<uint64_t, std::pair<long, long>>& uses) {
+		for (auto& mesh : object.getMeshes()) {
+			auto& use = uses[mesh.getGeometryId()];
+			use.first++;
+			use.second = mesh.storageUseCount();
+		}
+		for (size_t i = 0; i < object.numberOfChildren(); i++) {
+			countStorageUses(object.getChild(i), uses);
+		}
+	}
+
+	double megabytes(size_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+}
+
+ModelRegistry::ModelRegistry()
+	: m_streamer(nullptr), m_arena(nullptr), m_compressTextures(false), m_budgetBytes(0), m_useClock(0),
+	m_unloadCount(0) {
+}
+
+void ModelRegistry::setTextureStreamer(TextureStreamer* streamer) {
+	m_streamer = streamer;
+}
+
+void ModelRegistry::setTextureCompression(bool compress) {
+	m_compressTextures = compress;
+}
+
+void ModelRegistry::setGeometryArena(GeometryArena* arena) {
+	m_arena = arena;
+}
+
+void ModelRegistry::setMemoryBudget(size_t bytes) {
+	m_budgetBytes = bytes;
+}
+
+std::string ModelRegistry::key(const std::string& path, bool flipUVCoords) {
+	return path + (flipUVCoords ? "|flipUV" : "");
+}
+
+ModelRegistry::Entry& ModelRegistry::add(const std::string& key, Object3D&& prototype) {
+	auto bytes = gpuBytes(prototype);
+	m_loadOrder.push_back(key);
+	return m_models.emplace(key, Entry{ std::move(prototype), bytes, 0, ++m_useClock }).first->second;
+}
+
+/**
+ * @brief Whether anything besides the prototype shares its meshes' data. Instances copy every
+ * mesh of the prototype, so one mesh with more users than the prototype has is enough.
+ */
+bool ModelRegistry::hasLiveInstances(const Object3D& prototype) {
+	std::unordered_map<uint64_t, std::pair<long, long>> uses;
+	countStorageUses(prototype, uses);
+	return std::any_of(uses.begin(), uses.end(), [](auto& use) {
+		return use.second.second > use.second.first;
+	});
+}
+
+/**
+ * @brief How many instances of the prototype are alive now. Each instance adds as many users to
+ * a mesh storage as the prototype has, so the storage with the fewest extra users gives the
+ * count without including anything else that shares a single mesh.
+ */
+size_t ModelRegistry::liveInstanceCount(const Object3D& prototype) {
+	std::unordered_map<uint64_t, std::pair<long, long>> uses;
+	countStorageUses(prototype, uses);
+	if (uses.empty()) {
+		return 0;
+	}
+	long live = std::numeric_limits<long>::max();
+	for (auto& [geometry, use] : uses) {
+		live = std::min(live, (use.second - use.first) / use.first);
+	}
+	return static_cast<size_t>(std::max(live, 0L));
+}
+
+Object3D ModelRegistry::instantiate(const std::string& path, bool flipUVCoords) {
+	auto modelKey = key(path, flipUVCoords);
+	auto existing = m_models.find(modelKey);
+	bool loaded = existing == m_models.end();
+	if (loaded) {
+		GpuMemory::OwnerLabel owner(modelKey);
+		add(modelKey, assimpLoad(path, flipUVCoords, m_streamer, m_compressTextures, m_arena));
+		existing = m_models.find(modelKey);
+	}
+	auto& entry = existing->second;
+	entry.instanceCount++;
+	entry.lastUsed = ++m_useClock;
+	// The copy shares the prototype's GPU buffers and textures, which live while any instance does.
+	auto instance = entry.prototype;
+	if (loaded && m_budgetBytes > 0) {
+		// Models preloaded for the scene being built may not have been instantiated yet.
+		evictUnused(m_budgetBytes, true);
+	}
+	return instance;
+}
+
+size_t ModelRegistry::unloadUnused(size_t budgetBytes) {
+	return evictUnused(budgetBytes, false);
+}
+
+size_t ModelRegistry::evictUnused(size_t budgetBytes, bool keepPreloaded) {
+	std::vector<std::pair<uint64_t, std::string>> unused;
+	for (auto& [key, entry] : m_models) {
+		if (keepPreloaded && entry.instanceCount == 0) {
+			continue;
+		}
+		if (!hasLiveInstances(entry.prototype)) {
+			unused.emplace_back(entry.lastUsed, key);
+		}
+	}
+	std::sort(unused.begin(), unused.end());
+
+	size_t unloaded = 0;
+	auto resident = residentBytes();
+	for (auto& [lastUsed, key] : unused) {
+		if (resident <= budgetBytes) {
+			break;
+		}
+		auto model = m_models.find(key);
+		resident -= model->second.gpuBytes;
+		// Destroying the prototype frees the model's buffers, textures and arena space.
+		m_models.erase(model);
+		m_loadOrder.erase(std::find(m_loadOrder.begin(), m_loadOrder.end(), key));
+		unloaded++;
+	}
+	m_unloadCount += unloaded;
+	return unloaded;
+}
+
+void ModelRegistry::preload(const std::vector<std::string>& paths, bool flipUVCoords, ThreadPool& pool) {
+	auto start = std::chrono::steady_clock::now();
+	auto importFlags = assimpImportFlags(flipUVCoords);
+
+	std::vector<std::string> pending;
+	std::vector<std::future<PreparedModel>> prepared;
+	for (auto& path : paths) {
+		auto modelKey = key(path, flipUVCoords);
+		if (m_models.count(modelKey) > 0 || std::find(pending.begin(), pending.end(), modelKey) != pending.end()) {
+			continue;
+		}
+		pending.push_back(modelKey);
+		prepared.push_back(pool.submit([path, importFlags, compress = m_compressTextures]() {
+			return prepareModel(path, importFlags, compress);
+		}));
+	}
+
+	// Upload in submission order; later files keep preparing on the workers meanwhile.
+	for (size_t i = 0; i < prepared.size(); i++) {
+		auto model = prepared[i].get();
+		auto path = model.path;
+		auto cacheHit = model.cacheHit;
+		auto prepareTime = model.prepareMilliseconds;
+		auto uploadStart = std::chrono::steady_clock::now();
+		{
+			GpuMemory::OwnerLabel owner(pending[i]);
+			add(pending[i], instantiateModel(std::move(model), m_streamer, m_arena));
+		}
+		std::chrono::duration<double, std::milli> uploadTime = std::chrono::steady_clock::now() - uploadStart;
+		std::cout << (cacheHit ? "[cache hit]  " : "[cache miss] ") << path << ": "
+			<< prepareTime << " ms " << (cacheHit ? "mapped" : "imported")
+			<< " on a worker, " << uploadTime.count() << " ms uploaded" << std::endl;
+	}
+
+	std::chrono::duration<double, std::milli> wallTime = std::chrono::steady_clock::now() - start;
+	std::cout << "Preloaded " << prepared.size() << " models on " << pool.size() << " threads in "
+		<< wallTime.count() << " ms" << std::endl;
+}
+
+size_t ModelRegistry::loadCount() const {
+	return m_models.size();
+}
+
+size_t ModelRegistry::unloadCount() const {
+	return m_unloadCount;
+}
+
+size_t ModelRegistry::residentBytes() const {
+	size_t bytes = 0;
+	for (auto& model : m_models) {
+		bytes += model.second.gpuBytes;
+	}
+	return bytes;
+}
+
+size_t ModelRegistry::instanceCount() const {
+	size_t count = 0;
+	for (auto& model : m_models) {
+		count += model.second.instanceCount;
+	}
+	return count;
+}
+
+size_t ModelRegistry::bytesSaved() const {
+	size_t saved = 0;
+	for (auto& model : m_models) {
+		auto live = liveInstanceCount(model.second.prototype);
+		if (live > 1) {
+			saved += model.second.gpuBytes * (live - 1);
+		}
+	}
+	return saved;
+}
+
+void ModelRegistry::printReport(std::ostream& out) const {
+	out << "Model registry: " << loadCount() << " files loaded for " << instanceCount() << " instances, "
+		<< m_unloadCount << " unloaded" << std::endl;
+	for (auto& key : m_loadOrder) {
+		auto& model = m_models.at(key);
+		out << "  " << key << ": " << model.instanceCount << " instance(s), "
+			<< megabytes(model.gpuBytes) << " MB on the GPU" << std::endl;
+	}
+	out << "  VRAM saved by sharing: " << megabytes(bytesSaved()) << " MB" << std::endl;
+}
+
+size_t ModelRegistry::gpuBytes(const Object3D& object) {
+	std::unordered_set<uint64_t> geometries;
+	std::unordered_set<uint32_t> textures;
+	size_t bytes = 0;
+	collectGpuBytes(object, geometries, textures, bytes);
+	return bytes;
+}
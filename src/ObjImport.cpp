@@ -0,0 +1,683 @@
+#include "ObjImport.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <assimp/postprocess.h>
+
+namespace {
+	// Splitting a file into chunks smaller than this costs more in thread startup than it saves.
+	const size_t MIN_CHUNK_BYTES = 256 * 1024;
+	const uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+	// The most decimal digits that always fit in a 64-bit mantissa.
+	const int MAX_MANTISSA_DIGITS = 19;
+	// Every power of ten up to 1e22 is exact in double precision.
+	const double POWERS_OF_TEN[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+
+	bool isSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	bool isDigit(char c) {
+		return c >= '0' && c <= '9';
+	}
+
+	const char* skipSpaces(const char* p, const char* end) {
+		while (p < end && isSpace(*p)) {
+			p++;
+		}
+		return p;
+	}
+
+	std::string_view trimmed(const char* begin, const char* end) {
+		begin = skipSpaces(begin, end);
+		while (end > begin && isSpace(end[-1])) {
+			end--;
+		}
+		return std::string_view(begin, end - begin);
+	}
+
+	// Whether all eight bytes of a little-endian word are ASCII digits.
+	bool isEightDigits(uint64_t word) {
+		return (((word & 0xf0f0f0f0f0f0f0f0) | (((word + 0x0606060606060606) & 0xf0f0f0f0f0f0f0f0) >> 4))
+			== 0x3333333333333333);
+	}
+
+	// Converts eight ASCII digits in a little-endian word to their value, pairing up digits
+	// with multiplies instead of handling them one by one.
+	uint32_t parseEightDigits(uint64_t word) {
+		word -= 0x3030303030303030;
+		word = word * 10 + (word >> 8);
+		word = (((word & 0x000000ff000000ff) * (100 + (1000000ull << 32)))
+			+ (((word >> 16) & 0x000000ff000000ff) * (1 + (10000ull << 32)))) >> 32;
+		return static_cast<uint32_t>(word);
+	}
+
+	/**
+	 * @brief Appends a run of digits to a mantissa. Returns the end of the run. Sets overflow if
+	 * the mantissa would need more than MAX_MANTISSA_DIGITS digits.
+	 */
+	const char* parseDigits(const char* p, const char* end, uint64_t& mantissa, int& digits, bool& overflow) {
+		if constexpr (std::endian::native == std::endian::little) {
+			while (end - p >= 8 && digits + 8 <= MAX_MANTISSA_DIGITS) {
+				uint64_t word;
+				std::memcpy(&word, p, sizeof(word));
+				if (!isEightDigits(word)) {
+					break;
+				}
+				mantissa = mantissa * 100000000 + parseEightDigits(word);
+				digits += 8;
+				p += 8;
+			}
+		}
+		for (; p < end && isDigit(*p); p++) {
+			if (digits < MAX_MANTISSA_DIGITS) {
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				digits++;
+			}
+			else {
+				overflow = true;
+			}
+		}
+		return p;
+	}
+
+	/**
+	 * @brief Parses a signed decimal integer. Returns a pointer just past it, or begin if there is none.
+	 */
+	const char* parseInt(const char* begin, const char* end, int64_t& value) {
+		auto p = begin;
+		bool negative = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+')) {
+			p++;
+		}
+		if (p == end || !isDigit(*p)) {
+			return begin;
+		}
+		int64_t result = 0;
+		for (; p < end && isDigit(*p); p++) {
+			result = result * 10 + (*p - '0');
+		}
+		value = negative ? -result : result;
+		return p;
+	}
+
+	struct Corner {
+		uint32_t position;
+		uint32_t texCoord;
+		uint32_t normal;
+	};
+
+	// The material that applies to the corners from firstCorner on, until the next run.
+	struct MaterialRun {
+		size_t firstCorner;
+		std::string_view name;
+	};
+
+	/**
+	 * @brief What was parsed from one contiguous range of lines. Names point into the mapped file.
+	 */
+	struct ObjChunk {
+		const char* begin;
+		const char* end;
+		// How many of each attribute come before this chunk, to resolve relative indices.
+		size_t positionBase = 0;
+		size_t texCoordBase = 0;
+		size_t normalBase = 0;
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> texCoords;
+		std::vector<glm::vec3> normals;
+		// Three per triangle, as global attribute indices.
+		std::vector<Corner> corners;
+		std::vector<MaterialRun> materials;
+		std::vector<std::string_view> libraries;
+		// The corners of the face being parsed, before triangulation.
+		std::vector<Corner> polygon;
+		std::exception_ptr error;
+	};
+
+	// Keyword checks compare the whole keyword and require whitespace after it.
+	bool startsWith(const char* p, const char* end, std::string_view keyword) {
+		return static_cast<size_t>(end - p) > keyword.size() && std::memcmp(p, keyword.data(), keyword.size()) == 0
+			&& isSpace(p[keyword.size()]);
+	}
+
+	const char* parseFloats(const char* p, const char* end, float* values, int count) {
+		for (int i = 0; i < count; i++) {
+			p = skipSpaces(p, end);
+			auto next = parseObjFloat(p, end, values[i]);
+			if (next == p) {
+				values[i] = 0;
+			}
+			p = next;
+		}
+		return p;
+	}
+
+	/**
+	 * @brief Resolves a 1-based OBJ index, or a negative one counting back from the latest attribute.
+	 */
+	uint32_t resolveIndex(int64_t index, size_t base, size_t localCount) {
+		if (index > 0) {
+			return static_cast<uint32_t>(index - 1);
+		}
+		auto resolved = static_cast<int64_t>(base + localCount) + index;
+		if (index == 0 || resolved < 0) {
+			throw std::runtime_error("Error loading OBJ file: invalid face index " + std::to_string(index));
+		}
+		return static_cast<uint32_t>(resolved);
+	}
+
+	void parseFace(const char* p, const char* end, ObjChunk& chunk) {
+		chunk.polygon.clear();
+		while (true) {
+			p = skipSpaces(p, end);
+			int64_t index;
+			auto next = parseInt(p, end, index);
+			if (next == p) {
+				break;
+			}
+			Corner corner{ resolveIndex(index, chunk.positionBase, chunk.positions.size()), NO_INDEX, NO_INDEX };
+			p = next;
+			if (p < end && *p == '/') {
+				p++;
+				next = parseInt(p, end, index);
+				if (next != p) {
+					corner.texCoord = resolveIndex(index, chunk.texCoordBase, chunk.texCoords.size());
+					p = next;
+				}
+				if (p < end && *p == '/') {
+					p++;
+					next = parseInt(p, end, index);
+					if (next != p) {
+						corner.normal = resolveIndex(index, chunk.normalBase, chunk.normals.size());
+						p = next;
+					}
+				}
+			}
+			chunk.polygon.push_back(corner);
+		}
+		// Fan-triangulate, which is exact for the convex polygons exporters write.
+		for (size_t i = 2; i < chunk.polygon.size(); i++) {
+			chunk.corners.push_back(chunk.polygon[0]);
+			chunk.corners.push_back(chunk.polygon[i - 1]);
+			chunk.corners.push_back(chunk.polygon[i]);
+		}
+	}
+
+	template <typename F>
+	void forEachLine(const char* begin, const char* end, const F& body) {
+		for (auto line = begin; line < end; ) {
+			auto lineEnd = static_cast<const char*>(std::memchr(line, '\n', end - line));
+			if (lineEnd == nullptr) {
+				lineEnd = end;
+			}
+			auto p = skipSpaces(line, lineEnd);
+			if (p < lineEnd) {
+				body(p, lineEnd);
+			}
+			line = lineEnd + 1;
+		}
+	}
+
+	void parseChunk(ObjChunk& chunk) {
+		forEachLine(chunk.begin, chunk.end, [&chunk](const char* p, const char* end) {
+			if (p[0] == 'v') {
+				float values[3];
+				if (startsWith(p, end, "v")) {
+					parseFloats(p + 1, end, values, 3);
+					chunk.positions.emplace_back(values[0], values[1], values[2]);
+				}
+				else if (startsWith(p, end, "vt")) {
+					parseFloats(p + 2, end, values, 2);
+					chunk.texCoords.emplace_back(values[0], values[1]);
+				}
+				else if (startsWith(p, end, "vn")) {
+					parseFloats(p + 2, end, values, 3);
+					chunk.normals.emplace_back(values[0], values[1], values[2]);
+				}
+			}
+			else if (startsWith(p, end, "f")) {
+				parseFace(p + 1, end, chunk);
+			}
+			else if (startsWith(p, end, "usemtl")) {
+				chunk.materials.push_back({ chunk.corners.size(), trimmed(p + 6, end) });
+			}
+			else if (startsWith(p, end, "mtllib")) {
+				chunk.libraries.push_back(trimmed(p + 6, end));
+			}
+		});
+	}
+
+	/**
+	 * @brief Counts the attributes in a chunk, so chunks after it know their bases before
+	 * they are parsed.
+	 */
+	void countAttributes(ObjChunk& chunk, size_t& positions, size_t& texCoords, size_t& normals) {
+		forEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end) {
+			if (p[0] == 'v') {
+				positions += startsWith(p, end, "v") ? 1 : 0;
+				texCoords += startsWith(p, end, "vt") ? 1 : 0;
+				normals += startsWith(p, end, "vn") ? 1 : 0;
+			}
+		});
+	}
+
+	template <typename F>
+	void runChunks(std::vector<ObjChunk>& chunks, const F& body) {
+		auto guarded = [&body](ObjChunk& chunk) {
+			try {
+				body(chunk);
+			}
+			catch (...) {
+				chunk.error = std::current_exception();
+			}
+		};
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < chunks.size(); i++) {
+			workers.emplace_back(guarded, std::ref(chunks[i]));
+		}
+		guarded(chunks[0]);
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		for (auto& chunk : chunks) {
+			if (chunk.error) {
+				std::rethrow_exception(chunk.error);
+			}
+		}
+	}
+
+	struct ObjMaterial {
+		std::string name;
+		// Texture file names by the sampler they bind to, in the order Assimp imports report them.
+		std::vector<std::pair<std::string, std::string>> textures;
+	};
+
+	/**
+	 * @brief The file name of a texture map statement, after any options such as "-bm 0.5".
+	 */
+	std::string_view textureFileName(std::string_view rest) {
+		static const std::unordered_map<std::string_view, int> optionArguments = {
+			{ "-blendu", 1 }, { "-blendv", 1 }, { "-boost", 1 }, { "-mm", 2 }, { "-o", 3 }, { "-s", 3 },
+			{ "-t", 3 }, { "-texres", 1 }, { "-clamp", 1 }, { "-bm", 1 }, { "-imfchan", 1 }, { "-type", 1 },
+		};
+		auto nextToken = [&rest]() {
+			auto start = rest.find_first_not_of(" \t");
+			rest.remove_prefix(std::min(start, rest.size()));
+			auto length = std::min(rest.find_first_of(" \t"), rest.size());
+			auto token = rest.substr(0, length);
+			rest.remove_prefix(length);
+			return token;
+		};
+		while (true) {
+			auto start = rest.find_first_not_of(" \t");
+			if (start == std::string_view::npos || rest[start] != '-') {
+				break;
+			}
+			auto option = optionArguments.find(nextToken());
+			// Options that take several numbers may leave out all but the first.
+			int arguments = option != optionArguments.end() ? option->second : 0;
+			for (int i = 0; i < arguments; i++) {
+				auto save = rest;
+				auto token = nextToken();
+				float number;
+				bool isNumber = !token.empty()
+					&& parseObjFloat(token.data(), token.data() + token.size(), number) != token.data();
+				if (i > 0 && !isNumber) {
+					rest = save;
+					break;
+				}
+			}
+		}
+		return trimmed(rest.data(), rest.data() + rest.size());
+	}
+
+	void parseMaterialLibrary(const std::filesystem::path& path, std::vector<ObjMaterial>& materials) {
+		MappedFile file;
+		if (!file.open(path.string())) {
+			// Like Assimp, carry on without the materials of a missing library.
+			return;
+		}
+		auto begin = reinterpret_cast<const char*>(file.data());
+		forEachLine(begin, begin + file.size(), [&materials](const char* p, const char* end) {
+			if (startsWith(p, end, "newmtl")) {
+				materials.push_back({ std::string(trimmed(p + 6, end)), {} });
+				return;
+			}
+			if (materials.empty()) {
+				return;
+			}
+			static const std::pair<std::string_view, const char*> maps[] = {
+				{ "map_Kd", "baseTexture" }, { "map_Ks", "specMap" },
+				{ "map_Bump", "normalMap" }, { "map_bump", "normalMap" }, { "bump", "normalMap" },
+				{ "norm", "normalMap" },
+			};
+			for (auto& [keyword, samplerName] : maps) {
+				if (startsWith(p, end, keyword)) {
+					auto fileName = textureFileName(std::string_view(p + keyword.size(), end - p - keyword.size()));
+					if (!fileName.empty()) {
+						materials.back().textures.emplace_back(std::string(fileName), samplerName);
+					}
+					return;
+				}
+			}
+		});
+	}
+
+	/**
+	 * @brief Merges vertices with identical contents, using an open-addressed hash table.
+	 */
+	class VertexWelder {
+	private:
+		std::vector<Vertex3D>& m_vertices;
+		std::vector<uint32_t> m_slots;
+
+		void grow() {
+			std::vector<uint32_t> slots(std::max<size_t>(m_slots.size() * 2, 1024), NO_INDEX);
+			auto mask = slots.size() - 1;
+			for (uint32_t i = 0; i < m_vertices.size(); i++) {
+				auto slot = hashBytes(&m_vertices[i], sizeof(Vertex3D)) & mask;
+				while (slots[slot] != NO_INDEX) {
+					slot = (slot + 1) & mask;
+				}
+				slots[slot] = i;
+			}
+			m_slots = std::move(slots);
+		}
+
+	public:
+		VertexWelder(std::vector<Vertex3D>& vertices, size_t expected)
+			: m_vertices(vertices), m_slots(std::bit_ceil(std::max<size_t>(expected * 2, 1024)), NO_INDEX) {
+		}
+
+		uint32_t add(const Vertex3D& vertex) {
+			if ((m_vertices.size() + 1) * 2 > m_slots.size()) {
+				grow();
+			}
+			auto mask = m_slots.size() - 1;
+			auto slot = hashBytes(&vertex, sizeof(Vertex3D)) & mask;
+			while (m_slots[slot] != NO_INDEX) {
+				if (std::memcmp(&m_vertices[m_slots[slot]], &vertex, sizeof(Vertex3D)) == 0) {
+					return m_slots[slot];
+				}
+				slot = (slot + 1) & mask;
+			}
+			m_slots[slot] = static_cast<uint32_t>(m_vertices.size());
+			m_vertices.push_back(vertex);
+			return m_slots[slot];
+		}
+	};
+
+	template <typename T>
+	std::vector<T> concatenate(std::vector<ObjChunk>& chunks, std::vector<T> ObjChunk::* member) {
+		if (chunks.size() == 1) {
+			return std::move(chunks[0].*member);
+		}
+		size_t total = 0;
+		for (auto& chunk : chunks) {
+			total += (chunk.*member).size();
+		}
+		std::vector<T> result;
+		result.reserve(total);
+		for (auto& chunk : chunks) {
+			result.insert(result.end(), (chunk.*member).begin(), (chunk.*member).end());
+		}
+		return result;
+	}
+}
+
+const char* parseObjFloat(const char* begin, const char* end, float& value) {
+	auto p = begin;
+	bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) {
+		p++;
+	}
+	uint64_t mantissa = 0;
+	int digits = 0;
+	bool overflow = false;
+	// Leading zeros carry no information, and would only use up mantissa digits.
+	while (p < end && *p == '0') {
+		p++;
+	}
+	auto integerStart = p;
+	p = parseDigits(p, end, mantissa, digits, overflow);
+	bool any = p > begin + (negative || (begin < end && *begin == '+') ? 1 : 0);
+	int exponent = static_cast<int>(p - integerStart) - digits;
+	if (p < end && *p == '.') {
+		p++;
+		auto fractionStart = p;
+		if (digits == 0) {
+			while (p < end && *p == '0') {
+				p++;
+			}
+		}
+		auto digitsBefore = digits;
+		auto fractionDigitsStart = p;
+		p = parseDigits(p, end, mantissa, digits, overflow);
+		any = any || p > fractionStart;
+		exponent -= static_cast<int>(fractionDigitsStart - fractionStart) + (digits - digitsBefore);
+	}
+	if (!any) {
+		return begin;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int64_t exponentValue;
+		auto next = parseInt(p + 1, end, exponentValue);
+		if (next != p + 1) {
+			exponent += static_cast<int>(std::clamp<int64_t>(exponentValue, -100000, 100000));
+			p = next;
+		}
+	}
+
+	if (mantissa == 0 && !overflow) {
+		value = negative ? -0.0f : 0.0f;
+		return p;
+	}
+	// With a mantissa below 2^53 and an exact power of ten, the double result is correctly
+	// rounded (Clinger's fast path). Anything else goes through the standard library.
+	if (!overflow && mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+		double result = static_cast<double>(mantissa);
+		result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+		value = static_cast<float>(negative ? -result : result);
+		return p;
+	}
+	auto start = begin < end && *begin == '+' ? begin + 1 : begin;
+	auto [next, error] = std::from_chars(start, p, value);
+	if (error == std::errc::result_out_of_range) {
+		value = exponent < 0 ? 0.0f : std::numeric_limits<float>::infinity();
+		value = negative ? -value : value;
+	}
+	return p;
+}
+
+ModelData objConvert(const std::string& path, uint32_t importFlags, size_t threadCount) {
+	MappedFile file;
+	if (!file.open(path)) {
+		throw std::runtime_error("Error loading OBJ file: cannot open " + path);
+	}
+	auto begin = reinterpret_cast<const char*>(file.data());
+	auto end = begin + file.size();
+
+	// Split the file into chunks of whole lines, one per thread.
+	auto chunkCount = std::clamp<size_t>(file.size() / MIN_CHUNK_BYTES, 1, std::max<size_t>(threadCount, 1));
+	std::vector<ObjChunk> chunks(chunkCount);
+	auto chunkBegin = begin;
+	for (size_t i = 0; i < chunkCount; i++) {
+		auto chunkEnd = i + 1 < chunkCount ? begin + file.size() * (i + 1) / chunkCount : end;
+		if (chunkEnd < chunkBegin) {
+			chunkEnd = chunkBegin;
+		}
+		auto newline = static_cast<const char*>(std::memchr(chunkEnd, '\n', end - chunkEnd));
+		chunkEnd = i + 1 < chunkCount && newline != nullptr ? newline + 1 : end;
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+	if (chunkCount > 1) {
+		// Negative face indices count back from the attributes parsed so far, so each chunk
+		// needs to know how many come before it.
+		std::vector<size_t> counts(chunkCount * 3, 0);
+		runChunks(chunks, [&](ObjChunk& chunk) {
+			auto i = static_cast<size_t>(&chunk - chunks.data());
+			countAttributes(chunk, counts[i * 3], counts[i * 3 + 1], counts[i * 3 + 2]);
+		});
+		for (size_t i = 1; i < chunkCount; i++) {
+			chunks[i].positionBase = chunks[i - 1].positionBase + counts[(i - 1) * 3];
+			chunks[i].texCoordBase = chunks[i - 1].texCoordBase + counts[(i - 1) * 3 + 1];
+			chunks[i].normalBase = chunks[i - 1].normalBase + counts[(i - 1) * 3 + 2];
+		}
+	}
+	for (auto& chunk : chunks) {
+		// Assume about one attribute line every 40 bytes, to avoid most reallocation.
+		auto lines = static_cast<size_t>(chunk.end - chunk.begin) / 40;
+		chunk.positions.reserve(lines / 3);
+		chunk.texCoords.reserve(lines / 3);
+		chunk.normals.reserve(lines / 3);
+		chunk.corners.reserve(lines);
+	}
+	runChunks(chunks, parseChunk);
+
+	// Materials, in the order of their libraries.
+	std::filesystem::path modelPath(path);
+	std::vector<ObjMaterial> materials;
+	std::vector<std::string> libraryPaths;
+	for (auto& chunk : chunks) {
+		for (auto library : chunk.libraries) {
+			std::string fixName(library);
+			std::replace(fixName.begin(), fixName.end(), '\\', '/');
+			auto libraryPath = modelPath.parent_path() / fixName;
+			parseMaterialLibrary(libraryPath, materials);
+			libraryPaths.push_back(libraryPath.string());
+		}
+	}
+
+	auto positions = concatenate(chunks, &ObjChunk::positions);
+	auto texCoords = concatenate(chunks, &ObjChunk::texCoords);
+	auto normals = concatenate(chunks, &ObjChunk::normals);
+	bool flipTextureCoords = (importFlags & aiProcess_FlipUVs) != 0;
+
+	// Group the triangles by material, in the order materials are first used. Group 0 holds
+	// any triangles before the first usemtl.
+	std::vector<std::string_view> groupNames = { {} };
+	std::vector<std::vector<Corner>> groups(1);
+	size_t group = 0;
+	size_t cornerCount = 0;
+	for (auto& chunk : chunks) {
+		size_t run = 0;
+		for (size_t i = 0; i < chunk.corners.size(); i++) {
+			while (run < chunk.materials.size() && chunk.materials[run].firstCorner <= i) {
+				auto name = chunk.materials[run++].name;
+				group = std::find(groupNames.begin(), groupNames.end(), name) - groupNames.begin();
+				if (group == groupNames.size()) {
+					groupNames.push_back(name);
+					groups.emplace_back();
+				}
+			}
+			auto& corner = chunk.corners[i];
+			if (corner.position >= positions.size()
+				|| (corner.texCoord != NO_INDEX && corner.texCoord >= texCoords.size())
+				|| (corner.normal != NO_INDEX && corner.normal >= normals.size())) {
+				throw std::runtime_error("Error loading OBJ file: face index out of range in " + path);
+			}
+			groups[group].push_back(corner);
+		}
+		// Any material switch after the chunk's last face still applies to the next chunk.
+		for (; run < chunk.materials.size(); run++) {
+			auto name = chunk.materials[run].name;
+			group = std::find(groupNames.begin(), groupNames.end(), name) - groupNames.begin();
+			if (group == groupNames.size()) {
+				groupNames.push_back(name);
+				groups.emplace_back();
+			}
+		}
+		cornerCount += chunk.corners.size();
+	}
+	if (cornerCount == 0) {
+		throw std::runtime_error("Error loading OBJ file: no faces in " + path);
+	}
+
+	// Faces without normals get smooth ones: the area-weighted average of the faces around
+	// each position.
+	std::vector<glm::vec3> smoothNormals;
+	for (auto& corners : groups) {
+		for (size_t i = 0; i + 2 < corners.size(); i += 3) {
+			if (corners[i].normal != NO_INDEX && corners[i + 1].normal != NO_INDEX && corners[i + 2].normal != NO_INDEX) {
+				continue;
+			}
+			if (smoothNormals.empty()) {
+				smoothNormals.assign(positions.size(), glm::vec3(0));
+			}
+			auto& p0 = positions[corners[i].position];
+			auto faceNormal = glm::cross(positions[corners[i + 1].position] - p0, positions[corners[i + 2].position] - p0);
+			for (int corner = 0; corner < 3; corner++) {
+				smoothNormals[corners[i + corner].position] += faceNormal;
+			}
+		}
+	}
+	for (auto& normal : smoothNormals) {
+		auto length = glm::length(normal);
+		normal = length > 0 ? normal / length : glm::vec3(0, 1, 0);
+	}
+
+	ModelData model;
+	model.dependencies = std::move(libraryPaths);
+	std::unordered_map<std::filesystem::path, uint32_t> loadedTextures;
+	NodeData root;
+	root.name = modelPath.filename().string();
+	root.transform = glm::mat4(1);
+	for (size_t g = 0; g < groups.size(); g++) {
+		auto& corners = groups[g];
+		if (corners.empty()) {
+			continue;
+		}
+		MeshData mesh;
+		mesh.indices.reserve(corners.size());
+		VertexWelder welder(mesh.vertices, corners.size() / 2);
+		for (auto& corner : corners) {
+			auto& position = positions[corner.position];
+			auto normal = corner.normal != NO_INDEX ? normals[corner.normal] : smoothNormals[corner.position];
+			auto texCoord = corner.texCoord != NO_INDEX ? texCoords[corner.texCoord] : glm::vec2(0);
+			if (flipTextureCoords) {
+				texCoord.y = 1 - texCoord.y;
+			}
+			mesh.indices.push_back(welder.add(Vertex3D(position.x, position.y, position.z,
+				normal.x, normal.y, normal.z, texCoord.x, texCoord.y)));
+		}
+
+		auto material = std::find_if(materials.begin(), materials.end(), [&](const ObjMaterial& m) {
+			return m.name == groupNames[g];
+		});
+		if (material != materials.end()) {
+			for (auto& [fileName, samplerName] : material->textures) {
+				std::string fixName = fileName;
+				std::replace(fixName.begin(), fixName.end(), '\\', '/');
+				auto texPath = modelPath.parent_path() / fixName;
+				auto existing = loadedTextures.find(texPath);
+				if (existing == loadedTextures.end()) {
+					existing = loadedTextures.emplace(texPath, static_cast<uint32_t>(model.images.size())).first;
+					model.images.push_back(texPath.string());
+				}
+				mesh.textures.push_back({ existing->second, samplerName });
+			}
+		}
+		root.meshes.push_back(static_cast<uint32_t>(model.meshes.size()));
+		model.meshes.push_back(std::move(mesh));
+	}
+	root.firstChild = 1;
+	root.childCount = 0;
+	model.nodes.push_back(std::move(root));
+	return model;
+}
@@ -1,17 +1,16 @@
 #include "Object3D.h"
 #include "ShaderProgram.h"
+#include "RenderQueue.h"
 #include <glm/ext.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
-glm::mat4 Object3D::buildModelMatrix() const {
-	auto m = glm::translate(glm::mat4(1), m_position);
-	m = glm::translate(m, m_center * m_scale);
-	m = glm::rotate(m, m_orientation[2], glm::vec3(0, 0, 1));
-	m = glm::rotate(m, m_orientation[0], glm::vec3(1, 0, 0));
-	m = glm::rotate(m, m_orientation[1], glm::vec3(0, 1, 0));
-	m = glm::scale(m, m_scale);
-	m = glm::translate(m, -m_center);
-	m = m * m_baseTransform;
-	return m;
+namespace {
+	// Meshes closer than this are treated as this far away.
+	const float LOD_MIN_DISTANCE = 1e-3f;
+	constexpr UniformName MODEL_UNIFORM("model");
+	constexpr UniformName NORMAL_MATRIX_UNIFORM("normalMatrix");
 }
 
 Object3D::Object3D(std::vector<Mesh3D>&& meshes)
@@ -19,28 +18,108 @@ Object3D::Object3D(std::vector<Mesh3D>&& meshes)
 }
 
 Object3D::Object3D(std::vector<Mesh3D>&& meshes, const glm::mat4& baseTransform)
-	: m_meshes(meshes), m_position(), m_orientation(), m_scale(1.0),
-	m_center(), m_baseTransform(baseTransform), m_material(0.1, 1.0, 0.3, 4)
+	: Object3D(std::move(meshes), baseTransform, TransformHierarchy::shared()) {
+}
+
+Object3D::Object3D(std::vector<Mesh3D>&& meshes, const glm::mat4& baseTransform, TransformHierarchy& transforms)
+	: m_meshes(std::move(meshes)), m_transforms(&transforms), m_node(transforms.create(baseTransform)), m_boundsVersion(0),
+	m_material(0.1, 1.0, 0.3, 4),
+	m_worldBounds{ glm::vec3(0), glm::vec3(0) }, m_subtreeMeshCount(0), m_hasWorldBounds(false)
+{
+}
+
+/**
+ * @brief The copy's node is created before its children's, so the hierarchy stays sorted.
+ */
+Object3D::Object3D(const Object3D& other)
+	: m_meshes(other.m_meshes), m_transforms(other.m_transforms), m_node(m_transforms->clone(other.m_node)),
+	m_boundsVersion(other.m_boundsVersion), m_material(other.m_material), m_name(other.m_name),
+	m_selectedLods(other.m_selectedLods), m_meshSpheres(other.m_meshSpheres), m_meshBounds(other.m_meshBounds),
+	m_childBounds(other.m_childBounds), m_worldBounds(other.m_worldBounds),
+	m_subtreeMeshCount(other.m_subtreeMeshCount), m_hasWorldBounds(other.m_hasWorldBounds)
+{
+	m_children.reserve(other.m_children.size());
+	for (auto& child : other.m_children) {
+		m_children.push_back(child);
+		m_transforms->setParent(m_children.back().m_node, m_node);
+	}
+}
+
+Object3D::Object3D(Object3D&& other) noexcept
+	: m_meshes(std::move(other.m_meshes)), m_children(std::move(other.m_children)),
+	m_transforms(other.m_transforms), m_node(other.m_node), m_boundsVersion(other.m_boundsVersion),
+	m_material(other.m_material), m_name(std::move(other.m_name)), m_selectedLods(std::move(other.m_selectedLods)),
+	m_meshSpheres(std::move(other.m_meshSpheres)), m_meshBounds(std::move(other.m_meshBounds)),
+	m_childBounds(std::move(other.m_childBounds)), m_worldBounds(other.m_worldBounds),
+	m_subtreeMeshCount(other.m_subtreeMeshCount), m_hasWorldBounds(other.m_hasWorldBounds)
 {
+	other.m_node = TransformHierarchy::NO_NODE;
+}
+
+Object3D& Object3D::operator=(const Object3D& other) {
+	if (this != &other) {
+		*this = Object3D(other);
+	}
+	return *this;
+}
+
+/**
+ * @brief Takes over the other object's node, and gives it this object's parent, as happens to
+ * the children after one that is erased.
+ */
+Object3D& Object3D::operator=(Object3D&& other) noexcept {
+	if (this == &other) {
+		return *this;
+	}
+	auto parent = TransformHierarchy::NO_NODE;
+	if (m_node != TransformHierarchy::NO_NODE) {
+		parent = m_transforms->getParent(m_node);
+		m_transforms->release(m_node);
+	}
+	m_meshes = std::move(other.m_meshes);
+	m_children = std::move(other.m_children);
+	m_transforms = other.m_transforms;
+	m_node = other.m_node;
+	other.m_node = TransformHierarchy::NO_NODE;
+	if (m_node != TransformHierarchy::NO_NODE && m_transforms->getParent(m_node) != parent) {
+		m_transforms->setParent(m_node, parent);
+	}
+	m_boundsVersion = other.m_boundsVersion;
+	m_material = other.m_material;
+	m_name = std::move(other.m_name);
+	m_selectedLods = std::move(other.m_selectedLods);
+	m_meshSpheres = std::move(other.m_meshSpheres);
+	m_meshBounds = std::move(other.m_meshBounds);
+	m_childBounds = std::move(other.m_childBounds);
+	m_worldBounds = other.m_worldBounds;
+	m_subtreeMeshCount = other.m_subtreeMeshCount;
+	m_hasWorldBounds = other.m_hasWorldBounds;
+	return *this;
+}
+
+Object3D::~Object3D() {
+	if (m_node != TransformHierarchy::NO_NODE) {
+		m_transforms->release(m_node);
+	}
 }
 
 const glm::vec3& Object3D::getPosition() const {
-	return m_position;
+	return m_transforms->getPosition(m_node);
 }
 
 const glm::vec3& Object3D::getOrientation() const {
-	return m_orientation;
+	return m_transforms->getOrientation(m_node);
 }
 
 const glm::vec3& Object3D::getScale() const {
-	return m_scale;
+	return m_transforms->getScale(m_node);
 }
 
 /**
  * @brief Gets the center of the object's rotation.
  */
 const glm::vec3& Object3D::getCenter() const {
-	return m_center;
+	return m_transforms->getCenter(m_node);
 }
 
 const std::string& Object3D::getName() const {
@@ -51,6 +130,10 @@ const glm::vec4& Object3D::getMaterial() const {
 	return m_material;
 }
 
+const std::vector<Mesh3D>& Object3D::getMeshes() const {
+	return m_meshes;
+}
+
 size_t Object3D::numberOfChildren() const {
 	return m_children.size();
 }
@@ -64,15 +147,15 @@ Object3D& Object3D::getChild(size_t index) {
 }
 
 void Object3D::setPosition(const glm::vec3& position) {
-	m_position = position;
+	m_transforms->setPosition(m_node, position);
 }
 
 void Object3D::setOrientation(const glm::vec3& orientation) {
-	m_orientation = orientation;
+	m_transforms->setOrientation(m_node, orientation);
 }
 
 void Object3D::setScale(const glm::vec3& scale) {
-	m_scale = scale;
+	m_transforms->setScale(m_node, scale);
 }
 
 /**
@@ -81,7 +164,7 @@ void Object3D::setScale(const glm::vec3& scale) {
  */
 void Object3D::setCenter(const glm::vec3& center)
 {
-	m_center = center;
+	m_transforms->setCenter(m_node, center);
 }
 
 void Object3D::setName(const std::string& name) {
@@ -93,39 +176,284 @@ void Object3D::setMaterial(const glm::vec4& material) {
 }
 
 void Object3D::move(const glm::vec3& offset) {
-	m_position = m_position + offset;
+	setPosition(getPosition() + offset);
 }
 
 void Object3D::rotate(const glm::vec3& rotation) {
-	m_orientation = m_orientation + rotation;
+	setOrientation(getOrientation() + rotation);
 }
 
 void Object3D::grow(const glm::vec3& growth) {
-	m_scale = m_scale * growth;
+	setScale(getScale() * growth);
 }
 
 void Object3D::addChild(Object3D&& child) {
-	m_children.emplace_back(child);
+	if (child.m_transforms != m_transforms) {
+		throw std::runtime_error("Object3D::addChild: the child's transforms are in a different hierarchy");
+	}
+	m_children.push_back(std::move(child));
+	m_transforms->setParent(m_children.back().m_node, m_node);
 }
 
-void Object3D::render(ShaderProgram& shaderProgram) const {
-	renderRecursive(shaderProgram, glm::mat4(1));
+void Object3D::updateWorld() {
+	m_transforms->update();
+	updateBounds();
+}
+
+const glm::mat4& Object3D::getWorldMatrix() const {
+	return m_transforms->getWorldMatrix(m_node);
+}
+
+const glm::mat3& Object3D::getNormalMatrix() const {
+	return m_transforms->getNormalMatrix(m_node);
+}
+
+const BoundingBox& Object3D::getWorldBounds() const {
+	return m_worldBounds;
+}
+
+TransformHierarchy& Object3D::getTransforms() const {
+	return *m_transforms;
+}
+
+TransformHierarchy::NodeId Object3D::getNode() const {
+	return m_node;
 }
 
 /**
- * @brief Renders the object and its children, recursively.
- * @param parentMatrix the model matrix of this object's parent in the model hierarchy.
+ * @brief Refreshes the world bounds of the object and its descendants, bottom up, where their
+ * world matrices changed in the hierarchy's last update or their children changed.
+ * @return whether anything in the subtree moved, so the parent's bounds must be recomputed.
  */
-void Object3D::renderRecursive(ShaderProgram& shaderProgram, const glm::mat4& parentMatrix) const {
-	// This object's true model matrix is the combination of its parent's matrix and the object's matrix.
-	glm::mat4 trueModel = parentMatrix * buildModelMatrix();
-	shaderProgram.setUniform("model", trueModel);
-	// Render each mesh in the object.
-	for (auto& mesh : m_meshes) {
-		mesh.render(shaderProgram);
-	}
-	// Render the children of the object.
+bool Object3D::updateBounds() {
+	auto version = m_transforms->getWorldVersion(m_node);
+	bool transformChanged = version != m_boundsVersion;
+	m_boundsVersion = version;
+	bool childrenChanged = m_childBounds.size() != m_children.size();
 	for (auto& child : m_children) {
-		child.renderRecursive(shaderProgram, trueModel);
+		childrenChanged |= child.updateBounds();
+	}
+	if (transformChanged || childrenChanged || !m_hasWorldBounds) {
+		updateBounds(transformChanged || !m_hasWorldBounds, childrenChanged || !m_hasWorldBounds);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Recomputes the world bounds of the object's meshes if it moved, and the box around its
+ * subtree from them and its children's boxes.
+ */
+void Object3D::updateBounds(bool transformChanged, bool childrenChanged) {
+	auto& world = getWorldMatrix();
+	if (transformChanged) {
+		glm::mat3 linear(world);
+		float scale = std::max({ glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2]) });
+		m_meshSpheres.resize(m_meshes.size());
+		m_meshBounds.resize(m_meshes.size());
+		for (size_t i = 0; i < m_meshes.size(); i++) {
+			auto& mesh = m_meshes[i];
+			auto sphere = mesh.getBoundingSphere();
+			auto center = glm::vec3(world * glm::vec4(glm::vec3(sphere), 1));
+			m_meshSpheres[i] = glm::vec4(center, sphere.w * scale);
+			// The box around the transformed bounding box.
+			auto halfExtent = (mesh.getBoundsMax() - mesh.getBoundsMin()) * 0.5f;
+			auto worldHalfExtent = glm::abs(linear[0]) * halfExtent.x + glm::abs(linear[1]) * halfExtent.y
+				+ glm::abs(linear[2]) * halfExtent.z;
+			m_meshBounds[i] = BoundingBox{ center - worldHalfExtent, center + worldHalfExtent };
+		}
+	}
+	if (childrenChanged) {
+		m_subtreeMeshCount = m_meshes.size();
+		m_childBounds.resize(m_children.size());
+		for (size_t i = 0; i < m_children.size(); i++) {
+			m_childBounds[i] = m_children[i].m_worldBounds;
+			m_subtreeMeshCount += m_children[i].m_subtreeMeshCount;
+		}
+	}
+
+	bool empty = true;
+	auto include = [&](const BoundingBox& box) {
+		m_worldBounds.min = empty ? box.min : glm::min(m_worldBounds.min, box.min);
+		m_worldBounds.max = empty ? box.max : glm::max(m_worldBounds.max, box.max);
+		empty = false;
+	};
+	for (auto& box : m_meshBounds) {
+		include(box);
+	}
+	for (size_t i = 0; i < m_children.size(); i++) {
+		if (m_children[i].m_subtreeMeshCount > 0) {
+			include(m_childBounds[i]);
+		}
+	}
+	if (empty) {
+		m_worldBounds = BoundingBox{ glm::vec3(world[3]), glm::vec3(world[3]) };
+	}
+	m_hasWorldBounds = true;
+}
+
+/**
+ * @brief Whether the object and all its descendants are outside the pass's frustum, in which
+ * case their meshes are counted as culled.
+ */
+bool Object3D::cullSubtree(RenderContext& context) const {
+	if (context.frustum == nullptr || !m_hasWorldBounds || context.frustum->intersects(m_worldBounds)) {
+		return false;
+	}
+	context.meshesCulled += m_subtreeMeshCount;
+	return true;
+}
+
+/**
+ * @brief Tests the object's meshes and children against the pass's frustum, all meshes at once
+ * and then all children at once, recording which must be drawn or visited in m_meshVisible and
+ * m_childVisible. Culled meshes and the meshes of culled children's subtrees are counted.
+ */
+void Object3D::cullContents(RenderContext& context) const {
+	m_meshVisible.assign(m_meshes.size(), 1);
+	m_childVisible.assign(m_children.size(), 1);
+	if (context.frustum == nullptr || !m_hasWorldBounds) {
+		return;
+	}
+	// Meshes and children added since the bounds were computed have none, and are kept.
+	if (m_meshSpheres.size() == m_meshes.size()) {
+		context.frustum->cullSpheres(m_meshSpheres.data(), m_meshes.size(), m_meshVisible.data());
+		for (auto visible : m_meshVisible) {
+			context.meshesCulled += visible ? 0 : 1;
+		}
+	}
+	if (m_childBounds.size() == m_children.size()) {
+		context.frustum->cullBoxes(m_childBounds.data(), m_children.size(), m_childVisible.data());
+		for (size_t i = 0; i < m_children.size(); i++) {
+			context.meshesCulled += m_childVisible[i] ? 0 : m_children[i].m_subtreeMeshCount;
+		}
+	}
+}
+
+void Object3D::render(ShaderProgram& shaderProgram) const {
+	renderRecursive(shaderProgram, nullptr);
+}
+
+void Object3D::render(ShaderProgram& shaderProgram, RenderContext& context) const {
+	if (!cullSubtree(context)) {
+		renderRecursive(shaderProgram, &context);
+	}
+}
+
+void Object3D::enqueue(ShaderProgram& shaderProgram, RenderContext& context, RenderQueue& queue) const {
+	if (!cullSubtree(context)) {
+		enqueueRecursive(shaderProgram, context, queue);
+	}
+}
+
+/**
+ * @brief Picks the coarsest level of detail whose simplification error projects to at most
+ * LOD_PIXEL_ERROR * lodBias pixels at the distance between the camera and the mesh's world
+ * space bounding box. A level is only given up for a coarser one once that one is comfortably
+ * within the threshold, so meshes don't flicker between levels near a switching distance.
+ */
+size_t Object3D::selectLod(size_t mesh, const glm::mat4& model, const RenderContext& context) const {
+	auto& m = m_meshes[mesh];
+	if (m.lodCount() <= 1) {
+		return 0;
+	}
+	auto slot = static_cast<size_t>(context.pass) * m_meshes.size() + mesh;
+	if (m_selectedLods.size() <= slot) {
+		m_selectedLods.resize(slot + 1, 0);
+	}
+
+	// The world space bounding box of the mesh, and how much the model matrix magnifies it.
+	glm::mat3 linear(model);
+	auto center = glm::vec3(model * glm::vec4((m.getBoundsMin() + m.getBoundsMax()) * 0.5f, 1));
+	auto halfExtent = (m.getBoundsMax() - m.getBoundsMin()) * 0.5f;
+	glm::vec3 worldHalfExtent(0);
+	float scale = 0;
+	for (int column = 0; column < 3; column++) {
+		worldHalfExtent += glm::abs(linear[column]) * halfExtent[column];
+		scale = std::max(scale, glm::length(linear[column]));
+	}
+	auto outside = glm::max(glm::abs(context.cameraPosition - center) - worldHalfExtent, glm::vec3(0));
+	auto distance = std::max(glm::length(outside), LOD_MIN_DISTANCE);
+	auto pixelsPerUnit = context.projectionScale * scale / distance;
+	auto threshold = LOD_PIXEL_ERROR * context.lodBias;
+
+	auto coarsestWithin = [&](float pixels) {
+		size_t lod = 0;
+		while (lod + 1 < m.lodCount() && m.getLod(lod + 1).error * pixelsPerUnit <= pixels) {
+			lod++;
+		}
+		return lod;
+	};
+	size_t current = std::min<size_t>(m_selectedLods[slot], m.lodCount() - 1);
+	size_t lod;
+	if (m.getLod(current).error * pixelsPerUnit > threshold) {
+		lod = coarsestWithin(threshold);
+	}
+	else {
+		lod = std::max(current, coarsestWithin(threshold * (1 - LOD_HYSTERESIS)));
+	}
+	m_selectedLods[slot] = static_cast<uint8_t>(lod);
+	return lod;
+}
+
+/**
+ * @brief Renders the object and its children, recursively, with the world matrices left by the
+ * last updateWorld.
+ * @param context if given, meshes are culled against the pass's frustum and drawn at the level
+ * of detail picked for the pass, and counted; otherwise all are drawn at full detail.
+ */
+void Object3D::renderRecursive(ShaderProgram& shaderProgram, RenderContext* context) const {
+	auto& world = getWorldMatrix();
+	shaderProgram.setUniform(MODEL_UNIFORM, world);
+	shaderProgram.setUniform(NORMAL_MATRIX_UNIFORM, getNormalMatrix());
+	if (context == nullptr) {
+		for (auto& mesh : m_meshes) {
+			mesh.render(shaderProgram);
+		}
+		for (auto& child : m_children) {
+			child.renderRecursive(shaderProgram, context);
+		}
+		return;
+	}
+
+	// Render each visible mesh in the object.
+	cullContents(*context);
+	for (size_t i = 0; i < m_meshes.size(); i++) {
+		if (!m_meshVisible[i]) {
+			continue;
+		}
+		auto& mesh = m_meshes[i];
+		auto lod = selectLod(i, world, *context);
+		mesh.render(shaderProgram, lod, &context->stats);
+		context->meshesVisible++;
+		context->trianglesDrawn += mesh.getLod(lod).indexCount / 3;
+		context->fullDetailTriangles += mesh.getLod(0).indexCount / 3;
+	}
+	// Render the visible children of the object.
+	for (size_t i = 0; i < m_children.size(); i++) {
+		if (m_childVisible[i]) {
+			m_children[i].renderRecursive(shaderProgram, context);
+		}
+	}
+}
+
+void Object3D::enqueueRecursive(ShaderProgram& shaderProgram, RenderContext& context, RenderQueue& queue) const {
+	auto& world = getWorldMatrix();
+	cullContents(context);
+	for (size_t i = 0; i < m_meshes.size(); i++) {
+		if (!m_meshVisible[i]) {
+			continue;
+		}
+		auto& mesh = m_meshes[i];
+		auto lod = selectLod(i, world, context);
+		queue.submit(shaderProgram, mesh, lod, world, getNormalMatrix(), context);
+		context.meshesVisible++;
+		context.trianglesDrawn += mesh.getLod(lod).indexCount / 3;
+		context.fullDetailTriangles += mesh.getLod(0).indexCount / 3;
+	}
+	for (size_t i = 0; i < m_children.size(); i++) {
+		if (m_childVisible[i]) {
+			m_children[i].enqueueRecursive(shaderProgram, context, queue);
+		}
 	}
 }
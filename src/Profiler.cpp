@@ -0,0 +1,249 @@
+#include "Profiler.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+namespace {
+	// The trace track the GPU's times are shown on; CPU threads are numbered from 1.
+	const uint32_t GPU_TRACK = 0;
+
+	float milliseconds(int64_t nanoseconds) {
+		return nanoseconds / 1'000'000.0f;
+	}
+
+	double microseconds(int64_t nanoseconds) {
+		return nanoseconds / 1000.0;
+	}
+
+	void writeJsonString(std::ostream& out, const char* text) {
+		out << '"';
+		for (const char* c = text; *c != '\0'; c++) {
+			if (*c == '"' || *c == '\\') {
+				out << '\\';
+			}
+			out << *c;
+		}
+		out << '"';
+	}
+
+	// Sums the durations of the scopes recorded under each name this frame.
+	template <typename Events>
+	void addFrameTotals(std::map<std::string, RollingDurations>& scopes, const Events& events) {
+		std::map<std::string, int64_t> totals;
+		for (auto& event : events) {
+			totals[event.name] += event.durationNs;
+		}
+		for (auto& [name, total] : totals) {
+			scopes[name].add(milliseconds(total));
+		}
+	}
+
+	void printScopes(std::ostream& out, const char* label, const std::map<std::string, RollingDurations>& scopes) {
+		for (auto& [name, durations] : scopes) {
+			auto percentiles = durations.percentiles();
+			out << "  " << label << " " << name << ": p50 " << percentiles.p50 << " ms, p95 " << percentiles.p95
+				<< " ms" << std::endl;
+		}
+	}
+}
+
+RollingDurations::RollingDurations(size_t capacity) : m_next(0), m_capacity(capacity) {
+	m_samples.reserve(capacity);
+}
+
+void RollingDurations::add(float milliseconds) {
+	if (m_samples.size() < m_capacity) {
+		m_samples.push_back(milliseconds);
+	} else {
+		m_samples[m_next] = milliseconds;
+	}
+	m_next = (m_next + 1) % m_capacity;
+}
+
+DurationPercentiles RollingDurations::percentiles() const {
+	if (m_samples.empty()) {
+		return { 0, 0.0f, 0.0f, 0.0f, 0.0f };
+	}
+	auto sorted = m_samples;
+	std::sort(sorted.begin(), sorted.end());
+	auto at = [&](float fraction) {
+		return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+	};
+	return { sorted.size(), at(0.5f), at(0.95f), at(0.99f), sorted.back() };
+}
+
+Profiler::Profiler()
+	: m_epoch(Clock::now()), m_frameStartNs(-1), m_captureFrames(0) {
+}
+
+Profiler& Profiler::shared() {
+	static Profiler profiler;
+	return profiler;
+}
+
+int64_t Profiler::now() const {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_epoch).count();
+}
+
+Profiler::ThreadLog& Profiler::threadLog() {
+	// Each thread registers once per profiler; after that recording takes only its own lock.
+	thread_local const Profiler* owner = nullptr;
+	thread_local ThreadLog* log = nullptr;
+	if (owner != this) {
+		std::lock_guard lock(m_mutex);
+		m_threads.push_back(std::make_unique<ThreadLog>());
+		log = m_threads.back().get();
+		log->threadId = static_cast<uint32_t>(m_threads.size());
+		owner = this;
+	}
+	return *log;
+}
+
+void Profiler::recordCpu(const char* name, int64_t startNs, int64_t endNs) {
+	auto& log = threadLog();
+	std::lock_guard lock(log.mutex);
+	log.events.push_back({ name, startNs, endNs - startNs });
+}
+
+void Profiler::recordGpu(const char* name, int64_t startNs, int64_t durationNs) {
+	std::lock_guard lock(m_mutex);
+	m_gpuEvents.push_back({ name, startNs, durationNs });
+}
+
+void Profiler::endFrame() {
+	auto endNs = now();
+	std::vector<std::pair<uint32_t, Event>> cpuEvents;
+	std::vector<Event> gpuEvents;
+	{
+		std::lock_guard lock(m_mutex);
+		for (auto& thread : m_threads) {
+			std::lock_guard threadLock(thread->mutex);
+			for (auto& event : thread->events) {
+				cpuEvents.emplace_back(thread->threadId, event);
+			}
+			thread->events.clear();
+		}
+		std::swap(gpuEvents, m_gpuEvents);
+	}
+
+	std::vector<Event> cpuFrameEvents;
+	cpuFrameEvents.reserve(cpuEvents.size());
+	for (auto& [thread, event] : cpuEvents) {
+		cpuFrameEvents.push_back(event);
+	}
+	addFrameTotals(m_cpuScopes, cpuFrameEvents);
+	addFrameTotals(m_gpuScopes, gpuEvents);
+
+	// The first frame has no start to measure from.
+	if (m_frameStartNs >= 0) {
+		m_frameTimes.add(milliseconds(endNs - m_frameStartNs));
+		if (m_captureFrames > 0) {
+			m_captured.emplace_back(threadLog().threadId, Event{ "frame", m_frameStartNs, endNs - m_frameStartNs });
+			m_captured.insert(m_captured.end(), cpuEvents.begin(), cpuEvents.end());
+			for (auto& event : gpuEvents) {
+				m_captured.emplace_back(GPU_TRACK, event);
+			}
+			if (--m_captureFrames == 0) {
+				writeTrace();
+				m_captured.clear();
+			}
+		}
+	}
+	m_frameStartNs = endNs;
+}
+
+void Profiler::captureFrames(size_t frames, const std::string& path) {
+	m_captureFrames = frames;
+	m_capturePath = path;
+	m_captured.clear();
+}
+
+bool Profiler::capturing() const {
+	return m_captureFrames > 0;
+}
+
+void Profiler::writeTrace() const {
+	std::ofstream out(m_capturePath);
+	if (!out) {
+		// A failed capture is dropped; it is no reason to stop rendering.
+		std::cerr << "Failed to write trace " << m_capturePath << std::endl;
+		return;
+	}
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_TRACK << ",\"args\":{\"name\":\"GPU\"}}";
+	for (size_t thread = 1; thread <= m_threads.size(); thread++) {
+		out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+			<< ",\"args\":{\"name\":\"Thread " << thread << "\"}}";
+	}
+	for (auto& [thread, event] : m_captured) {
+		out << ",\n{\"name\":";
+		writeJsonString(out, event.name);
+		out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread << ",\"ts\":" << microseconds(event.startNs)
+			<< ",\"dur\":" << microseconds(event.durationNs) << "}";
+	}
+	out << "\n]}\n";
+	std::cout << "Wrote " << m_captured.size() << " profiler events to " << m_capturePath << std::endl;
+}
+
+DurationPercentiles Profiler::frameTimes() const {
+	return m_frameTimes.percentiles();
+}
+
+void Profiler::printReport(std::ostream& out) const {
+	auto frames = m_frameTimes.percentiles();
+	out << "Frame time over " << frames.samples << " frames: p50 " << frames.p50 << " ms, p95 " << frames.p95
+		<< " ms, p99 " << frames.p99 << " ms, max " << frames.max << " ms" << std::endl;
+	printScopes(out, "CPU", m_cpuScopes);
+	printScopes(out, "GPU", m_gpuScopes);
+}
+
+GpuProfiler::GpuProfiler() : m_frame(0), m_active(false), m_dropped(0) {
+}
+
+bool GpuProfiler::begin(const char* name) {
+	if (m_active) {
+		return false;
+	}
+	auto& frame = m_frames[m_frame];
+	if (frame.used == frame.queries.size()) {
+		frame.queries.push_back({ GLQuery::create(), nullptr, 0 });
+	}
+	auto& query = frame.queries[frame.used++];
+	query.name = name;
+	query.startNs = Profiler::shared().now();
+	glBeginQuery(GL_TIME_ELAPSED, query.query.get());
+	m_active = true;
+	return true;
+}
+
+void GpuProfiler::end() {
+	glEndQuery(GL_TIME_ELAPSED);
+	m_active = false;
+}
+
+void GpuProfiler::endFrame() {
+	m_frame = (m_frame + 1) % FRAMES_IN_FLIGHT;
+	auto& frame = m_frames[m_frame];
+	bool available = true;
+	for (size_t i = 0; i < frame.used && available; i++) {
+		GLint result;
+		glGetQueryObjectiv(frame.queries[i].query.get(), GL_QUERY_RESULT_AVAILABLE, &result);
+		available = result != GL_FALSE;
+	}
+	if (available) {
+		for (size_t i = 0; i < frame.used; i++) {
+			GLuint64 elapsed;
+			glGetQueryObjectui64v(frame.queries[i].query.get(), GL_QUERY_RESULT, &elapsed);
+			Profiler::shared().recordGpu(frame.queries[i].name, frame.queries[i].startNs, static_cast<int64_t>(elapsed));
+		}
+	} else {
+		m_dropped++;
+	}
+	frame.used = 0;
+}
+
+size_t GpuProfiler::droppedFrames() const {
+	return m_dropped;
+}
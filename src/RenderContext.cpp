@@ -0,0 +1,6 @@
+#include "RenderContext.h"
+#include <cmath>
+
+float projectionScaleFor(float fovy, float viewportHeight) {
+	return viewportHeight / (2 * std::tan(fovy / 2));
+}
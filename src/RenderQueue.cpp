@@ -0,0 +1,295 @@
+#include "RenderQueue.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+
+namespace {
+	constexpr UniformName MODEL_UNIFORM("model");
+	constexpr UniformName NORMAL_MATRIX_UNIFORM("normalMatrix");
+	constexpr UniformName POSITION_SCALE_UNIFORM("positionScale");
+	constexpr UniformName POSITION_OFFSET_UNIFORM("positionOffset");
+
+	const uint32_t PASS_BITS = 4;
+	const uint32_t PROGRAM_BITS = 8;
+	const uint32_t TEXTURE_SET_BITS = 12;
+	const uint32_t VERTEX_ARRAY_BITS = 8;
+	const uint32_t GEOMETRY_BITS = 10;
+	const uint32_t LOD_BITS = 2;
+	const uint32_t DEPTH_BITS = 20;
+
+	uint64_t field(uint64_t key, uint32_t value, uint32_t bits) {
+		return (key << bits) | (value & ((1u << bits) - 1));
+	}
+
+	bool sameTextures(const std::vector<Texture>& a, const std::vector<Texture>& b) {
+		if (&a == &b) {
+			return true;
+		}
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Texture& x, const Texture& y) {
+			return x.textureId == y.textureId && x.samplerName == y.samplerName;
+		});
+	}
+
+	/**
+	 * @brief Whether two items can be drawn by one multi-draw: they use the same instanced program,
+	 * vertex array and textures.
+	 */
+	bool canBatchTogether(const DrawItem& a, const DrawItem& b) {
+		return a.program->getProgramId() == b.program->getProgramId() && a.program->isInstanced()
+			&& a.mesh->getVertexArray() == b.mesh->getVertexArray()
+			&& sameTextures(a.mesh->getTextures(), b.mesh->getTextures());
+	}
+
+	/**
+	 * @brief Whether two items of a batch can be drawn by one instanced draw command. Copies of a
+	 * mesh share its geometry, levels of detail and quantization.
+	 */
+	bool canInstanceTogether(const DrawItem& a, const DrawItem& b) {
+		return a.mesh->getGeometryId() == b.mesh->getGeometryId() && a.lod == b.lod;
+	}
+}
+
+RenderQueue::RenderQueue()
+	: m_instanceBufferBytes(0), m_vertexArrayDeletions(0), m_commandBufferBytes(0) {
+}
+
+uint64_t RenderQueue::makeKey(uint32_t pass, uint32_t program, uint32_t textureSet, uint32_t vertexArray,
+	uint32_t geometry, uint32_t lod, float depth) {
+	uint64_t key = field(0, pass, PASS_BITS);
+	key = field(key, program, PROGRAM_BITS);
+	key = field(key, textureSet, TEXTURE_SET_BITS);
+	key = field(key, vertexArray, VERTEX_ARRAY_BITS);
+	key = field(key, geometry, GEOMETRY_BITS);
+	key = field(key, lod, LOD_BITS);
+	// The bits of a non-negative float sort the same way as its value; the top ones keep the
+	// exponent and the leading mantissa bits.
+	auto depthBits = std::bit_cast<uint32_t>(std::max(depth, 0.0f)) >> (32 - DEPTH_BITS);
+	return field(key, depthBits, DEPTH_BITS);
+}
+
+uint32_t RenderQueue::programIndex(const ShaderProgram& program) {
+	auto found = std::find(m_programs.begin(), m_programs.end(), program.getProgramId());
+	if (found != m_programs.end()) {
+		return static_cast<uint32_t>(found - m_programs.begin());
+	}
+	m_programs.push_back(program.getProgramId());
+	return static_cast<uint32_t>(m_programs.size() - 1);
+}
+
+uint32_t RenderQueue::textureSetIndex(const Mesh3D& mesh) {
+	m_textureSetScratch.clear();
+	for (auto& texture : mesh.getTextures()) {
+		m_textureSetScratch.push_back(texture.textureId);
+	}
+	auto found = m_textureSets.find(m_textureSetScratch);
+	if (found != m_textureSets.end()) {
+		return found->second;
+	}
+	auto index = static_cast<uint32_t>(m_textureSets.size());
+	m_textureSets.emplace(m_textureSetScratch, index);
+	return index;
+}
+
+uint32_t RenderQueue::geometryIndex(const Mesh3D& mesh) {
+	auto index = static_cast<uint32_t>(m_geometries.size());
+	return m_geometries.try_emplace(mesh.getGeometryId(), index).first->second;
+}
+
+void RenderQueue::submit(ShaderProgram& program, const Mesh3D& mesh, size_t lod, const glm::mat4& model,
+	const glm::mat3& normalMatrix, const RenderContext& context) {
+	auto center = glm::vec3(model * glm::vec4((mesh.getBoundsMin() + mesh.getBoundsMax()) * 0.5f, 1));
+	auto depth = glm::length(center - context.cameraPosition);
+	auto key = makeKey(context.pass, programIndex(program), textureSetIndex(mesh), mesh.getVertexArray(),
+		geometryIndex(mesh), static_cast<uint32_t>(lod), depth);
+	m_items.push_back(DrawItem{ key, &program, &mesh, static_cast<uint32_t>(lod), model, normalMatrix });
+}
+
+size_t RenderQueue::size() const {
+	return m_items.size();
+}
+
+void RenderQueue::clear() {
+	m_items.clear();
+}
+
+/**
+ * @brief Splits the sorted items into batches, and writes the per-instance data and the draw
+ * commands of the instanced ones, in draw order.
+ */
+void RenderQueue::planBatches() {
+	m_batches.clear();
+	m_instances.clear();
+	m_commands.clear();
+	for (size_t first = 0; first < m_items.size();) {
+		auto& item = m_items[first];
+		Batch batch{ first, 1, m_commands.size(), 0 };
+		if (item.program->isInstanced()) {
+			while (first + batch.itemCount < m_items.size() && canBatchTogether(item, m_items[first + batch.itemCount])) {
+				batch.itemCount++;
+			}
+			for (size_t i = first; i < first + batch.itemCount;) {
+				auto& mesh = *m_items[i].mesh;
+				auto baseInstance = static_cast<uint32_t>(m_instances.size());
+				size_t count = 0;
+				while (i + count < first + batch.itemCount && (count == 0 || canInstanceTogether(m_items[i], m_items[i + count]))) {
+					auto& quantization = mesh.getQuantization();
+					m_instances.push_back(InstanceData{ m_items[i + count].model, glm::vec4(quantization.scale, 0),
+						glm::vec4(quantization.offset, 0), glm::mat3x4(m_items[i + count].normalMatrix) });
+					count++;
+				}
+				m_commands.push_back(mesh.indirectCommand(m_items[i].lod, static_cast<uint32_t>(count), baseInstance));
+				i += count;
+			}
+			batch.commandCount = m_commands.size() - batch.firstCommand;
+		}
+		m_batches.push_back(batch);
+		first += batch.itemCount;
+	}
+}
+
+/**
+ * @brief Uploads the per-instance data of the flush to the instance buffer, and leaves it bound
+ * to GL_ARRAY_BUFFER.
+ */
+void RenderQueue::uploadInstances() {
+	if (m_instances.empty()) {
+		return;
+	}
+	if (!m_instanceBuffer) {
+		m_instanceBuffer = GLBuffer::create();
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer.get());
+	auto bytes = m_instances.size() * sizeof(InstanceData);
+	// Reallocating the buffer each flush orphans the old storage, so the driver need not wait
+	// for the previous pass's draws to finish reading it.
+	m_instanceBufferBytes = std::max(m_instanceBufferBytes, bytes);
+	glBufferData(GL_ARRAY_BUFFER, m_instanceBufferBytes, nullptr, GL_STREAM_DRAW);
+	GpuMemory::shared().track(GpuObject::Buffer, m_instanceBuffer.get(), GpuCategory::DynamicBuffers,
+		m_instanceBufferBytes, "RenderQueue");
+	glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, m_instances.data());
+}
+
+/**
+ * @brief Uploads the draw commands of the flush to the indirect buffer, and leaves it bound to
+ * GL_DRAW_INDIRECT_BUFFER.
+ */
+void RenderQueue::uploadCommands() {
+	if (m_commands.empty()) {
+		return;
+	}
+	if (!m_commandBuffer) {
+		m_commandBuffer = GLBuffer::create();
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer.get());
+	auto bytes = m_commands.size() * sizeof(DrawElementsIndirectCommand);
+	m_commandBufferBytes = std::max(m_commandBufferBytes, bytes);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commandBufferBytes, nullptr, GL_STREAM_DRAW);
+	GpuMemory::shared().track(GpuObject::Buffer, m_commandBuffer.get(), GpuCategory::DynamicBuffers,
+		m_commandBufferBytes, "RenderQueue");
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, bytes, m_commands.data());
+}
+
+/**
+ * @brief Points the bound vertex array's instance attributes at the instance buffer, starting
+ * from the given instance and advancing once per instance. A matrix takes one location per
+ * column. Skipped when they already point there.
+ */
+void RenderQueue::pointInstanceAttributes(uint32_t vertexArray, size_t firstInstance) {
+	if (m_vertexArrayDeletions != GLState::vertexArrayDeletions()) {
+		m_vertexArrayDeletions = GLState::vertexArrayDeletions();
+		m_instancedVertexArrays.clear();
+	}
+	auto [pointed, enable] = m_instancedVertexArrays.try_emplace(vertexArray, firstInstance);
+	if (!enable && pointed->second == firstInstance) {
+		return;
+	}
+	pointed->second = firstInstance;
+
+	auto base = firstInstance * sizeof(InstanceData);
+	auto point = [&](uint32_t location, size_t offset, int32_t size = 4) {
+		glVertexAttribPointer(location, size, GL_FLOAT, false, sizeof(InstanceData), reinterpret_cast<const void*>(base + offset));
+		if (enable) {
+			glEnableVertexAttribArray(location);
+			glVertexAttribDivisor(location, 1);
+		}
+	};
+	for (uint32_t column = 0; column < 4; column++) {
+		point(INSTANCE_MODEL_LOCATION + column, offsetof(InstanceData, model) + column * sizeof(glm::vec4));
+	}
+	point(INSTANCE_POSITION_SCALE_LOCATION, offsetof(InstanceData, positionScale));
+	point(INSTANCE_POSITION_OFFSET_LOCATION, offsetof(InstanceData, positionOffset));
+	for (uint32_t column = 0; column < 3; column++) {
+		point(INSTANCE_NORMAL_MATRIX_LOCATION + column, offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec4), 3);
+	}
+}
+
+void RenderQueue::flush(RenderStats& stats) {
+	std::sort(m_items.begin(), m_items.end(), [](const DrawItem& a, const DrawItem& b) {
+		return a.key < b.key;
+	});
+	planBatches();
+	uploadInstances();
+	// Without GL 4.3 each command becomes its own instanced draw, its instances found by pointing
+	// the attributes at its baseInstance, since glDrawElementsInstancedBaseVertexBaseInstance is
+	// also 4.2+.
+	bool multiDraw = GLAD_GL_VERSION_4_3;
+	if (multiDraw) {
+		uploadCommands();
+	}
+
+	// Sampler uniforms belong to the program, so they are set again after a program change.
+	// GLState skips the binds that are already in place.
+	uint32_t currentProgram = UINT32_MAX;
+	const std::vector<Texture>* currentTextures = nullptr;
+	for (auto& batch : m_batches) {
+		auto& item = m_items[batch.firstItem];
+		auto& program = *item.program;
+		auto& mesh = *item.mesh;
+		bool programChanged = program.getProgramId() != currentProgram;
+		if (programChanged) {
+			stats.programBinds += GLState::useProgram(program.getProgramId());
+			currentProgram = program.getProgramId();
+		}
+		stats.vertexArrayBinds += GLState::bindVertexArray(mesh.getVertexArray());
+		auto& textures = mesh.getTextures();
+		if (programChanged || &textures != currentTextures) {
+			for (size_t i = 0; i < textures.size(); i++) {
+				program.setUniform(textures[i].samplerName, static_cast<int32_t>(i));
+				stats.textureBinds += GLState::bindTexture(static_cast<uint32_t>(i), textures[i].textureId);
+			}
+			currentTextures = &textures;
+		}
+
+		if (!program.isInstanced()) {
+			program.setUniform(POSITION_SCALE_UNIFORM, mesh.getQuantization().scale);
+			program.setUniform(POSITION_OFFSET_UNIFORM, mesh.getQuantization().offset);
+			program.setUniform(MODEL_UNIFORM, item.model);
+			program.setUniform(NORMAL_MATRIX_UNIFORM, item.normalMatrix);
+			mesh.draw(item.lod);
+			stats.drawCalls++;
+		}
+		else if (multiDraw) {
+			// The commands' baseInstance selects each draw's instances, counted from the start
+			// of the buffer.
+			pointInstanceAttributes(mesh.getVertexArray(), 0);
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				reinterpret_cast<const void*>(batch.firstCommand * sizeof(DrawElementsIndirectCommand)),
+				static_cast<GLsizei>(batch.commandCount), 0);
+			stats.drawCalls++;
+		}
+		else {
+			for (size_t i = batch.firstCommand; i < batch.firstCommand + batch.commandCount; i++) {
+				auto& command = m_commands[i];
+				pointInstanceAttributes(mesh.getVertexArray(), command.baseInstance);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+					reinterpret_cast<const void*>(static_cast<size_t>(command.firstIndex) * sizeof(uint32_t)),
+					command.instanceCount, command.baseVertex);
+				stats.drawCalls++;
+			}
+		}
+		stats.meshesDrawn += batch.itemCount;
+	}
+	m_items.clear();
+}
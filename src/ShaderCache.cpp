@@ -0,0 +1,96 @@
+#include "ShaderCache.h"
+#include "ModelCache.h"
+#include <glad/glad.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace {
+	const char* SHADER_CACHE_DIRECTORY = "cache/shaders";
+	const char SHADER_CACHE_MAGIC[4] = { 'G', 'P', 'R', 'G' };
+
+	uint64_t hashString(const char* text, uint64_t seed) {
+		if (text == nullptr) {
+			return seed;
+		}
+		// Hash the terminator too, so that strings next to each other can't run together.
+		return hashBytes(text, std::strlen(text) + 1, seed);
+	}
+}
+
+bool programBinariesSupported() {
+	if (!GLAD_GL_VERSION_4_1) {
+		return false;
+	}
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+uint64_t programCacheKey(const std::string& vertexCode, const std::string& fragmentCode) {
+	auto key = hashString(vertexCode.c_str(), SHADER_CACHE_VERSION);
+	key = hashString(fragmentCode.c_str(), key);
+	for (auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		key = hashString(reinterpret_cast<const char*>(glGetString(name)), key);
+	}
+	return key;
+}
+
+std::filesystem::path programCachePath(uint64_t key) {
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+	return std::filesystem::path(SHADER_CACHE_DIRECTORY) / name.str();
+}
+
+bool loadProgramBinary(uint32_t program, uint64_t key) {
+	auto path = programCachePath(key);
+	std::ifstream in(path, std::ios::binary);
+	ShaderCacheHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| std::memcmp(header.magic, SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC)) != 0
+		|| header.version != SHADER_CACHE_VERSION || header.key != key) {
+		return false;
+	}
+	// Check the stored length against the file before allocating for it, so a truncated or
+	// corrupt file is a miss rather than a huge allocation.
+	std::error_code error;
+	auto fileSize = std::filesystem::file_size(path, error);
+	if (error || fileSize != sizeof(ShaderCacheHeader) + static_cast<uintmax_t>(header.binaryLength)) {
+		return false;
+	}
+	std::vector<char> binary(header.binaryLength);
+	if (!in.read(binary.data(), static_cast<std::streamsize>(binary.size()))) {
+		return false;
+	}
+	glProgramBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+bool saveProgramBinary(uint32_t program, uint64_t key) {
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return false;
+	}
+	std::vector<uint8_t> bytes(sizeof(ShaderCacheHeader) + length);
+	GLsizei written = 0;
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &written, &format, bytes.data() + sizeof(ShaderCacheHeader));
+	if (written <= 0) {
+		return false;
+	}
+	ShaderCacheHeader header{};
+	std::memcpy(header.magic, SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC));
+	header.version = SHADER_CACHE_VERSION;
+	header.key = key;
+	header.binaryFormat = format;
+	header.binaryLength = static_cast<uint32_t>(written);
+	std::memcpy(bytes.data(), &header, sizeof(header));
+	bytes.resize(sizeof(ShaderCacheHeader) + written);
+	return writeCacheFile(programCachePath(key), bytes);
+}
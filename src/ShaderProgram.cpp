@@ -1,18 +1,104 @@
 #include "ShaderProgram.h"
+#include "GLState.h"
+#include "ShaderCache.h"
+#include "UniformBuffer.h"
 #include <glad/glad.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    UniformCallStats callStats{ 0, 0 };
+
+    /**
+     * @brief Adds a #define for each name right after the #version line, which must stay first.
+     */
+    std::string withDefines(const std::string& code, const std::vector<std::string>& defines)
+    {
+        if (defines.empty()) {
+            return code;
+        }
+        std::string lines;
+        for (auto& define : defines) {
+            lines += "#define " + define + "\n";
+        }
+        auto version = code.find("#version");
+        if (version == std::string::npos) {
+            return lines + code;
+        }
+        auto lineEnd = code.find('\n', version);
+        if (lineEnd == std::string::npos) {
+            return code + "\n" + lines;
+        }
+        return code.substr(0, lineEnd + 1) + lines + code.substr(lineEnd + 1);
+    }
+}
+
+struct ShaderProgram::PendingLoad {
+    // The shader files and defines, for logging.
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+    // Whether the driver supports program binaries, and the program's key in the shader cache.
+    bool binaries = false;
+    uint64_t key = 0;
+    bool cacheHit = false;
+    // The shaders being compiled, on a cache miss.
+    uint32_t vertex = 0;
+    uint32_t fragment = 0;
+};
+
+struct ShaderProgram::UniformTable {
+    struct Slot {
+        std::string name;
+        // Arrays can also be looked up by their name without "[0]".
+        std::string alias;
+        int32_t location;
+        bool hasValue;
+        uint8_t valueSize;
+        // Large enough for a mat4.
+        std::array<uint8_t, 64> value;
+    };
+
+    std::vector<Slot> slots;
+    std::unordered_map<uint64_t, int32_t> byHash;
+    // Whether two names share a hash, so lookups that miss must search by name.
+    bool hasCollisions = false;
+
+    void add(const std::string& name, int32_t location) {
+        auto index = static_cast<int32_t>(slots.size());
+        slots.push_back({ name, std::string(), location, false, 0, {} });
+        hasCollisions |= !byHash.emplace(UniformName(name).hashValue(), index).second;
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            slots.back().alias = name.substr(0, name.size() - 3);
+            hasCollisions |= !byHash.emplace(UniformName(slots.back().alias).hashValue(), index).second;
+        }
+    }
+};
 
 ShaderProgram::ShaderProgram()
-    : m_programId(-1) {
+    : m_programId(-1), m_instanced(false) {
 
 }
 
 
 
-void ShaderProgram::load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath)
+void ShaderProgram::load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+    const std::vector<std::string>& defines)
 {
+    startLoad(vertexShaderPath, fragmentShaderPath, defines);
+    finishLoad();
+}
+
+void ShaderProgram::startLoad(const std::string& vertexShaderPath, const std::string& fragmentShaderPath,
+    const std::vector<std::string>& defines)
+{
+    auto start = std::chrono::steady_clock::now();
     std::string vertexCode;
     std::string fragmentCode;
     std::ifstream vShaderFile;
@@ -33,109 +119,301 @@ void ShaderProgram::load(const std::string& vertexShaderPath, const std::string&
         vShaderFile.close();
         fShaderFile.close();
         // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        vertexCode = withDefines(vShaderStream.str(), defines);
+        fragmentCode = withDefines(fShaderStream.str(), defines);
     }
     catch (std::ifstream::failure& e)
     {
         throw std::runtime_error("Failed to locate vertex or fragment shader files");
     }
 
+    m_pending = std::make_shared<PendingLoad>();
+    m_pending->name = vertexShaderPath + " + " + fragmentShaderPath;
+    for (auto& define : defines) {
+        m_pending->name += " " + define;
+    }
+    m_pending->start = start;
+    m_pending->binaries = programBinariesSupported();
+
+    // A binary the driver rejects, as it may after an update, is rebuilt from source.
+    m_programId = glCreateProgram();
+    if (m_pending->binaries) {
+        m_pending->key = programCacheKey(vertexCode, fragmentCode);
+        m_pending->cacheHit = loadProgramBinary(m_programId, m_pending->key);
+        if (m_pending->cacheHit) {
+            return;
+        }
+        glDeleteProgram(m_programId);
+        m_programId = glCreateProgram();
+        glProgramParameteri(m_programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // Nothing is checked until finishLoad(), so drivers that compile on their own threads
+    // aren't made to wait here.
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
+    m_pending->vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(m_pending->vertex, 1, &vShaderCode, NULL);
+    glCompileShader(m_pending->vertex);
+    m_pending->fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(m_pending->fragment, 1, &fShaderCode, NULL);
+    glCompileShader(m_pending->fragment);
+    glAttachShader(m_programId, m_pending->vertex);
+    glAttachShader(m_programId, m_pending->fragment);
+    glLinkProgram(m_programId);
+}
 
-    unsigned int vertex, fragment;
-    int success;
-    char infoLog[512];
-
-    // vertex Shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    // print compile errors if any
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        throw std::runtime_error(infoLog);
-    };
+void ShaderProgram::finishLoad()
+{
+    if (!m_pending) {
+        return;
+    }
+    auto pending = std::move(m_pending);
+    if (!pending->cacheHit) {
+        int success;
+        char infoLog[512];
 
-    // similiar for Fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    // print compile errors if any
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        throw std::runtime_error(infoLog);
-    };
+        // print compile errors if any
+        glGetShaderiv(pending->vertex, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(pending->vertex, 512, NULL, infoLog);
+            throw std::runtime_error(infoLog);
+        };
+        glGetShaderiv(pending->fragment, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(pending->fragment, 512, NULL, infoLog);
+            throw std::runtime_error(infoLog);
+        };
+        // print linking errors if any
+        glGetProgramiv(m_programId, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(m_programId, 512, NULL, infoLog);
+            throw std::runtime_error(infoLog);
+        }
 
-    // shader Program
-    m_programId = glCreateProgram();
-    glAttachShader(m_programId, vertex);
-    glAttachShader(m_programId, fragment);
-    glLinkProgram(m_programId);
-    // print linking errors if any
-    glGetProgramiv(m_programId, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(m_programId, 512, NULL, infoLog);
-        throw std::runtime_error(infoLog);
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDeleteShader(pending->vertex);
+        glDeleteShader(pending->fragment);
+        if (pending->binaries) {
+            saveProgramBinary(m_programId, pending->key);
+        }
+    }
+
+    introspectUniforms();
+    m_instanced = glGetAttribLocation(m_programId, "instanceModel") >= 0;
+
+    // Connect the shared uniform blocks the program uses to their binding points.
+    GLint blockCount = 0;
+    glGetProgramiv(m_programId, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    for (GLint i = 0; i < blockCount; i++) {
+        char blockName[64];
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(m_programId, i, sizeof(blockName), &length, blockName);
+        auto binding = uniformBlockBinding(std::string_view(blockName, length));
+        if (binding >= 0) {
+            glUniformBlockBinding(m_programId, i, binding);
+        }
     }
 
-    // delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - pending->start;
+    std::cout << (pending->cacheHit ? "[cache hit]  " : "[cache miss] ") << pending->name << ": "
+        << loadTime.count() << " ms " << (pending->cacheHit ? "loaded from binary" : "compiled") << std::endl;
+}
+
+/**
+ * @brief Finds the location of every active uniform, including each element of arrays.
+ * Uniforms in uniform blocks have no location and are left out.
+ */
+void ShaderProgram::introspectUniforms()
+{
+    m_uniforms = std::make_shared<UniformTable>();
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(m_programId, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(m_programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> nameBuffer(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(m_programId, i, static_cast<GLsizei>(nameBuffer.size()), &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+        auto location = glGetUniformLocation(m_programId, name.c_str());
+        if (location < 0) {
+            continue;
+        }
+        m_uniforms->add(name, location);
+        if (size > 1 && name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            auto base = name.substr(0, name.size() - 3);
+            for (GLint element = 1; element < size; element++) {
+                auto elementName = base + "[" + std::to_string(element) + "]";
+                m_uniforms->add(elementName, glGetUniformLocation(m_programId, elementName.c_str()));
+            }
+        }
+    }
 }
 
 void ShaderProgram::activate()
 {
-    glUseProgram(m_programId);
+    GLState::useProgram(m_programId);
+}
+
+uint32_t ShaderProgram::getProgramId() const
+{
+    return m_programId;
+}
+
+bool ShaderProgram::isInstanced() const
+{
+    return m_instanced;
+}
+
+UniformHandle ShaderProgram::uniformHandle(UniformName uniformName) const
+{
+    if (!m_uniforms) {
+        return {};
+    }
+    auto found = m_uniforms->byHash.find(uniformName.hashValue());
+    if (found != m_uniforms->byHash.end()) {
+        auto& slot = m_uniforms->slots[found->second];
+        if (slot.name == uniformName.name() || slot.alias == uniformName.name()) {
+            return { found->second };
+        }
+    }
+    if (!m_uniforms->hasCollisions) {
+        // A uniform the program doesn't use.
+        return {};
+    }
+    for (size_t i = 0; i < m_uniforms->slots.size(); i++) {
+        auto& slot = m_uniforms->slots[i];
+        if (slot.name == uniformName.name() || slot.alias == uniformName.name()) {
+            return { static_cast<int32_t>(i) };
+        }
+    }
+    return {};
+}
+
+/**
+ * @brief Uploads a uniform's value, unless it already holds exactly that value.
+ */
+template <typename T, typename Upload>
+void ShaderProgram::set(UniformHandle handle, const T& value, Upload upload)
+{
+    static_assert(sizeof(T) <= sizeof(UniformTable::Slot::value));
+    if (!handle.isValid() || !m_uniforms) {
+        callStats.skipped++;
+        return;
+    }
+    auto& slot = m_uniforms->slots[handle.index];
+    if (slot.hasValue && slot.valueSize == sizeof(T) && std::memcmp(slot.value.data(), &value, sizeof(T)) == 0) {
+        callStats.skipped++;
+        return;
+    }
+    std::memcpy(slot.value.data(), &value, sizeof(T));
+    slot.valueSize = sizeof(T);
+    slot.hasValue = true;
+    upload(slot.location);
+    callStats.issued++;
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, bool value)
+{
+    setUniform(uniform, static_cast<int32_t>(value));
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, int32_t value)
+{
+    set(uniform, value, [&](GLint location) { glUniform1i(location, value); });
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, float value)
+{
+    set(uniform, value, [&](GLint location) { glUniform1f(location, value); });
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec2& value)
+{
+    set(uniform, value, [&](GLint location) { glUniform2fv(location, 1, &value[0]); });
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec3& value)
+{
+    set(uniform, value, [&](GLint location) { glUniform3fv(location, 1, &value[0]); });
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::vec4& value)
+{
+    set(uniform, value, [&](GLint location) { glUniform4fv(location, 1, &value[0]); });
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat2& value)
+{
+    set(uniform, value, [&](GLint location) { glUniformMatrix2fv(location, 1, false, &value[0][0]); });
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat3& value)
+{
+    set(uniform, value, [&](GLint location) { glUniformMatrix3fv(location, 1, false, &value[0][0]); });
+}
+
+void ShaderProgram::setUniform(UniformHandle uniform, const glm::mat4& value)
+{
+    set(uniform, value, [&](GLint location) { glUniformMatrix4fv(location, 1, false, &value[0][0]); });
+}
+
+void ShaderProgram::setUniform(UniformName uniformName, bool value)
+{
+    setUniform(uniformHandle(uniformName), value);
+}
+
+void ShaderProgram::setUniform(UniformName uniformName, int32_t value)
+{
+    setUniform(uniformHandle(uniformName), value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, bool value)
+void ShaderProgram::setUniform(UniformName uniformName, float value)
 {
-    glUniform1i(glGetUniformLocation(m_programId, uniformName.c_str()), (int32_t)value);
+    setUniform(uniformHandle(uniformName), value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, int32_t value)
+void ShaderProgram::setUniform(UniformName uniformName, const glm::vec2& value)
 {
-    glUniform1i(glGetUniformLocation(m_programId, uniformName.c_str()), value);
+    setUniform(uniformHandle(uniformName), value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, float value)
+void ShaderProgram::setUniform(UniformName uniformName, const glm::vec3& value)
 {
-    glUniform1f(glGetUniformLocation(m_programId, uniformName.c_str()), /*(int) removed this cast*/value);
+    setUniform(uniformHandle(uniformName), value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec2& value)
+void ShaderProgram::setUniform(UniformName uniformName, const glm::vec4& value)
 {
-    glUniform2fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+    setUniform(uniformHandle(uniformName), value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec3& value)
+void ShaderProgram::setUniform(UniformName uniformName, const glm::mat2& value)
 {
-    glUniform3fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+    setUniform(uniformHandle(uniformName), value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::vec4& value)
+void ShaderProgram::setUniform(UniformName uniformName, const glm::mat3& value)
 {
-    glUniform4fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, &value[0]);
+    setUniform(uniformHandle(uniformName), value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat2& value)
+void ShaderProgram::setUniform(UniformName uniformName, const glm::mat4& value)
 {
-    glUniformMatrix2fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+    setUniform(uniformHandle(uniformName), value);
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat3& value)
+UniformCallStats ShaderProgram::uniformCallStats()
 {
-    glUniformMatrix3fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+    return callStats;
 }
 
-void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat4& value)
+void ShaderProgram::resetUniformCallStats()
 {
-    glUniformMatrix4fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
+    callStats = { 0, 0 };
 }
@@ -0,0 +1,326 @@
+#include "TextureCooker.h"
+#include "ModelCache.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace {
+	const char* TEXTURE_CACHE_DIRECTORY = "cache/textures";
+
+	/**
+	 * @brief Runs body(i) for i in [0, count), split into contiguous ranges across threads.
+	 * On a ThreadPool worker it runs serially, since the pool already keeps every core busy.
+	 */
+	template <typename F>
+	void parallelFor(size_t count, const F& body) {
+		size_t threads = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), count);
+		if (threads <= 1 || ThreadPool::isWorkerThread()) {
+			for (size_t i = 0; i < count; i++) {
+				body(i);
+			}
+			return;
+		}
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < threads; t++) {
+			workers.emplace_back([&body, t, threads, count]() {
+				for (size_t i = count * t / threads; i < count * (t + 1) / threads; i++) {
+					body(i);
+				}
+			});
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	bool isVectorMap(const std::string& samplerName) {
+		return samplerName == "normalMap" || samplerName == "dudvMap";
+	}
+
+	/**
+	 * @brief Halves an RGBA8 image with a 2x2 box filter. Normal maps are renormalized, so
+	 * averaging doesn't shorten their vectors.
+	 */
+	std::vector<uint8_t> downsample(const std::vector<uint8_t>& src, uint32_t width, uint32_t height, bool renormalize) {
+		uint32_t dstWidth = std::max(width / 2, 1u);
+		uint32_t dstHeight = std::max(height / 2, 1u);
+		std::vector<uint8_t> dst(static_cast<size_t>(dstWidth) * dstHeight * 4);
+		for (uint32_t y = 0; y < dstHeight; y++) {
+			uint32_t y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			for (uint32_t x = 0; x < dstWidth; x++) {
+				uint32_t x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+				float sum[4];
+				for (int c = 0; c < 4; c++) {
+					sum[c] = (src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c]
+						+ src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c]) / 4.0f;
+				}
+				if (renormalize) {
+					float n[3] = { sum[0] / 127.5f - 1, sum[1] / 127.5f - 1, sum[2] / 127.5f - 1 };
+					float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					if (length > 0) {
+						for (int c = 0; c < 3; c++) {
+							sum[c] = (n[c] / length + 1) * 127.5f;
+						}
+					}
+				}
+				for (int c = 0; c < 4; c++) {
+					dst[(static_cast<size_t>(y) * dstWidth + x) * 4 + c] = static_cast<uint8_t>(std::clamp(sum[c] + 0.5f, 0.0f, 255.0f));
+				}
+			}
+		}
+		return dst;
+	}
+
+	/**
+	 * @brief Copies the 4x4 block at (bx, by) out of an image, repeating edge texels for blocks
+	 * that hang over the edge.
+	 */
+	void extractBlock(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, uint8_t block[64]) {
+		for (uint32_t y = 0; y < 4; y++) {
+			uint32_t sy = std::min(by * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; x++) {
+				uint32_t sx = std::min(bx * 4 + x, width - 1);
+				std::memcpy(block + (y * 4 + x) * 4, pixels + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+			}
+		}
+	}
+
+	uint16_t to565(const float color[3]) {
+		auto r = static_cast<uint16_t>(std::clamp(color[0] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f));
+		auto g = static_cast<uint16_t>(std::clamp(color[1] * 63.0f / 255.0f + 0.5f, 0.0f, 63.0f));
+		auto b = static_cast<uint16_t>(std::clamp(color[2] * 31.0f / 255.0f + 0.5f, 0.0f, 31.0f));
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	void from565(uint16_t c, int color[3]) {
+		color[0] = ((c >> 11) & 31) * 255 / 31;
+		color[1] = ((c >> 5) & 63) * 255 / 63;
+		color[2] = (c & 31) * 255 / 31;
+	}
+
+	/**
+	 * @brief Encodes the RGB of a block as BC1 in four-color mode. The endpoints are the
+	 * extremes of the block's colors along their principal axis.
+	 */
+	void encodeColorBlock(const uint8_t block[64], uint8_t out[8]) {
+		float mean[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 3; c++) {
+				mean[c] += block[i * 4 + c] / 16.0f;
+			}
+		}
+		float cov[6] = { 0, 0, 0, 0, 0, 0 };
+		for (int i = 0; i < 16; i++) {
+			float d[3] = { block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2] };
+			cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+			cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+		}
+		// Power iteration for the covariance matrix's dominant eigenvector.
+		float axis[3] = { 1, 1, 1 };
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[3] = {
+				cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+				cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+				cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+			};
+			float length = std::max({ std::fabs(next[0]), std::fabs(next[1]), std::fabs(next[2]) });
+			if (length < 1e-6f) {
+				break;
+			}
+			for (int c = 0; c < 3; c++) {
+				axis[c] = next[c] / length;
+			}
+		}
+		float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+		float minT = 0, maxT = 0;
+		for (int i = 0; i < 16; i++) {
+			float t = ((block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1]
+				+ (block[i * 4 + 2] - mean[2]) * axis[2]) / axisLength2;
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+		float high[3], low[3];
+		for (int c = 0; c < 3; c++) {
+			high[c] = mean[c] + axis[c] * maxT;
+			low[c] = mean[c] + axis[c] * minT;
+		}
+		uint16_t c0 = to565(high), c1 = to565(low);
+		if (c0 < c1) {
+			std::swap(c0, c1);
+		}
+		uint32_t indices = 0;
+		if (c0 != c1) {
+			int palette[4][3];
+			from565(c0, palette[0]);
+			from565(c1, palette[1]);
+			for (int c = 0; c < 3; c++) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (int i = 0; i < 16; i++) {
+				int best = 0, bestError = INT32_MAX;
+				for (int p = 0; p < 4; p++) {
+					int dr = block[i * 4] - palette[p][0], dg = block[i * 4 + 1] - palette[p][1], db = block[i * 4 + 2] - palette[p][2];
+					int error = dr * dr + dg * dg + db * db;
+					if (error < bestError) {
+						bestError = error;
+						best = p;
+					}
+				}
+				indices |= static_cast<uint32_t>(best) << (i * 2);
+			}
+		}
+		std::memcpy(out, &c0, 2);
+		std::memcpy(out + 2, &c1, 2);
+		std::memcpy(out + 4, &indices, 4);
+	}
+
+	/**
+	 * @brief Encodes one channel of a block as a BC4 block, using the eight-value mode
+	 * between the channel's minimum and maximum.
+	 */
+	void encodeChannelBlock(const uint8_t block[64], int channel, uint8_t out[8]) {
+		int high = 0, low = 255;
+		for (int i = 0; i < 16; i++) {
+			high = std::max<int>(high, block[i * 4 + channel]);
+			low = std::min<int>(low, block[i * 4 + channel]);
+		}
+		uint64_t bits = static_cast<uint64_t>(high) | (static_cast<uint64_t>(low) << 8);
+		if (high != low) {
+			int palette[8] = { high, low };
+			for (int p = 1; p < 7; p++) {
+				palette[p + 1] = ((7 - p) * high + p * low) / 7;
+			}
+			for (int i = 0; i < 16; i++) {
+				int value = block[i * 4 + channel];
+				int best = 0, bestError = INT32_MAX;
+				for (int p = 0; p < 8; p++) {
+					int error = std::abs(value - palette[p]);
+					if (error < bestError) {
+						bestError = error;
+						best = p;
+					}
+				}
+				bits |= static_cast<uint64_t>(best) << (16 + i * 3);
+			}
+		}
+		std::memcpy(out, &bits, 8);
+	}
+
+	void encodeBlock(BlockFormat format, const uint8_t block[64], uint8_t* out) {
+		switch (format) {
+		case BlockFormat::BC1:
+			encodeColorBlock(block, out);
+			break;
+		case BlockFormat::BC3:
+			encodeChannelBlock(block, 3, out);
+			encodeColorBlock(block, out + 8);
+			break;
+		case BlockFormat::BC5:
+			encodeChannelBlock(block, 0, out);
+			encodeChannelBlock(block, 1, out + 8);
+			break;
+		}
+	}
+
+	std::vector<uint8_t> encodeLevel(const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height, BlockFormat format) {
+		uint32_t blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+		auto bytesPerBlock = blockBytes(format);
+		std::vector<uint8_t> encoded(static_cast<size_t>(blocksWide) * blocksHigh * bytesPerBlock);
+		parallelFor(blocksHigh, [&](size_t by) {
+			uint8_t block[64];
+			for (uint32_t bx = 0; bx < blocksWide; bx++) {
+				extractBlock(pixels.data(), width, height, bx, static_cast<uint32_t>(by), block);
+				encodeBlock(format, block, encoded.data() + (by * blocksWide + bx) * bytesPerBlock);
+			}
+		});
+		return encoded;
+	}
+}
+
+BlockFormat chooseBlockFormat(const StbImage& image, const std::string& samplerName) {
+	if (isVectorMap(samplerName)) {
+		return BlockFormat::BC5;
+	}
+	size_t texels = static_cast<size_t>(image.getWidth()) * image.getHeight();
+	auto* pixels = image.getData();
+	for (size_t i = 0; i < texels; i++) {
+		if (pixels[i * 4 + 3] != 255) {
+			return BlockFormat::BC3;
+		}
+	}
+	return BlockFormat::BC1;
+}
+
+std::vector<uint8_t> cookTexture(const StbImage& image, const std::string& samplerName, BlockFormat format,
+	uint64_t sourceHash) {
+	uint32_t width = image.getWidth(), height = image.getHeight();
+	std::vector<uint8_t> pixels(image.getData(), image.getData() + static_cast<size_t>(width) * height * 4);
+	// Only normal maps hold unit vectors; distortion maps hold offsets, which are averaged as is.
+	bool renormalize = samplerName == "normalMap";
+
+	std::vector<std::vector<uint8_t>> levels;
+	uint32_t levelWidth = width, levelHeight = height;
+	while (true) {
+		levels.push_back(encodeLevel(pixels, levelWidth, levelHeight, format));
+		if (levelWidth == 1 && levelHeight == 1) {
+			break;
+		}
+		pixels = downsample(pixels, levelWidth, levelHeight, renormalize);
+		levelWidth = std::max(levelWidth / 2, 1u);
+		levelHeight = std::max(levelHeight / 2, 1u);
+	}
+	return CompressedTexture::serialize(format, levels, width, height, sourceHash, TEXTURE_COOKER_VERSION);
+}
+
+std::filesystem::path textureCachePath(const std::string& sourcePath, const std::string& samplerName) {
+	// Vector maps are cooked differently from color maps and from each other, so they are
+	// cached separately.
+	auto key = hashBytes(sourcePath.data(), sourcePath.size());
+	if (isVectorMap(samplerName)) {
+		key = hashBytes(samplerName.data(), samplerName.size(), key);
+	}
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << key << ".ktx2";
+	return std::filesystem::path(TEXTURE_CACHE_DIRECTORY) / name.str();
+}
+
+PreparedImage prepareImage(const std::string& path, const std::string& samplerName, bool compress) {
+	PreparedImage image;
+	uint64_t sourceHash = 0;
+	if (compress && hashFile(path, sourceHash)) {
+		auto cachePath = textureCachePath(path, samplerName);
+		image.cacheHit = image.compressed.open(cachePath) && image.compressed.sourceHash() == sourceHash
+			&& image.compressed.cookerVersion() == TEXTURE_COOKER_VERSION;
+		if (image.cacheHit) {
+			return image;
+		}
+
+		StbImage pixels;
+		pixels.loadFromFile(path);
+		auto bytes = cookTexture(pixels, samplerName, chooseBlockFormat(pixels, samplerName), sourceHash);
+		image.compressed = CompressedTexture();
+		if (writeCacheFile(cachePath, bytes) && image.compressed.open(cachePath)) {
+			return image;
+		}
+		image.compressed.adopt(std::move(bytes));
+		return image;
+	}
+	image.pixels.loadFromFile(path);
+	return image;
+}
+
+Texture uploadImage(PreparedImage&& image, const std::string& samplerName, TextureStreamer* streamer) {
+	if (image.compressed.isValid()) {
+		return streamer != nullptr
+			? streamer->enqueue(std::move(image.compressed), samplerName)
+			: Texture::loadCompressed(image.compressed, samplerName);
+	}
+	return streamer != nullptr
+		? streamer->enqueue(std::move(image.pixels), samplerName)
+		: Texture::loadImage(image.pixels, samplerName);
+}
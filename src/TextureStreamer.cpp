@@ -0,0 +1,289 @@
+#include "TextureStreamer.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	// Every slot must hold at least one row of the widest texture we expect (16384 RGBA texels).
+	const size_t MIN_SLOT_BYTES = 16384 * 4;
+	const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+}
+
+TextureStreamer::TextureStreamer(size_t budgetBytes)
+	: m_pbo(GLBuffer::create()), m_persistentMapping(nullptr), m_slotBytes(std::max(budgetBytes, MIN_SLOT_BYTES)),
+	m_budgetBytes(budgetBytes), m_frame(0), m_fences(), m_bytesStreamed(0), m_texturesCompleted(0) {
+	auto ringBytes = m_slotBytes * FRAMES_IN_FLIGHT;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo.get());
+	if (GLAD_GL_VERSION_4_4) {
+		// Map the whole ring once and keep it mapped for the streamer's lifetime.
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringBytes, nullptr, flags);
+		m_persistentMapping = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringBytes, flags));
+	}
+	else {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, ringBytes, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	GpuMemory::shared().track(GpuObject::Buffer, m_pbo.get(), GpuCategory::DynamicBuffers, ringBytes, "TextureStreamer");
+}
+
+TextureStreamer::~TextureStreamer() {
+	for (auto& fence : m_fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+		}
+	}
+	if (m_persistentMapping != nullptr) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo.get());
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+}
+
+Texture TextureStreamer::enqueue(StbImage&& image, const std::string& samplerName) {
+	auto width = image.getWidth();
+	auto height = image.getHeight();
+	auto levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+
+	auto owner = Texture::createOwner();
+	auto texId = owner->get();
+	GLState::bindTexture(texId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (GLAD_GL_VERSION_4_2) {
+		glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8, width, height);
+	}
+	else {
+		for (uint32_t level = 0; level < levels; level++) {
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, std::max(width >> level, 1), std::max(height >> level, 1),
+				0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		}
+	}
+
+	// Until the base level arrives, sample only the 1x1 top mip, filled with a neutral color
+	// (a flat normal, for normal maps).
+	const uint8_t grey[4] = { 128, 128, 128, 255 };
+	const uint8_t flatNormal[4] = { 128, 128, 255, 255 };
+	glTexSubImage2D(GL_TEXTURE_2D, levels - 1, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+		samplerName == "normalMap" ? flatNormal : grey);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+	GLState::bindTexture(0);
+
+	size_t baseBytes = static_cast<size_t>(width) * height * 4;
+	GpuMemory::shared().track(GpuObject::Texture, texId, GpuCategory::Textures, baseBytes * 4 / 3, "TextureStreamer");
+	m_pending.push_back({ texId, owner, std::move(image), CompressedTexture(), 0, 0 });
+	return Texture{ texId, samplerName, baseBytes * 4 / 3, std::move(owner) };
+}
+
+Texture TextureStreamer::enqueue(CompressedTexture&& texture, const std::string& samplerName) {
+	auto levels = static_cast<int>(texture.levelCount());
+	auto format = texture.glInternalFormat();
+
+	auto owner = Texture::createOwner();
+	auto texId = owner->get();
+	GLState::bindTexture(texId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	if (GLAD_GL_VERSION_4_2) {
+		glTexStorage2D(GL_TEXTURE_2D, levels, format, texture.width(), texture.height());
+	}
+	else {
+		for (int level = 0; level < levels; level++) {
+			auto& info = texture.level(level);
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, info.width, info.height, 0,
+				static_cast<GLsizei>(info.size), nullptr);
+		}
+	}
+
+	// The smallest level is tiny; upload it directly and sample only it until more arrive.
+	auto& smallest = texture.level(levels - 1);
+	glCompressedTexSubImage2D(GL_TEXTURE_2D, levels - 1, 0, 0, smallest.width, smallest.height, format,
+		static_cast<GLsizei>(smallest.size), texture.levelData(levels - 1));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+	GLState::bindTexture(0);
+
+	auto gpuBytes = texture.gpuBytes();
+	GpuMemory::shared().track(GpuObject::Texture, texId, GpuCategory::Textures, gpuBytes, "TextureStreamer");
+	if (levels > 1) {
+		m_pending.push_back({ texId, owner, StbImage(), std::move(texture), levels - 2, 0 });
+	}
+	else {
+		m_texturesCompleted++;
+	}
+	return Texture{ texId, samplerName, gpuBytes, std::move(owner) };
+}
+
+void TextureStreamer::update() {
+	if (m_pending.empty()) {
+		return;
+	}
+
+	// Wait until the GPU has finished reading this slot's previous contents. The fence is
+	// FRAMES_IN_FLIGHT frames old, so this rarely blocks.
+	auto slot = m_frame % FRAMES_IN_FLIGHT;
+	if (m_fences[slot] != nullptr) {
+		glClientWaitSync(m_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+		glDeleteSync(m_fences[slot]);
+		m_fences[slot] = nullptr;
+	}
+
+	auto slotOffset = slot * m_slotBytes;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo.get());
+	uint8_t* staging = m_persistentMapping != nullptr
+		? m_persistentMapping + slotOffset
+		: static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, slotOffset, m_slotBytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+
+	// Copy as many whole rows as fit in this frame's budget into the staging slot.
+	struct RowCopy {
+		uint32_t textureId;
+		int level;
+		// The region of the level being written, in texels.
+		int width;
+		int firstRow;
+		int rows;
+		// The block format for compressed data, or 0 for RGBA8 texels.
+		GLenum compressedFormat;
+		size_t bytes;
+		size_t offset;
+	};
+	struct CompletedLevel {
+		uint32_t textureId;
+		// Holds the texture of a finished upload, which leaves the queue before its rows are copied.
+		std::shared_ptr<const GLTexture> owner;
+		int level;
+		bool compressed;
+	};
+	std::vector<RowCopy> copies;
+	std::vector<CompletedLevel> completed;
+	size_t used = 0;
+	auto budget = std::min(m_budgetBytes, m_slotBytes);
+	while (!m_pending.empty()) {
+		auto& upload = m_pending.front();
+		bool compressed = upload.compressed.isValid();
+
+		// A "row" of a compressed level is one row of 4x4 blocks.
+		const uint8_t* source;
+		int width, height, texelsPerRow, totalRows;
+		size_t rowBytes;
+		if (compressed) {
+			auto& level = upload.compressed.level(upload.level);
+			source = upload.compressed.levelData(upload.level);
+			width = level.width;
+			height = level.height;
+			texelsPerRow = 4;
+			totalRows = (height + 3) / 4;
+			rowBytes = level.size / totalRows;
+		}
+		else {
+			source = upload.image.getData();
+			width = upload.image.getWidth();
+			height = upload.image.getHeight();
+			texelsPerRow = 1;
+			totalRows = height;
+			rowBytes = static_cast<size_t>(width) * 4;
+		}
+
+		auto rowsLeft = totalRows - upload.rowsUploaded;
+		auto rows = static_cast<int>(std::min<size_t>(rowsLeft, (budget - used) / rowBytes));
+		if (rows == 0 && used == 0) {
+			// Always make progress, even if a single row exceeds the budget.
+			rows = static_cast<int>(std::min<size_t>(rowsLeft, m_slotBytes / rowBytes));
+		}
+		if (rows == 0) {
+			break;
+		}
+		std::memcpy(staging + used, source + upload.rowsUploaded * rowBytes, rows * rowBytes);
+		auto firstRow = upload.rowsUploaded * texelsPerRow;
+		copies.push_back({ upload.textureId, upload.level, width, firstRow, std::min(rows * texelsPerRow, height - firstRow),
+			compressed ? upload.compressed.glInternalFormat() : 0, rows * rowBytes, used });
+		used += rows * rowBytes;
+		upload.rowsUploaded += rows;
+		if (upload.rowsUploaded == totalRows) {
+			completed.push_back({ upload.textureId, upload.owner, upload.level, compressed });
+			if (compressed && upload.level > 0) {
+				upload.level--;
+				upload.rowsUploaded = 0;
+			}
+			else {
+				m_pending.pop_front();
+			}
+		}
+	}
+	if (m_persistentMapping == nullptr) {
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	// With a pixel unpack buffer bound, the data "pointer" is an offset into the buffer.
+	for (auto& copy : copies) {
+		auto offset = reinterpret_cast<const void*>(slotOffset + copy.offset);
+		GLState::bindTexture(copy.textureId);
+		if (copy.compressedFormat != 0) {
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, copy.level, 0, copy.firstRow, copy.width, copy.rows,
+				copy.compressedFormat, static_cast<GLsizei>(copy.bytes), offset);
+		}
+		else {
+			glTexSubImage2D(GL_TEXTURE_2D, copy.level, 0, copy.firstRow, copy.width, copy.rows, GL_RGBA,
+				GL_UNSIGNED_BYTE, offset);
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	for (auto& level : completed) {
+		if (level.compressed) {
+			finishLevel(level.textureId, level.level);
+		}
+		else {
+			finish(level.textureId);
+		}
+	}
+	GLState::bindTexture(0);
+	m_bytesStreamed += used;
+	m_frame++;
+}
+
+/**
+ * @brief Makes a texture whose base level is fully uploaded visible, with a full mip chain.
+ */
+void TextureStreamer::finish(uint32_t textureId) {
+	GLState::bindTexture(textureId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	m_texturesCompleted++;
+}
+
+/**
+ * @brief Makes a fully uploaded level of a compressed texture, and the smaller ones below it,
+ * visible.
+ */
+void TextureStreamer::finishLevel(uint32_t textureId, int level) {
+	GLState::bindTexture(textureId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+	if (level == 0) {
+		m_texturesCompleted++;
+	}
+}
+
+bool TextureStreamer::idle() const {
+	return m_pending.empty();
+}
+
+size_t TextureStreamer::pendingCount() const {
+	return m_pending.size();
+}
+
+size_t TextureStreamer::bytesStreamed() const {
+	return m_bytesStreamed;
+}
+
+size_t TextureStreamer::texturesCompleted() const {
+	return m_texturesCompleted;
+}
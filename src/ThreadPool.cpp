@@ -0,0 +1,51 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+	// Whether this thread is a worker of some ThreadPool.
+	thread_local bool t_isWorker = false;
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+	: m_stopping(false) {
+	threadCount = std::max<size_t>(threadCount, 1);
+	for (size_t i = 0; i < threadCount; i++) {
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (auto& worker : m_workers) {
+		worker.join();
+	}
+}
+
+size_t ThreadPool::size() const {
+	return m_workers.size();
+}
+
+bool ThreadPool::isWorkerThread() {
+	return t_isWorker;
+}
+
+void ThreadPool::workerLoop() {
+	t_isWorker = true;
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+			if (m_tasks.empty()) {
+				return;
+			}
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
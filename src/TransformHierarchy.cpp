@@ -0,0 +1,359 @@
+#include "TransformHierarchy.h"
+#include "WorkStealingPool.h"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	// How far a matrix's axes may stray from equal lengths and right angles, relative to their
+	// squared length, for it to take the uniform scale path of normalMatrix.
+	const float UNIFORM_SCALE_TOLERANCE = 1e-5f;
+	// The fewest nodes of a level given to one thread by a parallel update.
+	const size_t PARALLEL_GRAIN = 256;
+
+	/**
+	 * @brief Reorders an array so that element i is the old element order[i].
+	 */
+	template <typename T>
+	void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+		std::vector<T> sorted;
+		sorted.reserve(order.size());
+		for (auto i : order) {
+			sorted.push_back(values[i]);
+		}
+		values.swap(sorted);
+	}
+}
+
+TransformHierarchy::TransformHierarchy()
+	: m_released(0), m_updateCount(0), m_sorted(true), m_levelsValid(true), m_dirty(false) {
+}
+
+TransformHierarchy& TransformHierarchy::shared() {
+	static TransformHierarchy hierarchy;
+	return hierarchy;
+}
+
+/**
+ * @brief Equivalent to translating by the position and center * scale, rotating around z, x and
+ * then y, scaling, and translating by -center, but composed as one 3x3 matrix and a translation
+ * rather than with a 4x4 product per step.
+ */
+glm::mat4 TransformHierarchy::localMatrix(const glm::vec3& position, const glm::vec3& orientation,
+	const glm::vec3& scale, const glm::vec3& center, const glm::mat4& baseTransform) {
+	auto cx = std::cos(orientation.x), sx = std::sin(orientation.x);
+	auto cy = std::cos(orientation.y), sy = std::sin(orientation.y);
+	auto cz = std::cos(orientation.z), sz = std::sin(orientation.z);
+	glm::mat3 rotateZ(glm::vec3(cz, sz, 0), glm::vec3(-sz, cz, 0), glm::vec3(0, 0, 1));
+	glm::mat3 rotateX(glm::vec3(1, 0, 0), glm::vec3(0, cx, sx), glm::vec3(0, -sx, cx));
+	glm::mat3 rotateY(glm::vec3(cy, 0, -sy), glm::vec3(0, 1, 0), glm::vec3(sy, 0, cy));
+	auto linear = rotateZ * rotateX * rotateY;
+	linear[0] *= scale.x;
+	linear[1] *= scale.y;
+	linear[2] *= scale.z;
+	auto translation = position + center * scale - linear * center;
+	glm::mat4 m(glm::vec4(linear[0], 0), glm::vec4(linear[1], 0), glm::vec4(linear[2], 0), glm::vec4(translation, 1));
+	return m * baseTransform;
+}
+
+/**
+ * @brief A rotation scaled by s on every axis has the inverse transpose R / s, which is the
+ * matrix itself divided by s squared. That covers most objects, and skips the inverse.
+ */
+glm::mat3 TransformHierarchy::normalMatrix(const glm::mat4& model) {
+	glm::mat3 linear(model);
+	auto lengthSquared = glm::dot(linear[0], linear[0]);
+	auto tolerance = UNIFORM_SCALE_TOLERANCE * lengthSquared;
+	bool uniform = lengthSquared > 0
+		&& std::abs(glm::dot(linear[1], linear[1]) - lengthSquared) <= tolerance
+		&& std::abs(glm::dot(linear[2], linear[2]) - lengthSquared) <= tolerance
+		&& std::abs(glm::dot(linear[0], linear[1])) <= tolerance
+		&& std::abs(glm::dot(linear[0], linear[2])) <= tolerance
+		&& std::abs(glm::dot(linear[1], linear[2])) <= tolerance;
+	if (uniform) {
+		return linear / lengthSquared;
+	}
+	return glm::transpose(glm::inverse(linear));
+}
+
+uint32_t TransformHierarchy::index(NodeId node) const {
+	if (node >= m_indices.size() || m_indices[node] == NO_NODE) {
+		throw std::runtime_error("TransformHierarchy: no node with id " + std::to_string(node));
+	}
+	return m_indices[node];
+}
+
+void TransformHierarchy::markDirty(uint32_t index) {
+	m_localDirty[index] = 1;
+	m_dirty = true;
+}
+
+/**
+ * @brief New nodes go at the end of the arrays, after any parent they are later given unless it
+ * is created after them. Ids of released nodes are reused; their slots are reclaimed by sort.
+ */
+TransformHierarchy::NodeId TransformHierarchy::create(const glm::mat4& baseTransform) {
+	NodeId id;
+	if (!m_freeIds.empty()) {
+		id = m_freeIds.back();
+		m_freeIds.pop_back();
+	}
+	else {
+		id = static_cast<NodeId>(m_indices.size());
+		m_indices.push_back(NO_NODE);
+	}
+	m_indices[id] = static_cast<uint32_t>(m_ids.size());
+
+	m_positions.emplace_back(0);
+	m_orientations.emplace_back(0);
+	m_scales.emplace_back(1);
+	m_centers.emplace_back(0);
+	m_baseTransforms.push_back(baseTransform);
+	m_localMatrices.push_back(baseTransform);
+	m_worldMatrices.push_back(baseTransform);
+	m_normalMatrices.push_back(normalMatrix(baseTransform));
+	m_parents.push_back(NO_NODE);
+	m_localDirty.push_back(1);
+	m_changed.push_back(0);
+	m_worldVersions.push_back(0);
+	m_ids.push_back(id);
+	// Parentless, it belongs in the first level.
+	m_levelsValid = false;
+	m_dirty = true;
+	return id;
+}
+
+TransformHierarchy::NodeId TransformHierarchy::clone(NodeId source) {
+	auto s = index(source);
+	// Copied first, as creating the node may move the array it is in.
+	glm::mat4 baseTransform = m_baseTransforms[s];
+	auto id = create(baseTransform);
+	auto i = m_indices[id];
+	m_positions[i] = m_positions[s];
+	m_orientations[i] = m_orientations[s];
+	m_scales[i] = m_scales[s];
+	m_centers[i] = m_centers[s];
+	return id;
+}
+
+void TransformHierarchy::release(NodeId node) {
+	auto i = index(node);
+	m_ids[i] = NO_NODE;
+	m_indices[node] = NO_NODE;
+	m_freeIds.push_back(node);
+	m_released++;
+	// Children left behind must be re-parented by the next sort.
+	m_sorted = false;
+}
+
+void TransformHierarchy::setParent(NodeId node, NodeId parent) {
+	auto i = index(node);
+	auto p = parent == NO_NODE ? NO_NODE : index(parent);
+	m_parents[i] = p;
+	if (p != NO_NODE && p > i) {
+		m_sorted = false;
+	}
+	m_levelsValid = false;
+	// Its world matrix was relative to wherever it was before.
+	markDirty(i);
+}
+
+TransformHierarchy::NodeId TransformHierarchy::getParent(NodeId node) const {
+	auto p = m_parents[index(node)];
+	return p == NO_NODE ? NO_NODE : m_ids[p];
+}
+
+const glm::vec3& TransformHierarchy::getPosition(NodeId node) const {
+	return m_positions[index(node)];
+}
+
+const glm::vec3& TransformHierarchy::getOrientation(NodeId node) const {
+	return m_orientations[index(node)];
+}
+
+const glm::vec3& TransformHierarchy::getScale(NodeId node) const {
+	return m_scales[index(node)];
+}
+
+const glm::vec3& TransformHierarchy::getCenter(NodeId node) const {
+	return m_centers[index(node)];
+}
+
+void TransformHierarchy::setPosition(NodeId node, const glm::vec3& position) {
+	auto i = index(node);
+	m_positions[i] = position;
+	markDirty(i);
+}
+
+void TransformHierarchy::setOrientation(NodeId node, const glm::vec3& orientation) {
+	auto i = index(node);
+	m_orientations[i] = orientation;
+	markDirty(i);
+}
+
+void TransformHierarchy::setScale(NodeId node, const glm::vec3& scale) {
+	auto i = index(node);
+	m_scales[i] = scale;
+	markDirty(i);
+}
+
+void TransformHierarchy::setCenter(NodeId node, const glm::vec3& center) {
+	auto i = index(node);
+	m_centers[i] = center;
+	markDirty(i);
+}
+
+/**
+ * @brief Restores parents-first order, dropping released nodes. Nodes are laid out level by
+ * level, breadth first, so that each level is a contiguous range whose nodes depend only on
+ * earlier levels, and the children of a node sit side by side; roots keep their relative order.
+ * Children of released nodes become roots, and are marked dirty.
+ */
+void TransformHierarchy::sort() {
+	auto count = static_cast<uint32_t>(m_ids.size());
+	// Gather each live node's children, in index order, as ranges of one array.
+	std::vector<uint32_t> firstChild(count + 1, 0);
+	std::vector<uint32_t> roots;
+	for (uint32_t i = 0; i < count; i++) {
+		if (m_ids[i] == NO_NODE) {
+			continue;
+		}
+		auto p = m_parents[i];
+		if (p != NO_NODE && m_ids[p] == NO_NODE) {
+			m_parents[i] = p = NO_NODE;
+			m_localDirty[i] = 1;
+		}
+		if (p == NO_NODE) {
+			roots.push_back(i);
+		}
+		else {
+			firstChild[p + 1]++;
+		}
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		firstChild[i + 1] += firstChild[i];
+	}
+	std::vector<uint32_t> children(firstChild[count]);
+	std::vector<uint32_t> filled(firstChild.begin(), firstChild.end() - 1);
+	for (uint32_t i = 0; i < count; i++) {
+		if (m_ids[i] != NO_NODE && m_parents[i] != NO_NODE) {
+			children[filled[m_parents[i]]++] = i;
+		}
+	}
+
+	// Each level is the children of the one before, in order.
+	std::vector<uint32_t> order(roots);
+	order.reserve(count - m_released);
+	m_levelStarts.assign(1, 0);
+	while (m_levelStarts.back() < order.size()) {
+		auto levelEnd = static_cast<uint32_t>(order.size());
+		for (auto i = m_levelStarts.back(); i < levelEnd; i++) {
+			auto node = order[i];
+			order.insert(order.end(), children.begin() + firstChild[node], children.begin() + firstChild[node + 1]);
+		}
+		m_levelStarts.push_back(levelEnd);
+	}
+
+	std::vector<uint32_t> newIndex(count, NO_NODE);
+	for (uint32_t i = 0; i < order.size(); i++) {
+		newIndex[order[i]] = i;
+	}
+	permute(m_positions, order);
+	permute(m_orientations, order);
+	permute(m_scales, order);
+	permute(m_centers, order);
+	permute(m_baseTransforms, order);
+	permute(m_localMatrices, order);
+	permute(m_worldMatrices, order);
+	permute(m_normalMatrices, order);
+	permute(m_parents, order);
+	permute(m_localDirty, order);
+	permute(m_changed, order);
+	permute(m_worldVersions, order);
+	permute(m_ids, order);
+	for (uint32_t i = 0; i < order.size(); i++) {
+		if (m_parents[i] != NO_NODE) {
+			m_parents[i] = newIndex[m_parents[i]];
+		}
+		m_indices[m_ids[i]] = i;
+	}
+	m_released = 0;
+	m_sorted = true;
+	m_levelsValid = true;
+	m_dirty = true;
+}
+
+/**
+ * @brief Brings nodes [begin, end) up to date, in order. Their parents must be up to date
+ * already: visited earlier in the same sweep, so that m_changed says whether they moved.
+ */
+void TransformHierarchy::sweep(size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++) {
+		auto parent = m_parents[i];
+		bool changed = m_localDirty[i] || (parent != NO_NODE && m_changed[parent]);
+		m_changed[i] = changed;
+		if (!changed) {
+			continue;
+		}
+		if (m_localDirty[i]) {
+			m_localMatrices[i] = localMatrix(m_positions[i], m_orientations[i], m_scales[i], m_centers[i],
+				m_baseTransforms[i]);
+			m_localDirty[i] = 0;
+		}
+		m_worldMatrices[i] = parent == NO_NODE ? m_localMatrices[i] : m_worldMatrices[parent] * m_localMatrices[i];
+		m_normalMatrices[i] = normalMatrix(m_worldMatrices[i]);
+		m_worldVersions[i] = m_updateCount;
+	}
+}
+
+/**
+ * @brief Sweeps the arrays front to back; each node's parent was visited before it.
+ */
+void TransformHierarchy::update() {
+	if (!m_sorted) {
+		sort();
+	}
+	if (!m_dirty) {
+		return;
+	}
+	m_updateCount++;
+	sweep(0, m_ids.size());
+	m_dirty = false;
+}
+
+/**
+ * @brief The nodes of one level depend only on those of earlier levels, so each level is
+ * split across the pool, finishing before the next starts.
+ */
+void TransformHierarchy::update(WorkStealingPool& pool) {
+	if (!m_sorted || !m_levelsValid) {
+		sort();
+	}
+	if (!m_dirty) {
+		return;
+	}
+	m_updateCount++;
+	for (size_t level = 0; level + 1 < m_levelStarts.size(); level++) {
+		auto first = m_levelStarts[level];
+		pool.parallelFor(m_levelStarts[level + 1] - first, PARALLEL_GRAIN, [this, first](size_t begin, size_t end) {
+			sweep(first + begin, first + end);
+		});
+	}
+	m_dirty = false;
+}
+
+const glm::mat4& TransformHierarchy::getWorldMatrix(NodeId node) const {
+	return m_worldMatrices[index(node)];
+}
+
+const glm::mat3& TransformHierarchy::getNormalMatrix(NodeId node) const {
+	return m_normalMatrices[index(node)];
+}
+
+uint32_t TransformHierarchy::getWorldVersion(NodeId node) const {
+	return m_worldVersions[index(node)];
+}
+
+size_t TransformHierarchy::size() const {
+	return m_ids.size() - m_released;
+}
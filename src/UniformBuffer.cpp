@@ -0,0 +1,42 @@
+#include "UniformBuffer.h"
+#include <glad/glad.h>
+#include "GpuMemory.h"
+#include <algorithm>
+#include <stdexcept>
+
+int32_t uniformBlockBinding(std::string_view blockName) {
+	if (blockName == "FrameUniforms") {
+		return FRAME_UNIFORMS_BINDING;
+	}
+	if (blockName == "LightingUniforms") {
+		return LIGHTING_UNIFORMS_BINDING;
+	}
+	return -1;
+}
+
+UniformBuffer::UniformBuffer(uint32_t binding, size_t blockSize, size_t slotCount)
+	: m_buffer(GLBuffer::create()), m_binding(binding), m_blockSize(blockSize), m_stride(blockSize), m_slotCount(slotCount) {
+	GLint alignment = 1;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment = std::max(alignment, 1);
+	m_stride = (blockSize + alignment - 1) / alignment * alignment;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_buffer.get());
+	glBufferData(GL_UNIFORM_BUFFER, m_stride * m_slotCount, nullptr, GL_DYNAMIC_DRAW);
+	GpuMemory::shared().track(GpuObject::Buffer, m_buffer.get(), GpuCategory::DynamicBuffers, m_stride * m_slotCount,
+		"UniformBuffer");
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::updateBytes(size_t slot, const void* data, size_t size) {
+	if (size != m_blockSize || slot >= m_slotCount) {
+		throw std::runtime_error("Uniform block update does not fit the buffer");
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, m_buffer.get());
+	glBufferSubData(GL_UNIFORM_BUFFER, slot * m_stride, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind(size_t slot) const {
+	glBindBufferRange(GL_UNIFORM_BUFFER, m_binding, m_buffer.get(), slot * m_stride, m_blockSize);
+}
@@ -0,0 +1,156 @@
+#include "VertexPacking.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	const float QUANTIZED_MAX = 32767.0f;
+	const float NORMAL_MAX = 511.0f;
+
+	uint32_t packNormalComponent(float value) {
+		auto quantized = static_cast<int32_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * NORMAL_MAX));
+		return static_cast<uint32_t>(quantized) & 0x3ff;
+	}
+
+	float unpackNormalComponent(uint32_t packed, int shift) {
+		// Sign-extend the 10-bit field.
+		auto value = static_cast<int32_t>(packed << (22 - shift)) >> 22;
+		return std::max(value / NORMAL_MAX, -1.0f);
+	}
+}
+
+uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+	auto exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (((bits >> 23) & 0xff) == 0xff) {
+		// Infinity or NaN.
+		return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+	}
+	if (exponent >= 31) {
+		return sign | 0x7c00;
+	}
+	if (exponent <= 0) {
+		// Subnormal half, or too small for one.
+		if (exponent < -10) {
+			return sign;
+		}
+		mantissa |= 0x800000;
+		auto shift = 14 - exponent;
+		auto half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1) {
+			half++;
+		}
+		return sign | static_cast<uint16_t>(half);
+	}
+	auto half = static_cast<uint32_t>(sign) | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	// Round to nearest; a carry out of the mantissa correctly bumps the exponent.
+	if (mantissa & 0x1000) {
+		half++;
+	}
+	return static_cast<uint16_t>(half);
+}
+
+float halfToFloat(uint16_t half) {
+	uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+	uint32_t bits;
+	if (exponent == 0) {
+		// Zero or subnormal: the value is mantissa * 2^-24.
+		float value = std::ldexp(static_cast<float>(mantissa), -24);
+		return sign != 0 ? -value : value;
+	}
+	if (exponent == 31) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else {
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+VertexQuantization quantizationFor(const std::vector<Vertex3D>& vertices) {
+	if (vertices.empty()) {
+		return { glm::vec3(1), glm::vec3(0) };
+	}
+	glm::vec3 low(vertices[0].x, vertices[0].y, vertices[0].z), high = low;
+	for (auto& v : vertices) {
+		low = glm::min(low, glm::vec3(v.x, v.y, v.z));
+		high = glm::max(high, glm::vec3(v.x, v.y, v.z));
+	}
+	VertexQuantization quantization;
+	quantization.offset = (low + high) * 0.5f;
+	quantization.scale = (high - low) * 0.5f / QUANTIZED_MAX;
+	for (int axis = 0; axis < 3; axis++) {
+		// A flat axis quantizes every vertex to 0; any nonzero scale decodes that to the offset.
+		if (quantization.scale[axis] <= 0) {
+			quantization.scale[axis] = 1;
+		}
+	}
+	return quantization;
+}
+
+PackedVertex3D packVertex(const Vertex3D& vertex, const VertexQuantization& quantization) {
+	auto quantize = [&](float value, int axis) {
+		auto q = std::lround((value - quantization.offset[axis]) / quantization.scale[axis]);
+		return static_cast<int16_t>(std::clamp<long>(q, -32767, 32767));
+	};
+	PackedVertex3D packed{};
+	packed.x = quantize(vertex.x, 0);
+	packed.y = quantize(vertex.y, 1);
+	packed.z = quantize(vertex.z, 2);
+	packed.normal = packNormalComponent(vertex.nx) | (packNormalComponent(vertex.ny) << 10)
+		| (packNormalComponent(vertex.nz) << 20);
+	packed.u = floatToHalf(vertex.u);
+	packed.v = floatToHalf(vertex.v);
+	return packed;
+}
+
+Vertex3D unpackVertex(const PackedVertex3D& vertex, const VertexQuantization& quantization) {
+	return Vertex3D(
+		vertex.x * quantization.scale.x + quantization.offset.x,
+		vertex.y * quantization.scale.y + quantization.offset.y,
+		vertex.z * quantization.scale.z + quantization.offset.z,
+		unpackNormalComponent(vertex.normal, 0),
+		unpackNormalComponent(vertex.normal, 10),
+		unpackNormalComponent(vertex.normal, 20),
+		halfToFloat(vertex.u),
+		halfToFloat(vertex.v));
+}
+
+bool packVertices(const std::vector<Vertex3D>& vertices, const PackingTolerance& tolerance,
+	std::vector<PackedVertex3D>& packed, VertexQuantization& quantization, PackingError& error) {
+	quantization = quantizationFor(vertices);
+	error = PackingError{ 0, 0, 0 };
+	packed.clear();
+	packed.reserve(vertices.size());
+	glm::vec3 low(0), high(0);
+	if (!vertices.empty()) {
+		low = high = glm::vec3(vertices[0].x, vertices[0].y, vertices[0].z);
+	}
+	for (auto& vertex : vertices) {
+		low = glm::min(low, glm::vec3(vertex.x, vertex.y, vertex.z));
+		high = glm::max(high, glm::vec3(vertex.x, vertex.y, vertex.z));
+		packed.push_back(packVertex(vertex, quantization));
+		auto decoded = unpackVertex(packed.back(), quantization);
+		error.position = std::max({ error.position, std::fabs(decoded.x - vertex.x),
+			std::fabs(decoded.y - vertex.y), std::fabs(decoded.z - vertex.z) });
+		error.normal = std::max({ error.normal, std::fabs(decoded.nx - vertex.nx),
+			std::fabs(decoded.ny - vertex.ny), std::fabs(decoded.nz - vertex.nz) });
+		error.texCoord = std::max({ error.texCoord, std::fabs(decoded.u - vertex.u), std::fabs(decoded.v - vertex.v) });
+	}
+	auto diagonal = glm::length(high - low);
+	bool withinTolerance = error.position <= tolerance.position * diagonal
+		&& error.normal <= tolerance.normal
+		&& error.texCoord <= tolerance.texCoord;
+	if (!withinTolerance) {
+		packed.clear();
+	}
+	return withinTolerance;
+}
@@ -0,0 +1,174 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+
+namespace {
+	// How many times an idle worker looks for tasks, yielding in between, before it sleeps. Jobs
+	// come in bursts within a frame, and waking a sleeping thread costs more than a few looks.
+	const int SPIN_ATTEMPTS = 64;
+
+	// The pool whose worker this thread is, if any, and the worker's queue.
+	thread_local const void* t_pool = nullptr;
+	thread_local size_t t_queue = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t threadCount)
+	: m_queued(0), m_sleeping(0), m_stopping(false) {
+	for (size_t i = 0; i <= threadCount; i++) {
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+	for (size_t i = 0; i < threadCount; i++) {
+		m_workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (auto& worker : m_workers) {
+		worker.join();
+	}
+}
+
+size_t WorkStealingPool::size() const {
+	return m_workers.size() + 1;
+}
+
+size_t WorkStealingPool::queueIndex() const {
+	return t_pool == this ? t_queue : m_queues.size() - 1;
+}
+
+/**
+ * @brief Queues a task, waking a sleeping worker if there is one. The mutex is taken before
+ * notifying so that a worker between checking m_queued and waiting can't miss the wake up.
+ */
+void WorkStealingPool::push(size_t queue, const Task& task) {
+	{
+		std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+		m_queues[queue]->tasks.push_back(task);
+	}
+	m_queued++;
+	if (m_sleeping.load() > 0) {
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+		m_wake.notify_one();
+	}
+}
+
+/**
+ * @brief Takes the newest task from a thread's own queue: the smallest, and the one whose
+ * items are most likely still in its cache.
+ */
+bool WorkStealingPool::pop(size_t queue, Task& task) {
+	auto& q = *m_queues[queue];
+	std::lock_guard<std::mutex> lock(q.mutex);
+	if (q.tasks.empty()) {
+		return false;
+	}
+	task = q.tasks.back();
+	q.tasks.pop_back();
+	m_queued--;
+	return true;
+}
+
+/**
+ * @brief Takes the oldest task from another thread's queue, which is the largest piece left.
+ */
+bool WorkStealingPool::steal(size_t queue, Task& task) {
+	for (size_t offset = 1; offset < m_queues.size(); offset++) {
+		auto& q = *m_queues[(queue + offset) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			task = q.tasks.front();
+			q.tasks.pop_front();
+			m_queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Splits a task down to its job's grain, queueing the upper halves for this thread or
+ * thieves, and runs the piece that is left. The job may be destroyed as soon as its remaining
+ * count reaches zero, so it isn't touched after that.
+ */
+void WorkStealingPool::run(size_t queue, Task task) {
+	auto& job = *task.job;
+	while (task.end - task.begin > job.grain) {
+		auto middle = task.begin + (task.end - task.begin) / 2;
+		push(queue, Task{ &job, middle, task.end });
+		task.end = middle;
+	}
+	try {
+		(*job.body)(task.begin, task.end);
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(job.errorMutex);
+		if (!job.error) {
+			job.error = std::current_exception();
+		}
+	}
+	job.remaining.fetch_sub(task.end - task.begin);
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+	t_pool = this;
+	t_queue = index;
+	int idle = 0;
+	while (true) {
+		Task task;
+		if (pop(index, task) || steal(index, task)) {
+			run(index, task);
+			idle = 0;
+			continue;
+		}
+		if (++idle < SPIN_ATTEMPTS) {
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_sleeping++;
+		m_wake.wait(lock, [this]() { return m_stopping || m_queued.load() > 0; });
+		m_sleeping--;
+		if (m_stopping) {
+			return;
+		}
+		idle = 0;
+	}
+}
+
+/**
+ * @brief While the job is unfinished, the calling thread runs tasks too, from its own queue
+ * first and then stolen, which may belong to other jobs when parallelFor is nested.
+ */
+void WorkStealingPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+	grain = std::max<size_t>(grain, 1);
+	if (count <= grain || m_workers.empty()) {
+		if (count > 0) {
+			body(0, count);
+		}
+		return;
+	}
+	Job job;
+	job.body = &body;
+	job.grain = grain;
+	job.remaining = count;
+	auto queue = queueIndex();
+	run(queue, Task{ &job, 0, count });
+	while (job.remaining.load() > 0) {
+		Task task;
+		if (pop(queue, task) || steal(queue, task)) {
+			run(queue, task);
+		}
+		else {
+			std::this_thread::yield();
+		}
+	}
+	if (job.error) {
+		std::rethrow_exception(job.error);
+	}
+}
@@ -0,0 +1,50 @@
+/**
+Prints the post-transform vertex cache efficiency of every mesh of every model under a
+directory (models/ by default), before and after the import-time mesh optimizations.
+	Usage: MeshReport [directory]
+*/
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+
+#include "AssimpImport.h"
+#include "MeshOptimizer.h"
+
+int main(int argc, char** argv) {
+	std::filesystem::path root = argc > 1 ? argv[1] : "models";
+	std::vector<std::filesystem::path> models;
+	for (auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+		auto extension = entry.path().extension().string();
+		if (extension == ".obj" || extension == ".gltf" || extension == ".glb" || extension == ".fbx") {
+			models.push_back(entry.path());
+		}
+	}
+	std::sort(models.begin(), models.end());
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "Vertex cache: FIFO, " << VERTEX_CACHE_SIZE << " entries" << std::endl;
+	for (auto& path : models) {
+		ModelData model;
+		try {
+			model = assimpConvert(path.string(), assimpImportFlags(true));
+		}
+		catch (std::exception& e) {
+			std::cout << path.string() << ": " << e.what() << std::endl;
+			continue;
+		}
+		std::cout << path.string() << std::endl;
+		for (size_t i = 0; i < model.meshes.size(); i++) {
+			auto& mesh = model.meshes[i];
+			auto triangles = mesh.indices.size() / 3;
+			auto start = std::chrono::steady_clock::now();
+			auto report = optimizeMesh(mesh.vertices, mesh.indices);
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			std::cout << "  mesh " << i << ": " << triangles << " triangles, ACMR " << report.before.acmr
+				<< " -> " << report.after.acmr << ", ATVR " << report.before.atvr << " -> " << report.after.atvr
+				<< " (" << elapsed.count() << " ms)" << std::endl;
+		}
+	}
+	return 0;
+}
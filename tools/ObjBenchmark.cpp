@@ -0,0 +1,86 @@
+/**
+Times the built-in OBJ parser against Assimp on every .obj model under a directory (models/ by
+default). Both produce unoptimized CPU-side model data with the import flags the application
+uses; the OBJ parser runs on one thread and on every hardware thread.
+	Usage: ObjBenchmark [directory] [runs]
+*/
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "AssimpImport.h"
+#include "ObjImport.h"
+
+namespace {
+	struct Timing {
+		double milliseconds;
+		size_t meshes;
+		size_t vertices;
+		size_t triangles;
+	};
+
+	/**
+	 * @brief Runs an import several times, returning the median time and the size of the result.
+	 */
+	Timing time(const std::function<ModelData()>& import, int runs) {
+		std::vector<double> times;
+		Timing timing{};
+		for (int run = 0; run < runs; run++) {
+			auto start = std::chrono::steady_clock::now();
+			auto model = import();
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			times.push_back(elapsed.count());
+			timing.meshes = model.meshes.size();
+			timing.vertices = timing.triangles = 0;
+			for (auto& mesh : model.meshes) {
+				timing.vertices += mesh.vertices.size();
+				timing.triangles += mesh.indices.size() / 3;
+			}
+		}
+		std::sort(times.begin(), times.end());
+		timing.milliseconds = times[times.size() / 2];
+		return timing;
+	}
+
+	void print(const std::string& name, const Timing& timing, double baseline) {
+		std::cout << "  " << std::left << std::setw(16) << name << std::right << std::setw(10) << timing.milliseconds
+			<< " ms" << std::setw(8) << baseline / timing.milliseconds << "x  " << timing.meshes << " meshes, "
+			<< timing.vertices << " vertices, " << timing.triangles << " triangles" << std::endl;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::filesystem::path root = argc > 1 ? argv[1] : "models";
+	int runs = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 5;
+	std::vector<std::filesystem::path> models;
+	for (auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+		if (entry.path().extension() == ".obj") {
+			models.push_back(entry.path());
+		}
+	}
+	std::sort(models.begin(), models.end());
+
+	auto flags = assimpImportFlags(true);
+	auto threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "Median of " << runs << " runs" << std::endl;
+	for (auto& path : models) {
+		auto file = path.string();
+		std::cout << file << " (" << std::filesystem::file_size(path) / 1024 << " KB)" << std::endl;
+		try {
+			auto assimp = time([&]() { return assimpConvert(file, flags); }, runs);
+			print("Assimp", assimp, assimp.milliseconds);
+			print("OBJ, 1 thread", time([&]() { return objConvert(file, flags, 1); }, runs), assimp.milliseconds);
+			print("OBJ, " + std::to_string(threads) + " threads",
+				time([&]() { return objConvert(file, flags, threads); }, runs), assimp.milliseconds);
+		}
+		catch (std::exception& e) {
+			std::cout << "  " << e.what() << std::endl;
+		}
+	}
+	return 0;
+}
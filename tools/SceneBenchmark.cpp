@@ -0,0 +1,293 @@
+/**
+Renders the lake scene offscreen, without a window or display, for a fixed number of frames and
+writes how long each took to a JSON file. The scene advances by a fixed timestep and the camera
+follows a scripted orbit of the lake, so every run draws the same frames: runs differ only in
+how long they took. The OpenGL context is an EGL surfaceless one, which Mesa provides on machines
+with no GPU through llvmpipe.
+Each frame records the CPU time to update the scene and submit its passes, the GPU time between
+timestamps taken around the frame, and the wall time until the GPU finished it. The summary
+gives the median, 95th and 99th percentile, maximum and mean of each.
+	Usage: SceneBenchmark [frames] [output file] [width] [height]
+*/
+#define _USE_MATH_DEFINES
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "CompressedTexture.h"
+#include "GLState.h"
+#include "LakeScene.h"
+#include "ModelRegistry.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+namespace {
+	const size_t DEFAULT_FRAMES = 600;
+	const uint32_t DEFAULT_WIDTH = 1200;
+	const uint32_t DEFAULT_HEIGHT = 800;
+	const float TIMESTEP = 1 / 60.0f;
+	// Frames drawn before timing starts, from the first frame's camera without advancing the
+	// scene, so that shader and driver warm-up isn't counted.
+	const size_t WARMUP_FRAMES = 10;
+	// The camera circles the lake once over this many seconds of scene time, bobbing up and
+	// down, starting from the application's default view.
+	const float ORBIT_SECONDS = 20.0f;
+	const float ORBIT_RADIUS = 7.07f;
+	const float ORBIT_HEIGHT = 3.0f;
+	const float ORBIT_BOB = 1.5f;
+
+	struct FrameTiming {
+		float time;
+		double cpuMs;
+		double gpuMs;
+		double frameMs;
+		size_t drawCalls;
+		size_t trianglesDrawn;
+	};
+
+	/**
+	 * @brief Holds an EGL surfaceless context current for the thread that created it.
+	 */
+	class HeadlessContext {
+	private:
+		EGLDisplay m_display;
+		EGLContext m_context;
+
+	public:
+		HeadlessContext() : m_display(EGL_NO_DISPLAY), m_context(EGL_NO_CONTEXT) {
+			auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+				eglGetProcAddress("eglGetPlatformDisplayEXT"));
+			if (getPlatformDisplay != nullptr) {
+				m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			}
+			if (m_display == EGL_NO_DISPLAY) {
+				m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+			}
+			EGLint major, minor;
+			if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+				throw std::runtime_error("Failed to initialize an EGL display");
+			}
+			eglBindAPI(EGL_OPENGL_API);
+
+			// The newest core context the driver offers, down to the 3.3 the engine needs.
+			const EGLint versions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 3 }, { 3, 3 } };
+			for (auto& version : versions) {
+				const EGLint attributes[] = {
+					EGL_CONTEXT_MAJOR_VERSION, version[0],
+					EGL_CONTEXT_MINOR_VERSION, version[1],
+					EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+					EGL_NONE
+				};
+				m_context = eglCreateContext(m_display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+				if (m_context != EGL_NO_CONTEXT) {
+					break;
+				}
+			}
+			if (m_context == EGL_NO_CONTEXT || !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+				eglTerminate(m_display);
+				throw std::runtime_error("Failed to create a surfaceless OpenGL 3.3 context");
+			}
+		}
+
+		~HeadlessContext() {
+			eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(m_display, m_context);
+			eglTerminate(m_display);
+		}
+
+		HeadlessContext(const HeadlessContext&) = delete;
+		HeadlessContext& operator=(const HeadlessContext&) = delete;
+	};
+
+	/**
+	 * @brief A framebuffer with color and depth renderbuffers, standing in for a window's.
+	 */
+	class OffscreenTarget {
+	private:
+		uint32_t m_framebuffer;
+		uint32_t m_renderbuffers[2];
+
+	public:
+		OffscreenTarget(uint32_t width, uint32_t height) {
+			glGenFramebuffers(1, &m_framebuffer);
+			GLState::bindFramebuffer(m_framebuffer);
+			glGenRenderbuffers(2, m_renderbuffers);
+			glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[0]);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffers[0]);
+			glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[1]);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_renderbuffers[1]);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				throw std::runtime_error("Offscreen framebuffer is incomplete");
+			}
+			glViewport(0, 0, width, height);
+		}
+
+		~OffscreenTarget() {
+			GLState::bindFramebuffer(0);
+			glDeleteFramebuffers(1, &m_framebuffer);
+			glDeleteRenderbuffers(2, m_renderbuffers);
+		}
+
+		OffscreenTarget(const OffscreenTarget&) = delete;
+		OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+		uint32_t framebuffer() const {
+			return m_framebuffer;
+		}
+	};
+
+	/**
+	 * @brief Where the camera is at the given scene time.
+	 */
+	glm::vec3 cameraPosition(float time) {
+		float angle = static_cast<float>(M_PI / 4 + 2 * M_PI * time / ORBIT_SECONDS);
+		return glm::vec3(ORBIT_RADIUS * cos(angle), ORBIT_HEIGHT + ORBIT_BOB * sin(2 * angle),
+			ORBIT_RADIUS * sin(angle));
+	}
+
+	double milliseconds(std::chrono::steady_clock::duration duration) {
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+	/**
+	 * @brief Writes the percentiles and mean of one timing of every frame as a JSON object.
+	 */
+	void writeSummary(std::ostream& out, const std::vector<FrameTiming>& frames, double FrameTiming::* timing) {
+		RollingDurations durations(frames.size());
+		double total = 0;
+		for (auto& frame : frames) {
+			durations.add(static_cast<float>(frame.*timing));
+			total += frame.*timing;
+		}
+		auto percentiles = durations.percentiles();
+		out << "{\"p50\":" << percentiles.p50 << ",\"p95\":" << percentiles.p95 << ",\"p99\":" << percentiles.p99
+			<< ",\"max\":" << percentiles.max << ",\"mean\":" << total / frames.size() << "}";
+	}
+
+	void writeResults(const std::string& path, const std::vector<FrameTiming>& frames, uint32_t width, uint32_t height) {
+		std::ofstream out(path);
+		if (!out) {
+			throw std::runtime_error("Failed to write " + path);
+		}
+		out << "{\n\"renderer\":\"" << reinterpret_cast<const char*>(glGetString(GL_RENDERER)) << "\",\n"
+			<< "\"width\":" << width << ",\"height\":" << height << ",\"frames\":" << frames.size()
+			<< ",\"timestep\":" << TIMESTEP << ",\n\"summary\":{\n\"cpu_ms\":";
+		writeSummary(out, frames, &FrameTiming::cpuMs);
+		out << ",\n\"gpu_ms\":";
+		writeSummary(out, frames, &FrameTiming::gpuMs);
+		out << ",\n\"frame_ms\":";
+		writeSummary(out, frames, &FrameTiming::frameMs);
+		out << "\n},\n\"per_frame\":[";
+		for (size_t i = 0; i < frames.size(); i++) {
+			auto& frame = frames[i];
+			out << (i == 0 ? "\n" : ",\n") << "{\"frame\":" << i << ",\"time\":" << frame.time << ",\"cpu_ms\":"
+				<< frame.cpuMs << ",\"gpu_ms\":" << frame.gpuMs << ",\"frame_ms\":" << frame.frameMs
+				<< ",\"draw_calls\":" << frame.drawCalls << ",\"triangles\":" << frame.trianglesDrawn << "}";
+		}
+		out << "\n]}\n";
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t frameCount = argc > 1 ? std::stoul(argv[1]) : DEFAULT_FRAMES;
+	std::string outputPath = argc > 2 ? argv[2] : "scene_benchmark.json";
+	uint32_t width = argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : DEFAULT_WIDTH;
+	uint32_t height = argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : DEFAULT_HEIGHT;
+	if (frameCount == 0) {
+		std::cerr << "Usage: SceneBenchmark [frames] [output file] [width] [height]" << std::endl;
+		return 1;
+	}
+
+	try {
+		HeadlessContext context;
+		if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+			throw std::runtime_error("Failed to load OpenGL functions");
+		}
+		std::cout << "Renderer: " << glGetString(GL_RENDERER) << " (OpenGL " << glGetString(GL_VERSION) << ")" << std::endl;
+
+		// Textures are uploaded as their models load rather than streamed in, so every frame
+		// draws them all.
+		GeometryArena geometry;
+		ModelRegistry models;
+		models.setTextureCompression(CompressedTexture::isSupported());
+		models.setGeometryArena(&geometry);
+		auto loadStart = std::chrono::steady_clock::now();
+		{
+			ThreadPool loaders;
+			models.preload(LakeScene::modelPaths(), true, loaders);
+		}
+		WorkStealingPool frameWorkers;
+		OffscreenTarget target(width, height);
+		LakeScene scene(models, frameWorkers, width, height, CompressedTexture::isSupported());
+		std::cout << "Scene loaded in " << milliseconds(std::chrono::steady_clock::now() - loadStart) << " ms"
+			<< std::endl;
+
+		GpuProfiler gpuProfiler;
+		glm::vec3 center(0, 0, 0);
+		glm::vec3 up(0, 1, 0);
+		// Sweep the transforms once without advancing time, so the warm-up frames draw with
+		// the first frame's world matrices and bounds.
+		scene.update(0);
+		for (size_t i = 0; i < WARMUP_FRAMES; i++) {
+			scene.render(cameraPosition(0), center, up, target.framebuffer(), gpuProfiler);
+			PROFILE_FRAME(gpuProfiler);
+		}
+		glFinish();
+
+		// Timestamps around each frame, rather than GL_TIME_ELAPSED, which the passes' GPU
+		// profiling scopes already use and which can't nest.
+		uint32_t timestamps[2];
+		glGenQueries(2, timestamps);
+		std::vector<FrameTiming> frames;
+		frames.reserve(frameCount);
+		for (size_t i = 0; i < frameCount; i++) {
+			glQueryCounter(timestamps[0], GL_TIMESTAMP);
+			auto frameStart = std::chrono::steady_clock::now();
+			{
+				PROFILE_SCOPE("frame update");
+				scene.update(TIMESTEP);
+			}
+			scene.render(cameraPosition(scene.time()), center, up, target.framebuffer(), gpuProfiler);
+			auto submitted = std::chrono::steady_clock::now();
+			glQueryCounter(timestamps[1], GL_TIMESTAMP);
+			glFinish();
+			auto finished = std::chrono::steady_clock::now();
+
+			GLuint64 gpuStart, gpuEnd;
+			glGetQueryObjectui64v(timestamps[0], GL_QUERY_RESULT, &gpuStart);
+			glGetQueryObjectui64v(timestamps[1], GL_QUERY_RESULT, &gpuEnd);
+			FrameTiming frame{ scene.time(), milliseconds(submitted - frameStart), (gpuEnd - gpuStart) / 1e6,
+				milliseconds(finished - frameStart), 0, 0 };
+			for (auto& pass : scene.passes()) {
+				frame.drawCalls += pass.stats.drawCalls;
+				frame.trianglesDrawn += pass.trianglesDrawn;
+			}
+			frames.push_back(frame);
+			PROFILE_FRAME(gpuProfiler);
+		}
+		glDeleteQueries(2, timestamps);
+
+		writeResults(outputPath, frames, width, height);
+		std::cout << "Wrote " << frames.size() << " frames to " << outputPath << std::endl;
+		writeSummary(std::cout, frames, &FrameTiming::frameMs);
+		std::cout << " ms per frame" << std::endl;
+#ifdef GRAPHICS_PROFILING
+		Profiler::shared().printReport(std::cout);
+#endif
+	}
+	catch (std::runtime_error& e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,225 @@
+/**
+Times world matrix updates of scene hierarchies of 10k to 100k nodes, each a complete tree with
+four children per node. A tree of nodes that each own their transform and children, updated by
+a recursive descent as Object3D used to be, is compared with a TransformHierarchy, updated by
+one sweep over its arrays, and with Object3Ds over a TransformHierarchy, which also refresh
+their bounds. Every node is rotated before each update, or only one in a hundred.
+Then scenes of thousands of small animated objects, one rotation animator each, are updated
+by FrameUpdate on 1, 2, 4... threads, up to one per hardware thread by default.
+	Usage: TransformBenchmark [runs] [max threads]
+*/
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "FrameUpdate.h"
+#include "Object3D.h"
+#include "TransformHierarchy.h"
+
+namespace {
+	const size_t NODE_COUNTS[] = { 10000, 25000, 50000, 100000 };
+	const size_t CHILDREN_PER_NODE = 4;
+	// The share of nodes rotated before each partial update.
+	const size_t PARTIAL_DIVISOR = 100;
+	const glm::vec3 ROTATION(0.001f, 0.002f, 0.0f);
+	// The nodes of each animated object: a root, its children and grandchildren.
+	const size_t ANIMATED_OBJECT_NODES = 1 + CHILDREN_PER_NODE + CHILDREN_PER_NODE * CHILDREN_PER_NODE;
+	const float ANIMATION_SECONDS = 1e6f;
+	const float FRAME_SECONDS = 1 / 60.0f;
+
+	/**
+	 * @brief A node of the tree the hierarchy is compared against, which keeps its transform and
+	 * children together as Object3D did.
+	 */
+	struct TreeNode {
+		glm::vec3 position;
+		glm::vec3 orientation;
+		glm::vec3 scale;
+		glm::vec3 center;
+		glm::mat4 baseTransform;
+		glm::mat4 worldMatrix;
+		glm::mat3 normalMatrix;
+		std::vector<TreeNode> children;
+	};
+
+	/**
+	 * @brief Places node i of a tree laid out breadth first with CHILDREN_PER_NODE children each.
+	 */
+	glm::vec3 nodePosition(size_t i) {
+		return glm::vec3(static_cast<float>(i % CHILDREN_PER_NODE), 1, 0);
+	}
+
+	TreeNode buildTree(size_t i, size_t count) {
+		TreeNode node{ nodePosition(i), glm::vec3(0), glm::vec3(1), glm::vec3(0), glm::mat4(1), glm::mat4(1),
+			glm::mat3(1), {} };
+		for (size_t c = i * CHILDREN_PER_NODE + 1; c <= i * CHILDREN_PER_NODE + CHILDREN_PER_NODE && c < count; c++) {
+			node.children.push_back(buildTree(c, count));
+		}
+		return node;
+	}
+
+	void updateTree(TreeNode& node, const glm::mat4& parentMatrix) {
+		node.worldMatrix = parentMatrix * TransformHierarchy::localMatrix(node.position, node.orientation, node.scale,
+			node.center, node.baseTransform);
+		node.normalMatrix = TransformHierarchy::normalMatrix(node.worldMatrix);
+		for (auto& child : node.children) {
+			updateTree(child, node.worldMatrix);
+		}
+	}
+
+	void collectTree(TreeNode& node, std::vector<TreeNode*>& nodes) {
+		nodes.push_back(&node);
+		for (auto& child : node.children) {
+			collectTree(child, nodes);
+		}
+	}
+
+	Object3D buildObject(size_t i, size_t count, TransformHierarchy& transforms) {
+		Object3D object(std::vector<Mesh3D>{}, glm::mat4(1), transforms);
+		object.setPosition(nodePosition(i));
+		for (size_t c = i * CHILDREN_PER_NODE + 1; c <= i * CHILDREN_PER_NODE + CHILDREN_PER_NODE && c < count; c++) {
+			object.addChild(buildObject(c, count, transforms));
+		}
+		return object;
+	}
+
+	void collectObjects(Object3D& object, std::vector<Object3D*>& objects) {
+		objects.push_back(&object);
+		for (size_t i = 0; i < object.numberOfChildren(); i++) {
+			collectObjects(object.getChild(i), objects);
+		}
+	}
+
+	/**
+	 * @brief Picks the nodes rotated before a partial update, the same for every representation.
+	 */
+	std::vector<size_t> pickMoved(size_t count) {
+		std::mt19937 random(1);
+		std::uniform_int_distribution<size_t> node(0, count - 1);
+		std::vector<size_t> moved(count / PARTIAL_DIVISOR);
+		for (auto& m : moved) {
+			m = node(random);
+		}
+		return moved;
+	}
+
+	/**
+	 * @brief Runs an update several times, returning the median time in milliseconds.
+	 */
+	double time(const std::function<void()>& update, int runs) {
+		// Once untimed, so lazy work like sorting the hierarchy isn't counted.
+		update();
+		std::vector<double> times;
+		for (int run = 0; run < runs; run++) {
+			auto start = std::chrono::steady_clock::now();
+			update();
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			times.push_back(elapsed.count());
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	void report(const std::string& name, size_t count, double milliseconds) {
+		std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(10) << milliseconds << " ms" << std::setprecision(1)
+			<< std::setw(10) << milliseconds * 1e6 / count << " ns/node";
+		// An update with nothing to do may finish within the clock's resolution.
+		if (milliseconds > 0) {
+			std::cout << std::setw(10) << count / (milliseconds * 1e3) << " M nodes/s";
+		}
+		std::cout << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	int runs = argc > 1 ? std::max(1, std::stoi(argv[1])) : 21;
+	size_t maxThreads = argc > 2 ? std::max(1, std::stoi(argv[2])) : std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (auto count : NODE_COUNTS) {
+		std::cout << count << " nodes" << std::endl;
+		auto moved = pickMoved(count);
+
+		auto tree = buildTree(0, count);
+		std::vector<TreeNode*> treeNodes;
+		collectTree(tree, treeNodes);
+		report("  recursive tree, all moved", count, time([&] {
+			for (auto node : treeNodes) {
+				node->orientation += ROTATION;
+			}
+			updateTree(tree, glm::mat4(1));
+		}, runs));
+
+		TransformHierarchy hierarchy;
+		std::vector<TransformHierarchy::NodeId> nodes(count);
+		for (size_t i = 0; i < count; i++) {
+			nodes[i] = hierarchy.create();
+			hierarchy.setPosition(nodes[i], nodePosition(i));
+			if (i > 0) {
+				hierarchy.setParent(nodes[i], nodes[(i - 1) / CHILDREN_PER_NODE]);
+			}
+		}
+		report("  hierarchy, all moved", count, time([&] {
+			for (auto node : nodes) {
+				hierarchy.setOrientation(node, hierarchy.getOrientation(node) + ROTATION);
+			}
+			hierarchy.update();
+		}, runs));
+		report("  hierarchy, 1% moved", count, time([&] {
+			for (auto m : moved) {
+				hierarchy.setOrientation(nodes[m], hierarchy.getOrientation(nodes[m]) + ROTATION);
+			}
+			hierarchy.update();
+		}, runs));
+		report("  hierarchy, none moved", count, time([&] { hierarchy.update(); }, runs));
+
+		TransformHierarchy objectTransforms;
+		auto root = buildObject(0, count, objectTransforms);
+		std::vector<Object3D*> objects;
+		collectObjects(root, objects);
+		report("  Object3D, all moved", count, time([&] {
+			for (auto object : objects) {
+				object->rotate(ROTATION);
+			}
+			root.updateWorld();
+		}, runs));
+		report("  Object3D, 1% moved", count, time([&] {
+			for (auto m : moved) {
+				objects[m]->rotate(ROTATION);
+			}
+			root.updateWorld();
+		}, runs));
+		report("  Object3D, none moved", count, time([&] { root.updateWorld(); }, runs));
+	}
+
+	for (auto count : NODE_COUNTS) {
+		TransformHierarchy transforms;
+		std::vector<Object3D> objects;
+		objects.reserve(count / ANIMATED_OBJECT_NODES);
+		for (size_t i = 0; i < count / ANIMATED_OBJECT_NODES; i++) {
+			objects.push_back(buildObject(0, ANIMATED_OBJECT_NODES, transforms));
+		}
+		std::vector<Animator> animators(objects.size());
+		for (size_t i = 0; i < objects.size(); i++) {
+			animators[i].addAnimation(std::make_unique<RotationAnimation>(objects[i], ANIMATION_SECONDS,
+				glm::vec3(0, ANIMATION_SECONDS, 0)));
+			animators[i].start();
+		}
+		auto nodeCount = objects.size() * ANIMATED_OBJECT_NODES;
+		std::cout << nodeCount << " nodes in " << objects.size() << " animated objects" << std::endl;
+		for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+			WorkStealingPool pool(threads - 1);
+			FrameUpdate update(pool, transforms);
+			update.addAnimators(animators);
+			update.addObjects(objects);
+			report("  FrameUpdate, " + std::to_string(threads) + " threads", nodeCount,
+				time([&] { update.run(FRAME_SECONDS); }, runs));
+		}
+	}
+	return 0;
+}